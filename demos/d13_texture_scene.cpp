@@ -9,6 +9,8 @@
 
 #include"../include/shader.h"
 #include"../include/mesh.h"
+#include"../include/resource_registry.h"
+#include"../include/texture_array.h"
 
 int win_width = 1500, win_height = 900;
 
@@ -64,16 +66,24 @@ int main()
         return 0;
     }
 
-    //Load the meshes with the corresponding textures.
-    meshvft ground("../obj/vft/plane10x10.obj", "../images/texture/aerial_grass_rock_diff_4k.jpg");
-    meshvft wooden_stool("../obj/vft/wooden_stool.obj", "../images/texture/wooden_stool_diff_2k.jpg");
-    meshvft brick_cube("../obj/vft/cube1x1x1_correct_uv.obj", "../images/texture/red_brick_diff_2k.jpg");
-    meshvft wooden_container("../obj/vft/cube1x1x1_correct_uv.obj", "../images/texture/wooden_container_diff_512x512.jpg");
-    meshvft plant_pot("../obj/vft/plant_pot.obj", "../images/texture/potted_plant_pot_diff_2k.png");
-    meshvft plant_leaves("../obj/vft/plant_leaves.obj", "../images/texture/potted_plant_leaves_diff_2k.png");
-
-    shader texshad("../shaders/vertex/trans_mvp_texture.vert","../shaders/fragment/texture.frag");
+    //Load the meshes with the corresponding textures. All the textures are layers of 1 texture array (see texture_array.h), so the whole
+    //scene is drawn with 1 texture binding. The layers are block compressed with their mipmaps and cached next to the images (see texture_cache.h) :
+    //4-6x less gpu memory, and from the 2nd run on, no image decoding at all.
+    texture_array textures(2048, 2048); //Layers of at most 2048x2048, and no larger than the smallest image.
+    resource_registry registry; //The 2 cubes share 1 geometry, which is parsed and uploaded only once.
+    std::shared_ptr<meshvft> ground = registry.get<meshvft>("../obj/vft/plane10x10.obj", textures.add("../images/texture/aerial_grass_rock_diff_4k.jpg"));
+    std::shared_ptr<meshvft> wooden_stool = registry.get<meshvft>("../obj/vft/wooden_stool.obj", textures.add("../images/texture/wooden_stool_diff_2k.jpg"));
+    std::shared_ptr<meshvft> brick_cube = registry.get<meshvft>("../obj/vft/cube1x1x1_correct_uv.obj", textures.add("../images/texture/red_brick_diff_2k.jpg"));
+    std::shared_ptr<meshvft> wooden_container = registry.get<meshvft>("../obj/vft/cube1x1x1_correct_uv.obj", textures.add("../images/texture/wooden_container_diff_512x512.jpg"));
+    std::shared_ptr<meshvft> plant_pot = registry.get<meshvft>("../obj/vft/plant_pot.obj", textures.add("../images/texture/potted_plant_pot_diff_2k.png"));
+    std::shared_ptr<meshvft> plant_leaves = registry.get<meshvft>("../obj/vft/plant_leaves.obj", textures.add("../images/texture/potted_plant_leaves_diff_2k.png"));
+    textures.build(mesh_compress_texture); //Decoded (or read from their cache files) all at once.
+    textures.print_stats();
+    registry.print_stats();
+
+    shader texshad("../shaders/vertex/trans_mvp_texture.vert","../shaders/fragment/texture_array.frag");
     texshad.use();
+    textures.bind(); //Once for the whole scene : the meshes do not bind their own textures.
 
     glm::mat4 projection, view, model;
 
@@ -91,32 +101,38 @@ int main()
         //Ground :
         model = glm::mat4(1.0f);
         texshad.set_mat4_uniform("model", model);
-        ground.draw_triangles();
+        texshad.set_int_uniform("layer", (int)ground->get_texture_layer());
+        ground->draw_triangles();
 
         //Wooden stool :
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(2.0f,0.0f,0.0f));
         texshad.set_mat4_uniform("model", model);
-        wooden_stool.draw_triangles();
+        texshad.set_int_uniform("layer", (int)wooden_stool->get_texture_layer());
+        wooden_stool->draw_triangles();
 
         //Brick cube :
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(-1.0f,0.5f,0.5f));
         texshad.set_mat4_uniform("model", model);
-        brick_cube.draw_triangles();
+        texshad.set_int_uniform("layer", (int)brick_cube->get_texture_layer());
+        brick_cube->draw_triangles();
 
         //Wooden container :
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(0.0f,-0.8f,0.5f));
         texshad.set_mat4_uniform("model", model);
-        wooden_container.draw_triangles();
+        texshad.set_int_uniform("layer", (int)wooden_container->get_texture_layer());
+        wooden_container->draw_triangles();
 
         //Plant (pot and leaves) :
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(0.7f,0.7f,0.0f)); //Redundant...
         texshad.set_mat4_uniform("model", model);
-        plant_pot.draw_triangles();
-        plant_leaves.draw_triangles();
+        texshad.set_int_uniform("layer", (int)plant_pot->get_texture_layer());
+        plant_pot->draw_triangles();
+        texshad.set_int_uniform("layer", (int)plant_leaves->get_texture_layer());
+        plant_leaves->draw_triangles();
 
         glfwSwapBuffers(window);
         glfwPollEvents();
@@ -4,9 +4,11 @@
 #include<glm/gtc/matrix_transform.hpp>
 #include<glm/gtc/type_ptr.hpp>
 #include<cstdio>
+#include<memory>
 
 #include"../include/shader.h"
 #include"../include/mesh.h"
+#include"../include/cube_map_convert.h"
 #include"../include/camera.h"
 
 camera cam(glm::vec3(0.0f, -10.0f, 0.0f));
@@ -115,7 +117,8 @@ void framebuffer_size_callback(GLFWwindow */*win*/, int w, int h)
     glViewport(0,0,w,h);
 }
 
-int main()
+//Run it with an image path to load the sky from that single image instead of 6 (an equirectangular panorama, or a cross of the 6 faces).
+int main(int argc, char **argv)
 {
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
@@ -161,13 +164,34 @@ int main()
     shadsuz.set_vec3_uniform("light_col", light_col);
     shadsuz.set_vec3_uniform("mesh_col", mesh_col);
 
-    //Make sure that the images have all the same size in pixels (e.g. 2048x2048, 500x500, etc..) AND channels.
-    skybox sb("../images/skyboxes/landscape_2k/right.jpg",
-              "../images/skyboxes/landscape_2k/left.jpg",
-              "../images/skyboxes/landscape_2k/top.jpg",
-              "../images/skyboxes/landscape_2k/bottom.jpg",
-              "../images/skyboxes/landscape_2k/front.jpg",
-              "../images/skyboxes/landscape_2k/back.jpg");
+    std::unique_ptr<skybox> sb;
+    if (argc > 1)
+    {
+        //1 image decoded, converted to the 6 faces (and their mipmaps) in 1 compute pass on the gpu. See cube_map_convert.h.
+        shader converter("../shaders/compute/cube_map_from_image.comp");
+        cube_map_conversion_stats stats;
+        sb.reset(new skybox(cube_map_from_image(argv[1], converter, cube_map_auto, 0, &stats)));
+        const char *layout_names[4] = { "", "equirectangular", "horizontal cross", "vertical cross" };
+        printf("Skybox '%s' (%s) decoded in %.1f ms, converted to 6 faces of %dx%d in %.1f ms\n", argv[1], layout_names[stats.layout],
+               stats.decode_ms, stats.face_size, stats.face_size, stats.convert_ms);
+    }
+    else
+    {
+        //Make sure that the images have all the same size in pixels (e.g. 2048x2048, 500x500, etc..) AND channels.
+        sb.reset(new skybox("../images/skyboxes/landscape_2k/right.jpg",
+                            "../images/skyboxes/landscape_2k/left.jpg",
+                            "../images/skyboxes/landscape_2k/top.jpg",
+                            "../images/skyboxes/landscape_2k/bottom.jpg",
+                            "../images/skyboxes/landscape_2k/front.jpg",
+                            "../images/skyboxes/landscape_2k/back.jpg",
+                            mesh_compress_texture)); //Block compressed and cached next to the images, so later runs decode nothing.
+
+        //The 6 faces decode concurrently, so the total is about the slowest face instead of the sum of all 6.
+        const char *face_names[6] = { "right", "left", "top", "bottom", "front", "back" };
+        for (int i = 0; i < 6; i++)
+            printf("Skybox face %-6s decoded in %6.1f ms\n", face_names[i], sb->get_face_decode_ms(i));
+        printf("Skybox decoded in %.1f ms\n", sb->get_decode_ms());
+    }
 
     shader shadsb("../shaders/vertex/skybox.vert","../shaders/fragment/skybox.frag");
 
@@ -206,7 +230,7 @@ int main()
         shadsb.set_mat4_uniform("projection", projection);
         shadsb.set_mat4_uniform("view", view);
         shadsb.set_mat4_uniform("model", model);
-        sb.draw_triangles();
+        sb->draw_triangles();
 
         glfwSwapBuffers(window);
         glfwPollEvents();
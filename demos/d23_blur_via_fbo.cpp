@@ -9,34 +9,32 @@
 
 #include"../include/shader.h"
 #include"../include/mesh.h"
+#include"../include/resource_registry.h"
+#include"../include/texture_array.h"
+#include"../include/texture_streamer.h"
+#include"../include/gl_handle.h"
 
 int win_width = 1500, win_height = 900;
-unsigned int fbo, fbo_tex, rbo; //Framebuffer object, framebuffer object (attached) textured and renderbuffer object.
+gl_framebuffer fbo; //Framebuffer object.
+gl_texture fbo_tex; //Framebuffer object (attached) texture.
+gl_renderbuffer rbo; //Renderbuffer object.
 
 void setup_framebuffer(int width, int height)
 {   
-    //If it exists, delete it first. This if statement will NOT run in the first fbo setup, coz the fbo will not exist,
-    //but WILL run every time the framebuffer is resized.
-    if (fbo != 0)
-    {
-        glDeleteFramebuffers(1, &fbo);
-        glDeleteTextures(1, &fbo_tex);
-        glDeleteRenderbuffers(1, &rbo);
-    }
-
-    //Generate a new framebuffer.
-    glGenFramebuffers(1, &fbo);
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    //Generate a new framebuffer. Every time the framebuffer is resized, assigning the new objects to the handles deletes the old ones
+    //(in the first fbo setup there are no old ones).
+    fbo = gl_framebuffer::create();
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo.get());
 
     //Generate a new texture to store the rendered scene.
-    glGenTextures(1, &fbo_tex);
-    glBindTexture(GL_TEXTURE_2D, fbo_tex);
+    fbo_tex = gl_texture::create();
+    glBindTexture(GL_TEXTURE_2D, fbo_tex.get());
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
     //Attach the generated teture the framebuffer.
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fbo_tex, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fbo_tex.get(), 0);
 
     //Now generate the depth buffer. Remember, we have to do this manually, unlike the default depth buffer, which
     //is generated either by glfw or the OpenGL kernel. A framebuffer is basically a container that holds multiple
@@ -45,10 +43,10 @@ void setup_framebuffer(int width, int height)
     //are used to store color, depth, and stencil information. Framebuffers seem to work similarly with vaos and vbos.
     //As I was saying..., You need a bunch of buffers to work. For the default framebuffer, everything is setup for you.
     //However when you create a new framebuffer, you also have to setup the addtitional-for-rendering buffers (depth buffer in our case).
-    glGenRenderbuffers(1, &rbo);
-    glBindRenderbuffer(GL_RENDERBUFFER, rbo);
+    rbo = gl_renderbuffer::create();
+    glBindRenderbuffer(GL_RENDERBUFFER, rbo.get());
     glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rbo.get());
     //Optional for both depth AND stencil buffer.
     //glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
     //glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo);
@@ -112,14 +110,22 @@ int main()
         return 0;
     }
 
-    //Load the meshes with the corresponding textures.
-    meshvft ground("../obj/vft/plane10x10.obj", "../images/texture/aerial_grass_rock_diff_4k.jpg");
-    meshvft wooden_stool("../obj/vft/wooden_stool.obj", "../images/texture/wooden_stool_diff_2k.jpg");
-    meshvft brick_cube("../obj/vft/cube1x1x1_correct_uv.obj", "../images/texture/red_brick_diff_2k.jpg");
-    meshvft wooden_container("../obj/vft/cube1x1x1_correct_uv.obj", "../images/texture/wooden_container_diff_512x512.jpg");
-    meshvft plant_pot("../obj/vft/plant_pot.obj", "../images/texture/potted_plant_pot_diff_2k.png");
-    meshvft plant_leaves("../obj/vft/plant_leaves.obj", "../images/texture/potted_plant_leaves_diff_2k.png");
-    shader texshad("../shaders/vertex/trans_mvp_texture.vert","../shaders/fragment/texture.frag");
+    //Load the meshes with the corresponding textures. All the textures are layers of 1 texture array (see texture_array.h), so the whole
+    //scene is drawn with 1 texture binding. The layers stream in over the first frames through a ring of pixel buffers (see texture_streamer.h),
+    //so the window shows up at once instead of after all the images are decoded and uploaded.
+    texture_streamer streamer;
+    texture_array textures(2048, 2048); //Layers of at most 2048x2048, and no larger than the smallest image.
+    resource_registry registry; //The 2 cubes share 1 geometry, which is parsed and uploaded only once.
+    std::shared_ptr<meshvft> ground = registry.get<meshvft>("../obj/vft/plane10x10.obj", textures.add("../images/texture/aerial_grass_rock_diff_4k.jpg"));
+    std::shared_ptr<meshvft> wooden_stool = registry.get<meshvft>("../obj/vft/wooden_stool.obj", textures.add("../images/texture/wooden_stool_diff_2k.jpg"));
+    std::shared_ptr<meshvft> brick_cube = registry.get<meshvft>("../obj/vft/cube1x1x1_correct_uv.obj", textures.add("../images/texture/red_brick_diff_2k.jpg"));
+    std::shared_ptr<meshvft> wooden_container = registry.get<meshvft>("../obj/vft/cube1x1x1_correct_uv.obj", textures.add("../images/texture/wooden_container_diff_512x512.jpg"));
+    std::shared_ptr<meshvft> plant_pot = registry.get<meshvft>("../obj/vft/plant_pot.obj", textures.add("../images/texture/potted_plant_pot_diff_2k.png"));
+    std::shared_ptr<meshvft> plant_leaves = registry.get<meshvft>("../obj/vft/plant_leaves.obj", textures.add("../images/texture/potted_plant_leaves_diff_2k.png"));
+    textures.build(streamer);
+    textures.print_stats();
+    registry.print_stats();
+    shader texshad("../shaders/vertex/trans_mvp_texture.vert","../shaders/fragment/texture_array.frag");
 
     quadtex quad;
     shader blurshad("../shaders/vertex/trans_nothing_texture.vert", "../shaders/fragment/blur.frag");
@@ -132,10 +138,13 @@ int main()
     glClearColor(0.0f,0.3f,0.5f,1.0f);
     while (!glfwWindowShouldClose(window))
     {
+        streamer.update(2.0f); //At most ~2 ms of texture uploads per frame.
+
         /* First rendering pass : Render the entire 3D scene in the fbo, which we will never see it in the monitor. */
 
         texshad.use();
-        glBindFramebuffer(GL_FRAMEBUFFER, fbo); //Bind the "hidden" framebuffer.
+        textures.bind(); //Once for the whole scene : the meshes do not bind their own textures.
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo.get()); //Bind the "hidden" framebuffer.
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); //Apply clearance commands (to the "hidden" framebuffer).
 
         projection = glm::perspective(glm::radians(45.0f), (float)win_width/(float)win_height, 0.01f,100.0f);
@@ -146,32 +155,38 @@ int main()
         //Ground :
         model = glm::mat4(1.0f);
         texshad.set_mat4_uniform("model", model);
-        ground.draw_triangles();
+        texshad.set_int_uniform("layer", (int)ground->get_texture_layer());
+        ground->draw_triangles();
 
         //Wooden stool :
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(2.0f,0.0f,0.0f));
         texshad.set_mat4_uniform("model", model);
-        wooden_stool.draw_triangles();
+        texshad.set_int_uniform("layer", (int)wooden_stool->get_texture_layer());
+        wooden_stool->draw_triangles();
 
         //Brick cube :
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(-1.0f,0.5f,0.5f));
         texshad.set_mat4_uniform("model", model);
-        brick_cube.draw_triangles();
+        texshad.set_int_uniform("layer", (int)brick_cube->get_texture_layer());
+        brick_cube->draw_triangles();
 
         //Wooden container :
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(0.0f,-0.8f,0.5f));
         texshad.set_mat4_uniform("model", model);
-        wooden_container.draw_triangles();
+        texshad.set_int_uniform("layer", (int)wooden_container->get_texture_layer());
+        wooden_container->draw_triangles();
 
         //Plant (pot and leaves) :
         model = glm::mat4(1.0f);
         model = glm::translate(model, glm::vec3(0.7f,0.7f,0.0f)); //Redundant...
         texshad.set_mat4_uniform("model", model);
-        plant_pot.draw_triangles();
-        plant_leaves.draw_triangles();
+        texshad.set_int_uniform("layer", (int)plant_pot->get_texture_layer());
+        plant_pot->draw_triangles();
+        texshad.set_int_uniform("layer", (int)plant_leaves->get_texture_layer());
+        plant_leaves->draw_triangles();
 
         /*
         Second rendering pass : Render only 1 windowed-fullscreen quad in the displayed fbo. The whole 3D scene however is
@@ -192,7 +207,7 @@ int main()
         blurshad.use();
         glBindFramebuffer(GL_FRAMEBUFFER, 0); //Bind to the default framebuffer (the one we will see in the monitor).
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); //Apply clearance commands (to the displayed framebuffer).
-        quad.draw_triangles(fbo_tex); //Draw only the quad.
+        quad.draw_triangles(fbo_tex.get()); //Draw only the quad.
 
         glfwSwapBuffers(window);
         glfwPollEvents();
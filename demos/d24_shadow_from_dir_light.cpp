@@ -8,9 +8,16 @@
 #include<glm/gtc/matrix_transform.hpp>
 #include<glm/gtc/type_ptr.hpp>
 #include<cstdio>
+#include<chrono>
+#include<vector>
 
 #include"../include/shader.h"
 #include"../include/mesh.h"
+#include"../include/mesh_loader.h"
+#include"../include/mesh_pool.h"
+#include"../include/mesh_indirect.h"
+#include"../include/frustum.h"
+#include"../include/gl_handle.h"
 #include"../include/camera.h"
 
 camera cam(glm::vec3(0.0f, -20.0f, 3.0f), glm::vec3(0.0f, 0.0f, 1.0f), 90.0f); //Set the camera.
@@ -23,7 +30,8 @@ bool cursor_visible = false;
 
 int win_width = 1200, win_height = 900;
 
-unsigned int fbo_depth, tex_depth; //IDs to hold the fbo and the depth texture (shadow map).
+gl_framebuffer fbo_depth; //The fbo and the depth texture (shadow map).
+gl_texture tex_depth;
 
 //Resolution of the shadow map texture. The higher, the better the final render of the shadow, but also more memory consumption and poorer performance.
 //Think of it like a classical image creation. 1k, 2k, 4k, etc... The more pixels in the image, the higher its detail. The shadow map-tex (as we will see later),
@@ -33,10 +41,10 @@ const int shadow_tex_reso_x = 4096, shadow_tex_reso_y = 4096; //4k image resolut
 
 void setup_fbo_depth()
 {
-    glGenFramebuffers(1, &fbo_depth); //Create fbo and assign ID.
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo_depth); //This means that all subsequent fb operations affect the fbo_depth.
-    glGenTextures(1, &tex_depth); //Create tex and assign ID.
-    glBindTexture(GL_TEXTURE_2D, tex_depth); //This means that all subsequent tex operations affect the tex_depth.
+    fbo_depth = gl_framebuffer::create(); //Create fbo.
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo_depth.get()); //This means that all subsequent fb operations affect the fbo_depth.
+    tex_depth = gl_texture::create(); //Create tex.
+    glBindTexture(GL_TEXTURE_2D, tex_depth.get()); //This means that all subsequent tex operations affect the tex_depth.
     //Actually create the depth texture with the specified resolution. Stored as floats and initialized as NULL because no data is provided yet.
     glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, shadow_tex_reso_x, shadow_tex_reso_y, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -46,7 +54,7 @@ void setup_fbo_depth()
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);  
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
     glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border_col);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, tex_depth, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, tex_depth.get(), 0);
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
         printf("Hidden framebuffer not complete!\n");
 
@@ -214,22 +222,34 @@ int main()
     imstyle.FrameRounding = 5.0f;
     imstyle.WindowRounding = 5.0f;
 
-    //Load the scene's meshes.
-    meshvfn didymain("../obj/vfn/asteroids/didymos/didymain2019.obj");
-    meshvfn dimorphos("../obj/vfn/asteroids/didymos/dimorphos_ellipsoid.obj");
-    meshvfn ryugu("../obj/vfn/asteroids/ryugu196k.obj");
-    meshvfn gerasimenko("../obj/vfn/asteroids/gerasimenko256k.obj");
-    meshvfn room("../obj/vfn/open_room30x30x5.obj");
-    meshvfn cube("../obj/vfn/cube2x2x2.obj");
-    meshvfn sphere("../obj/vfn/uv_sphere_rad1_40x30.obj");
-    meshvfn stool("../obj/vfn/stool.obj");
-    meshvfn suzanne("../obj/vfn/suzanne.obj");
+    //Load the scene's meshes. The big ones load in the background, so the window shows up at once. Until they arrive, a sphere is drawn in their place.
+    //All of them live in 1 pool, so both passes bind 1 vao for the whole scene instead of 1 per mesh.
+    mesh_pool<meshvfn> pool;
+    mesh_loader loader;
+    mesh_handle<meshvfn> didymain = loader.load<meshvfn>("../obj/vfn/asteroids/didymos/didymain2019.obj", pool);
+    mesh_handle<meshvfn> dimorphos = loader.load<meshvfn>("../obj/vfn/asteroids/didymos/dimorphos_ellipsoid.obj", pool);
+    mesh_handle<meshvfn> ryugu = loader.load<meshvfn>("../obj/vfn/asteroids/ryugu196k.obj", pool);
+    mesh_handle<meshvfn> gerasimenko = loader.load<meshvfn>("../obj/vfn/asteroids/gerasimenko256k.obj", pool);
+    mesh_handle<meshvfn> stool = loader.load<meshvfn>("../obj/vfn/stool.obj", pool);
+    mesh_handle<meshvfn> suzanne = loader.load<meshvfn>("../obj/vfn/suzanne.obj", pool);
+    meshvfn room("../obj/vfn/open_room30x30x5.obj", pool);
+    meshvfn cube("../obj/vfn/cube2x2x2.obj", pool);
+    meshvfn sphere("../obj/vfn/uv_sphere_rad1_40x30.obj", pool);
     
     //Shaders : 1 for the scene as perceived by the directional light and 1 for the scene as perceived by the camera. The first shader is gonna
     //be used to calculate a special info only (depth). The second shader is gonna use that info to compute all the fragment colors (ambient, diffuse, etc... AND shadows).
     shader shad_depth("../shaders/vertex/trans_dir_light_mvp.vert","../shaders/fragment/nothing.frag");
     shader shad_dir_light_with_shadow("../shaders/vertex/trans_mvpn_shadow.vert","../shaders/fragment/dir_light_ad_shadow.frag");
 
+    //The same 2 shaders for multi-draw indirect submission, which read the model matrices and colors from the draw list's buffer.
+    shader shad_depth_indirect("../shaders/vertex/trans_dir_light_mvp_indirect.vert","../shaders/fragment/nothing.frag");
+    shader shad_dir_light_with_shadow_indirect("../shaders/vertex/trans_mvpn_shadow_indirect.vert","../shaders/fragment/dir_light_ad_shadow_indirect.frag");
+    indirect_draw_list<meshvfn> draws_shadow(pool), draws_main(pool); //1 per pass, because each pass draws the objects that are inside its own frustum.
+
+    //Objects outside the light's cuboid or the camera's frustum are skipped in the corresponding pass.
+    frustum_culler culler;
+    std::vector<unsigned int> visible_shadow, visible_main; //Indices of the objects to draw in each pass.
+
     //This shader is only used to render the geometry model of the directional light in our scene.
     meshvf arrows("../obj/vf/dir_light_arrows.obj");
     shader shad_arrows("../shaders/vertex/trans_mvp.vert","../shaders/fragment/monochromatic.frag");
@@ -242,6 +262,8 @@ int main()
     shad_dir_light_with_shadow.use();
     shad_dir_light_with_shadow.set_vec3_uniform("mesh_col", mesh_col);
     shad_dir_light_with_shadow.set_vec3_uniform("light_col", light_col);
+    shad_dir_light_with_shadow_indirect.use();
+    shad_dir_light_with_shadow_indirect.set_vec3_uniform("light_col", light_col);
 
     glm::mat4 dir_light_projection, dir_light_view, dir_light_pv; //Directional light's matrices.
 
@@ -258,6 +280,10 @@ int main()
         t0 = tnow;
         event_tick(window);
 
+        //Send the meshes that finished loading to the gpu, spending at most ~2 ms of this frame on it.
+        if (loader.upload_pending(2.0f) > 0 && loader.get_num_pending() == 0)
+            pool.print_occupancy();
+
         /* Directional light definition in the code. */        
 
         //We want to simulate the shadow effects produced by a hypothetical infinitely far (directional) light. Since the light rays are considered to
@@ -285,83 +311,109 @@ int main()
         projection = glm::perspective(glm::radians(cam.fov), (float)win_width/win_height, 0.05f,500.0f);
         view = cam.view(); cam.move(time_tick);
 
+        //The scene's objects : which mesh is drawn where. Rebuilt every frame, because dimorphos moves and the meshes that are still loading are replaced by the sphere.
+        const unsigned int num_objects = 9;
+        meshvfn *object_meshes[num_objects] = { &didymain.get_or(sphere), &dimorphos.get_or(sphere), &ryugu.get_or(sphere), &gerasimenko.get_or(sphere),
+                                                &room, &cube, &sphere, &stool.get_or(sphere), &suzanne.get_or(sphere) };
+        glm::mat4 object_models[num_objects] = { glm::translate(glm::mat4(1.0f), glm::vec3(0.0f,12.0f,3.0f)),
+                                                 glm::translate(glm::mat4(1.0f), glm::vec3(1.5f*sin(tnow),11.0f,3.0f)),
+                                                 glm::translate(glm::mat4(1.0f), glm::vec3(-13.0f,2.0f,2.0f)),
+                                                 glm::translate(glm::mat4(1.0f), glm::vec3(6.0f,10.0f,3.0f)),
+                                                 glm::mat4(1.0f),
+                                                 glm::translate(glm::mat4(1.0f), glm::vec3(-12.0f,12.0f,2.0f)),
+                                                 glm::translate(glm::mat4(1.0f), glm::vec3(-5.0f,13.0f,2.0f)),
+                                                 glm::translate(glm::mat4(1.0f), glm::vec3(13.0f,13.0f,0.54f)),
+                                                 glm::translate(glm::mat4(1.0f), glm::vec3(13.0f,4.0f,2.0f)) };
+
+        //2 ways to submit the scene : 1 model uniform and 1 draw call per object and pass, or 1 multi-draw indirect per pass (with the model
+        //matrices and colors in a buffer). The cpu time spent on culling and on the submission of both passes is measured for the gui.
+        static bool multi_draw_indirect = false, frustum_culling = true;
+        std::chrono::steady_clock::time_point submission_start = std::chrono::steady_clock::now();
+        culler.clear();
+        for (unsigned int i = 0; i < num_objects; i++) //World space bounding spheres.
+            culler.add(object_models[i], object_meshes[i]->get_bounding_sphere());
+        frustum_cull_stats cull_stats_shadow = {num_objects, 0}, cull_stats_main = {num_objects, 0};
+        if (frustum_culling)
+        {
+            cull_stats_shadow = culler.cull(frustum(dir_light_pv), visible_shadow);
+            cull_stats_main = culler.cull(frustum(projection*view), visible_main);
+        }
+        else
+        {
+            visible_shadow.resize(num_objects);
+            for (unsigned int i = 0; i < num_objects; i++)
+                visible_shadow[i] = i;
+            visible_main = visible_shadow;
+        }
+        if (multi_draw_indirect)
+        {
+            draws_shadow.clear();
+            for (unsigned int i : visible_shadow)
+                draws_shadow.add(*object_meshes[i], object_models[i], glm::vec4(mesh_col, 1.0f));
+            draws_shadow.upload();
+            draws_main.clear();
+            for (unsigned int i : visible_main)
+                draws_main.add(*object_meshes[i], object_models[i], glm::vec4(mesh_col, 1.0f));
+            draws_main.upload();
+        }
+
         //Bind the fbo_depth to render the shadow map.
-        glBindFramebuffer(GL_FRAMEBUFFER, fbo_depth);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo_depth.get());
         glViewport(0,0, shadow_tex_reso_x,shadow_tex_reso_y);
         glClear(GL_DEPTH_BUFFER_BIT); //Clear only depth, coz we write only depth in this buffer. There's no color attachment.
-        shad_depth.use();
-        shad_depth.set_mat4_uniform("dir_light_pv", dir_light_pv);
         //Now transform the models and render to the fbo_depth.
-        model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f,12.0f,3.0f));
-            shad_depth.set_mat4_uniform("model", model);
-            didymain.draw_triangles();
-        model = glm::translate(glm::mat4(1.0f), glm::vec3(1.5f*sin(tnow),11.0f,3.0f));
-            shad_depth.set_mat4_uniform("model", model);
-            dimorphos.draw_triangles();
-        model = glm::translate(glm::mat4(1.0f), glm::vec3(-13.0f,2.0f,2.0f));
-            shad_depth.set_mat4_uniform("model", model);
-            ryugu.draw_triangles();
-        model = glm::translate(glm::mat4(1.0f), glm::vec3(6.0f,10.0f,3.0f));
-            shad_depth.set_mat4_uniform("model", model);
-            gerasimenko.draw_triangles();
-        model = glm::mat4(1.0f);
-            shad_depth.set_mat4_uniform("model", model);
-            room.draw_triangles();
-        model = glm::translate(glm::mat4(1.0f), glm::vec3(-12.0f,12.0f,2.0f));
-            shad_depth.set_mat4_uniform("model", model);
-            cube.draw_triangles();
-        model = glm::translate(glm::mat4(1.0f), glm::vec3(-5.0f,13.0f,2.0f));
-            shad_depth.set_mat4_uniform("model", model);
-            sphere.draw_triangles();
-        model = glm::translate(glm::mat4(1.0f), glm::vec3(13.0f,13.0f,0.54f));
-            shad_depth.set_mat4_uniform("model", model);
-            stool.draw_triangles();
-        model = glm::translate(glm::mat4(1.0f), glm::vec3(13.0f,4.0f,2.0f));
-            shad_depth.set_mat4_uniform("model", model);
-            suzanne.draw_triangles();
+        if (multi_draw_indirect)
+        {
+            shad_depth_indirect.use();
+            shad_depth_indirect.set_mat4_uniform("dir_light_pv", dir_light_pv);
+            draws_shadow.draw();
+        }
+        else
+        {
+            shad_depth.use();
+            shad_depth.set_mat4_uniform("dir_light_pv", dir_light_pv);
+            pool.bind();
+            for (unsigned int i : visible_shadow)
+            {
+                shad_depth.set_mat4_uniform("model", object_models[i]);
+                pool.draw_triangles(*object_meshes[i]);
+            }
+            pool.unbind();
+        }
 
         //Bind the default fbo to render the scene to the window.
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
         glViewport(0,0, win_width, win_height);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); //Now we have both depth and color (unlike to the fbo_depth).
-        shad_dir_light_with_shadow.use();
-        shad_dir_light_with_shadow.set_mat4_uniform("projection", projection);
-        shad_dir_light_with_shadow.set_mat4_uniform("view", view);
-        shad_dir_light_with_shadow.set_vec3_uniform("light_dir", light_dir);
-        shad_dir_light_with_shadow.set_mat4_uniform("dir_light_pv", dir_light_pv);
+        shader &shad_main = multi_draw_indirect ? shad_dir_light_with_shadow_indirect : shad_dir_light_with_shadow;
+        shad_main.use();
+        shad_main.set_mat4_uniform("projection", projection);
+        shad_main.set_mat4_uniform("view", view);
+        shad_main.set_vec3_uniform("light_dir", light_dir);
+        shad_main.set_mat4_uniform("dir_light_pv", dir_light_pv);
         glActiveTexture(GL_TEXTURE0); //Activate texture unit 0.
-        glBindTexture(GL_TEXTURE_2D, tex_depth); //Bind tex_depth to texture unit 0.
-        shad_dir_light_with_shadow.set_int_uniform("sample_shadow", 0); //Set sampler to use texture unit 0. This is handled automatically by OpenGL in case only 1 texture unit is used.
+        glBindTexture(GL_TEXTURE_2D, tex_depth.get()); //Bind tex_depth to texture unit 0.
+        shad_main.set_int_uniform("sample_shadow", 0); //Set sampler to use texture unit 0. This is handled automatically by OpenGL in case only 1 texture unit is used.
         //Now transform the models and render to the monitor.
-        model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f,12.0f,3.0f));
-            shad_dir_light_with_shadow.set_mat4_uniform("model", model);
-            didymain.draw_triangles();
-        model = glm::translate(glm::mat4(1.0f), glm::vec3(1.5f*sin(tnow),11.0f,3.0f));
-            shad_dir_light_with_shadow.set_mat4_uniform("model", model);
-            dimorphos.draw_triangles();
-        model = glm::translate(glm::mat4(1.0f), glm::vec3(-13.0f,2.0f,2.0f));
-            shad_dir_light_with_shadow.set_mat4_uniform("model", model);
-            ryugu.draw_triangles();
-        model = glm::translate(glm::mat4(1.0f), glm::vec3(6.0f,10.0f,3.0f));
-            shad_dir_light_with_shadow.set_mat4_uniform("model", model);
-            gerasimenko.draw_triangles();
-        model = glm::mat4(1.0f);
-            shad_dir_light_with_shadow.set_mat4_uniform("model", model);
-            room.draw_triangles();
-        model = glm::translate(glm::mat4(1.0f), glm::vec3(-12.0f,12.0f,2.0f));
-            shad_dir_light_with_shadow.set_mat4_uniform("model", model);
-            cube.draw_triangles();
-        model = glm::translate(glm::mat4(1.0f), glm::vec3(-5.0f,13.0f,2.0f));
-            shad_dir_light_with_shadow.set_mat4_uniform("model", model);
-            sphere.draw_triangles();
-        model = glm::translate(glm::mat4(1.0f), glm::vec3(13.0f,13.0f,0.54f));
-            shad_dir_light_with_shadow.set_mat4_uniform("model", model);
-            stool.draw_triangles();
-        model = glm::translate(glm::mat4(1.0f), glm::vec3(13.0f,4.0f,2.0f));
-            shad_dir_light_with_shadow.set_mat4_uniform("model", model);
-            suzanne.draw_triangles();
+        if (multi_draw_indirect)
+            draws_main.draw();
+        else
+        {
+            pool.bind();
+            for (unsigned int i : visible_main)
+            {
+                shad_main.set_mat4_uniform("model", object_models[i]);
+                pool.draw_triangles(*object_meshes[i]);
+            }
+            pool.unbind();
+        }
         glBindTexture(GL_TEXTURE_2D, 0); //Unbind the tex_depth.
 
+        //Smoothed, so that it can be read.
+        static float submission_ms = 0.0f;
+        std::chrono::duration<float, std::milli> submission_time = std::chrono::steady_clock::now() - submission_start;
+        submission_ms += 0.05f*(submission_time.count() - submission_ms);
+
         model = glm::translate(glm::mat4(1.0f), light_dir);
         //Check if the normalized light direction is almost aligned with the z-axis (north or south pole case).
         //However, When light_dir points directly along the -z axis (south pole), apply a 180-degree rotation.
@@ -391,6 +443,20 @@ int main()
         ImGui::Text("Right click to toggle the cursor.");
         ImGui::PopStyleColor();
 
+        if (loader.get_num_pending() > 0)
+            ImGui::Text("Meshes still loading : %u", loader.get_num_pending());
+        mesh_pool_stats pool_stats = pool.get_stats();
+        ImGui::Text("Mesh pool : %u meshes, %.1f / %.1f MB used", pool_stats.num_meshes, pool_stats.used_bytes/(1024.0*1024.0), pool_stats.gpu_bytes/(1024.0*1024.0));
+
+        ImGui::Dummy(ImVec2(0.0f, 20.0f));
+
+        ImGui::BulletText("Scene submission");
+        ImGui::Checkbox("Multi-draw indirect", &multi_draw_indirect);
+        ImGui::Checkbox("Frustum culling", &frustum_culling);
+        ImGui::Text("Shadow pass : %u visible, %u culled", cull_stats_shadow.visible, cull_stats_shadow.culled);
+        ImGui::Text("Main pass : %u visible, %u culled", cull_stats_main.visible, cull_stats_main.culled);
+        ImGui::Text("Cpu time of both passes : %.3f ms", submission_ms);
+
         ImGui::Dummy(ImVec2(0.0f, 20.0f));
 
         ImGui::BulletText("Light's orthographic frustum size");
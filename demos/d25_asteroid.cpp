@@ -12,6 +12,9 @@
 
 #include"../include/shader.h"
 #include"../include/mesh.h"
+#include"../include/gl_handle.h"
+#include"../include/mesh_bvh.h"
+#include"../include/camera.h"
 
 const float PI = glm::pi<float>();
 
@@ -19,14 +22,15 @@ int win_width = 1920, win_height = 1080;
 
 const int shadow_tex_reso_x = 4096, shadow_tex_reso_y = 4096; //Shadow image resolution.
 
-unsigned int fbo_depth, tex_depth; //IDs to hold the depth fbo and the depth texture (shadow map).
+gl_framebuffer fbo_depth; //The fbo and the depth texture (shadow map).
+gl_texture tex_depth;
 
 void setup_fbo_depth()
 {
-    glGenFramebuffers(1, &fbo_depth);
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo_depth);
-    glGenTextures(1, &tex_depth);
-    glBindTexture(GL_TEXTURE_2D, tex_depth);
+    fbo_depth = gl_framebuffer::create();
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo_depth.get());
+    tex_depth = gl_texture::create();
+    glBindTexture(GL_TEXTURE_2D, tex_depth.get());
     //Shadow mapping is highly sensitive to depth precision, hence the 32 bits.
     glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, shadow_tex_reso_x, shadow_tex_reso_y, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL); //NULL because no texture data is provided yet.
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -35,7 +39,7 @@ void setup_fbo_depth()
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);  
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
     glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border_col);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, tex_depth, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, tex_depth.get(), 0);
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
         fprintf(stderr, "Depth framebuffer is not completed!\n");
     glDrawBuffer(GL_NONE);
@@ -87,9 +91,13 @@ int main()
         return 0;
     }
 
-    meshvfn asteroid("../obj/vfn/asteroids/gerasimenko256k.obj");
-    shader shad_depth("../shaders/vertex/trans_dir_light_mvp.vert","../shaders/fragment/nothing.frag");
-    shader shad_dir_light_with_shadow("../shaders/vertex/trans_mvpn_shadow.vert","../shaders/fragment/dir_light_d_shadow.frag");
+    //Compact vertices (drawn with the *_quantized.vert shaders), simplified copies and meshlets.
+    meshvfn asteroid("../obj/vfn/asteroids/gerasimenko256k.obj", mesh_quantize | mesh_lod | mesh_meshlets);
+    double bvh_build_start = glfwGetTime();
+    mesh_bvh asteroid_bvh("../obj/vfn/asteroids/gerasimenko256k.obj"); //For picking the surface under the cursor.
+    float bvh_build_ms = 1000.0f*(float)(glfwGetTime() - bvh_build_start);
+    shader shad_depth("../shaders/vertex/trans_dir_light_mvp_quantized.vert","../shaders/fragment/nothing.frag");
+    shader shad_dir_light_with_shadow("../shaders/vertex/trans_mvpn_shadow_quantized.vert","../shaders/fragment/dir_light_d_shadow.frag");
 
     setup_fbo_depth();
 
@@ -113,6 +121,11 @@ int main()
     shad_dir_light_with_shadow.set_vec3_uniform("mesh_col", mesh_col);
     shad_dir_light_with_shadow.set_vec3_uniform("light_col", light_col);
 
+    glm::mat4 dequantization = asteroid.get_dequantization_matrix(); //Constant for the mesh, so set once.
+    shad_dir_light_with_shadow.set_mat4_uniform("dequantization", dequantization);
+    shad_depth.use();
+    shad_depth.set_mat4_uniform("dequantization", dequantization);
+
     float fc = 1.1f, fl = 1.2; //Scale factors : fc is for the ortho cube size and fl for the directional light dummy distance.
     float rmax = asteroid.get_farthest_vertex_distance(); //[km]
     float dir_light_dist = fl*rmax; //[km]
@@ -125,6 +138,8 @@ int main()
     glEnable(GL_CULL_FACE);
     glClearColor(0.0f,0.0f,0.0f,1.0f);
 
+    meshlet_draw_list visible_meshlets; //The meshlets of the asteroid that are on screen and face the camera, found every frame.
+
     while (!glfwWindowShouldClose(window))
     {
         //Essential calculation needed for rendering :
@@ -155,17 +170,60 @@ int main()
 
         glm::mat4 model = glm::rotate(glm::mat4(1.0f), 0.1f*(float)glfwGetTime(), glm::vec3(0.0f,0.0f,1.0f));
 
+        //Cpu queries, in the asteroid's coordinates (the bvh is built in them) : the surface point under the cursor, whether the
+        //sun reaches it, and the camera's altitude above the closest surface point.
+        glm::mat4 inv_model = glm::inverse(model);
+        bool cursor_on_asteroid = false, cursor_point_lit = false;
+        glm::vec3 cursor_point;
+        if (!io.WantCaptureMouse)
+        {
+            double cursor_x, cursor_y;
+            int window_w, window_h;
+            glfwGetCursorPos(window, &cursor_x, &cursor_y);
+            glfwGetWindowSize(window, &window_w, &window_h); //The cursor is in window units, which may differ from framebuffer pixels.
+            glm::vec3 ray_origin, ray_dir;
+            screen_ray(cursor_x, cursor_y, window_w, window_h, projection, view, ray_origin, ray_dir);
+            ray_origin = glm::vec3(inv_model*glm::vec4(ray_origin, 1.0f));
+            ray_dir = glm::mat3(inv_model)*ray_dir;
+            bvh_ray_hit hit;
+            if (asteroid_bvh.intersect(ray_origin, ray_dir, hit))
+            {
+                cursor_on_asteroid = true;
+                cursor_point = hit.point;
+                glm::vec3 to_light = glm::normalize(glm::mat3(inv_model)*light_dir);
+                cursor_point_lit = !asteroid_bvh.occluded(hit.point + 1e-4f*rmax*to_light, to_light);
+            }
+        }
+        bvh_closest_point below_cam = bvh_closest_point();
+        if (!asteroid_bvh.closest_point(glm::vec3(inv_model*glm::vec4(cam_pos, 1.0f)), below_cam))
+            below_cam.distance = glm::length(cam_pos); //No surface (empty bvh) : the distance to the asteroid's center.
+
+        //Levels of detail : the camera's view by the altitude above the surface, the shadow map by its texels per km.
+        static bool use_lods = true;
+        static float max_pixel_error = 1.0f;
+        unsigned int cam_lod = 0, shadow_lod = 0;
+        if (use_lods)
+        {
+            cam_lod = asteroid.select_lod(screen_pixels_per_unit(fov, below_cam.distance, win_height), max_pixel_error);
+            shadow_lod = asteroid.select_lod(shadow_tex_reso_y/(2.0f*fc*rmax), max_pixel_error);
+        }
+
+        //Meshlet culling, for the camera's view only : the light's view always holds the whole asteroid, and is orthographic.
+        static bool cull_meshlets = true;
+        if (cull_meshlets)
+            asteroid.cull_meshlets(projection*view, model, cam_pos, visible_meshlets, cam_lod);
+
         //Now we render :
 
         //1) Render to the depth framebuffer (used later for shadowing).
-        glBindFramebuffer(GL_FRAMEBUFFER, fbo_depth);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo_depth.get());
         glViewport(0,0, shadow_tex_reso_x,shadow_tex_reso_y);
         glDisable(GL_FRAMEBUFFER_SRGB);
         glClear(GL_DEPTH_BUFFER_BIT); //Only depth values exist in this framebuffer.
         shad_depth.use();
         shad_depth.set_mat4_uniform("dir_light_pv", dir_light_pv);
         shad_depth.set_mat4_uniform("model", model);
-        asteroid.draw_triangles();
+        asteroid.draw_triangles(shadow_lod);
 
         //2) Render to the default framebuffer (monitor).
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -181,9 +239,12 @@ int main()
         shad_dir_light_with_shadow.set_mat4_uniform("dir_light_pv", dir_light_pv);
         shad_dir_light_with_shadow.set_vec3_uniform("light_dir", light_dir);
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, tex_depth);
+        glBindTexture(GL_TEXTURE_2D, tex_depth.get());
         shad_dir_light_with_shadow.set_int_uniform("sample_shadow", 0);
-        asteroid.draw_triangles();   
+        if (cull_meshlets)
+            asteroid.draw_triangles(visible_meshlets);
+        else
+            asteroid.draw_triangles(cam_lod);
         glBindTexture(GL_TEXTURE_2D, 0);
 
         t += dt; //[sec]
@@ -208,6 +269,25 @@ int main()
         ImGui::SliderFloat("lat [deg]##cam_lat", &cam_lat, 0.0f, 180.0f);
         ImGui::BulletText("Gamma correction");
         ImGui::Checkbox("Apply", &apply_gamma_correction);
+        ImGui::BulletText("Surface under the cursor");
+        if (cursor_on_asteroid)
+            ImGui::Text("(%.3f, %.3f, %.3f) [km], %s", cursor_point.x, cursor_point.y, cursor_point.z, cursor_point_lit ? "lit" : "in shadow");
+        else
+            ImGui::Text("None");
+        ImGui::Text("Camera altitude : %.3f [km]", below_cam.distance);
+        ImGui::Text("BVH : %u nodes, built in %.0f ms", asteroid_bvh.get_stats().num_nodes, bvh_build_ms);
+        ImGui::BulletText("Level of detail");
+        ImGui::Checkbox("Simplify##use_lods", &use_lods);
+        ImGui::SliderFloat("max error [pixels]##max_pixel_error", &max_pixel_error, 0.25f, 8.0f);
+        ImGui::Text("Levels : %u (camera), %u (shadow) of %u", cam_lod, shadow_lod, asteroid.get_num_lods() - 1);
+        ImGui::BulletText("Meshlet culling");
+        ImGui::Checkbox("Cull##cull_meshlets", &cull_meshlets);
+        if (cull_meshlets)
+            ImGui::Text("Meshlets : %u drawn, %u off screen, %u facing away", visible_meshlets.stats.visible, visible_meshlets.stats.frustum_culled,
+                        visible_meshlets.stats.cone_culled);
+        unsigned int cam_triangles = cull_meshlets ? visible_meshlets.stats.triangles : asteroid.get_num_triangles(cam_lod);
+        unsigned int full = 2*asteroid.get_num_triangles(), drawn = cam_triangles + asteroid.get_num_triangles(shadow_lod);
+        ImGui::Text("Triangles : %u of %u (%.0f%% saved)", drawn, full, 100.0f*(1.0f - (float)drawn/full));
         ImGui::BulletText("Performance");
         ImGui::Text("FPS : [%.0f] ",ImGui::GetIO().Framerate);
         ImGui::End();
@@ -658,6 +658,14 @@ void framebuffer_size_callback(GLFWwindow */*win*/, int w, int h)
     glViewport(0,0,w,h);
 }
 
+//Level of detail of an asteroid, from the camera's distance to its bounding sphere (its model matrix only rotates and translates).
+unsigned int select_lod(const meshvfn &aster, const glm::mat4 &model, float max_pixel_error)
+{
+    glm::vec4 sphere = aster.get_bounding_sphere();
+    float distance = glm::distance(glm::vec3(model*glm::vec4(glm::vec3(sphere), 1.0f)), cam.pos) - sphere.w;
+    return aster.select_lod(cam.pixels_per_unit(distance, win_height), max_pixel_error);
+}
+
 void common_plot(const char *plot_label, const char *yaxis_label, bool &bool_plot_func, std::vector<double> &plot_data, std::vector<double> &time_data, double simulated_duration)
 {
     ImGui::SetNextWindowPos(ImVec2(ImGui::GetWindowPos().x + ImGui::GetWindowSize().x, ImGui::GetWindowPos().y), ImGuiCond_FirstUseEver);
@@ -768,16 +776,18 @@ int main()
     //const unsigned char *gpu_vendor = glGetString(GL_VENDOR);
 
     //Asteroid 1 along with its coordsys.
-    meshvfn aster1("../obj/vfn/asteroids/didymos/didymain2019.obj");
-    meshvfn aster1_axis_x("../obj/vfn/asteroids/didymos/didymain2019_pos_axis_x.obj");
-    meshvfn aster1_axis_y("../obj/vfn/asteroids/didymos/didymain2019_pos_axis_y.obj");
-    meshvfn aster1_axis_z("../obj/vfn/asteroids/didymos/didymain2019_pos_axis_z.obj");
+    meshvfn aster1("../obj/vfn/asteroids/didymos/didymain2019.obj", mesh_lod); //Simplified copies for when it's far away.
+    std::vector<meshvfn> aster1_axes; //x, y, z. Meshes are movable, so they are stored by value.
+    aster1_axes.emplace_back("../obj/vfn/asteroids/didymos/didymain2019_pos_axis_x.obj");
+    aster1_axes.emplace_back("../obj/vfn/asteroids/didymos/didymain2019_pos_axis_y.obj");
+    aster1_axes.emplace_back("../obj/vfn/asteroids/didymos/didymain2019_pos_axis_z.obj");
 
     //Asteroid 2 along with its coordsys.
-    meshvfn aster2("../obj/vfn/asteroids/didymos/dimorphos_ellipsoid.obj");
-    meshvfn aster2_axis_x("../obj/vfn/asteroids/didymos/dimorphos_ellipsoid_pos_axis_x.obj");
-    meshvfn aster2_axis_y("../obj/vfn/asteroids/didymos/dimorphos_ellipsoid_pos_axis_y.obj");
-    meshvfn aster2_axis_z("../obj/vfn/asteroids/didymos/dimorphos_ellipsoid_pos_axis_z.obj");
+    meshvfn aster2("../obj/vfn/asteroids/didymos/dimorphos_ellipsoid.obj", mesh_lod);
+    std::vector<meshvfn> aster2_axes; //x, y, z.
+    aster2_axes.emplace_back("../obj/vfn/asteroids/didymos/dimorphos_ellipsoid_pos_axis_x.obj");
+    aster2_axes.emplace_back("../obj/vfn/asteroids/didymos/dimorphos_ellipsoid_pos_axis_y.obj");
+    aster2_axes.emplace_back("../obj/vfn/asteroids/didymos/dimorphos_ellipsoid_pos_axis_z.obj");
 
     //This is just for visual convenience.
     meshvfn ref_ground("../obj/vfn/plane20x20_wavy.obj");
@@ -789,15 +799,17 @@ int main()
     glm::vec3 light_dir = glm::vec3(0.0f,-1.0f,0.5f);
     glm::vec3 light_col = glm::vec3(1.0f,1.0f,1.0f);
     glm::vec3 aster_col = glm::vec3(0.5f,0.5f,0.5f);
-    glm::vec3 axis_x_col = glm::vec3(1.0f,0.0f,0.0f);
-    glm::vec3 axis_y_col = glm::vec3(0.0f,1.0f,0.0f);
-    glm::vec3 axis_z_col = glm::vec3(0.0f,0.0f,1.0f);
+    glm::vec3 axis_cols[3] = { glm::vec3(1.0f,0.0f,0.0f), glm::vec3(0.0f,1.0f,0.0f), glm::vec3(0.0f,0.0f,1.0f) }; //x, y, z.
 
     shad.set_vec3_uniform("light_dir", light_dir);
     shad.set_vec3_uniform("light_col", light_col);
 
     glm::mat4 projection, view, model;
 
+    bool use_lods = true;
+    float max_pixel_error = 1.0f; //Simplification error allowed on screen [pixels].
+    unsigned int lod1 = 0, lod2 = 0;
+
     glEnable(GL_DEPTH_TEST);
     glClearColor(0.1f,0.1f,0.1f,1.0f);
 
@@ -841,14 +853,14 @@ int main()
         model = glm::rotate(model, (float)rpy1[0], glm::vec3(1.0f,0.0f,0.0f));
         shad.set_mat4_uniform("model", model);
         shad.set_vec3_uniform("mesh_col", aster_col);
-        aster1.draw_triangles();
+        lod1 = use_lods ? select_lod(aster1, model, max_pixel_error) : 0;
+        aster1.draw_triangles(lod1);
 
-        shad.set_vec3_uniform("mesh_col", axis_x_col);
-        aster1_axis_x.draw_triangles();
-        shad.set_vec3_uniform("mesh_col", axis_y_col);
-        aster1_axis_y.draw_triangles();
-        shad.set_vec3_uniform("mesh_col", axis_z_col);
-        aster1_axis_z.draw_triangles();
+        for (int i = 0; i < 3; i++)
+        {
+            shad.set_vec3_uniform("mesh_col", axis_cols[i]);
+            aster1_axes[i].draw_triangles();
+        }
 
 
 
@@ -862,14 +874,14 @@ int main()
         model = glm::rotate(model, (float)rpy2[0], glm::vec3(1.0f,0.0f,0.0f));
         shad.set_mat4_uniform("model", model);
         shad.set_vec3_uniform("mesh_col", aster_col);
-        aster2.draw_triangles();
+        lod2 = use_lods ? select_lod(aster2, model, max_pixel_error) : 0;
+        aster2.draw_triangles(lod2);
 
-        shad.set_vec3_uniform("mesh_col", axis_x_col);
-        aster2_axis_x.draw_triangles();
-        shad.set_vec3_uniform("mesh_col", axis_y_col);
-        aster2_axis_y.draw_triangles();
-        shad.set_vec3_uniform("mesh_col", axis_z_col);
-        aster2_axis_z.draw_triangles();
+        for (int i = 0; i < 3; i++)
+        {
+            shad.set_vec3_uniform("mesh_col", axis_cols[i]);
+            aster2_axes[i].draw_triangles();
+        }
 
 
 
@@ -938,6 +950,16 @@ int main()
             ImGui::BulletText("Pitch : %.1f [deg]", cam.pitch);
             ImGui::BulletText("FoV : %.1f [deg]", cam.fov);
         }
+        if (ImGui::CollapsingHeader("Level of detail"))
+        {
+            ImGui::Checkbox("Simplify far asteroids", &use_lods);
+            ImGui::SliderFloat("max error [pixels]", &max_pixel_error, 0.25f,8.0f);
+            ImGui::BulletText("Asteroid 1 : level %u of %u", lod1, aster1.get_num_lods() - 1);
+            ImGui::BulletText("Asteroid 2 : level %u of %u", lod2, aster2.get_num_lods() - 1);
+            unsigned int full = aster1.get_num_triangles() + aster2.get_num_triangles();
+            unsigned int drawn = aster1.get_num_triangles(lod1) + aster2.get_num_triangles(lod2);
+            ImGui::BulletText("Triangles : %u of %u (%.0f%% saved)", drawn, full, 100.0f*(1.0f - (float)drawn/full));
+        }
         if (ImGui::CollapsingHeader("Plots"))
         {
             ImGui::Checkbox("Energy", &show_energy_conservation);
@@ -0,0 +1,311 @@
+#include"../imgui/imgui.h"
+#include"../imgui/imgui_impl_glfw.h"
+#include"../imgui/imgui_impl_opengl3.h"
+
+#include<GL/glew.h>
+#include<GLFW/glfw3.h>
+#include<glm/glm.hpp>
+#include<glm/gtc/matrix_transform.hpp>
+#include<glm/gtc/quaternion.hpp>
+#include<glm/gtc/type_ptr.hpp>
+
+#include<cstdio>
+#include<chrono>
+#include<random>
+#include<vector>
+
+#include"../include/shader.h"
+#include"../include/mesh.h"
+#include"../include/instance_buffer.h"
+#include"../include/frustum.h"
+
+const float PI = glm::pi<float>();
+
+int win_width = 1920, win_height = 1080;
+
+//Orbit and spin of an asteroid of the belt. The belt is drawn with 1 instanced draw call, and the instances are rewritten every frame.
+struct belt_asteroid
+{
+    float orbit_radius, orbit_phase, orbit_rate; //[km], [rad], [rad/sec]
+    float height; //Distance from the belt's plane. [km]
+    glm::vec3 spin_axis;
+    float spin_rate; //[rad/sec]
+    float scale;
+};
+
+//Random belt of n asteroids between r_inner and r_outer. The orbital rates follow Kepler's 3rd law, i.e. they are proportional to r^(-3/2).
+std::vector<belt_asteroid> make_belt(size_t n, float r_inner, float r_outer)
+{
+    std::mt19937 rng(12345);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    std::vector<belt_asteroid> belt(n);
+    for (belt_asteroid &a : belt)
+    {
+        a.orbit_radius = sqrt(r_inner*r_inner + uniform(rng)*(r_outer*r_outer - r_inner*r_inner)); //Uniform surface density.
+        a.orbit_phase = 2.0f*PI*uniform(rng);
+        a.orbit_rate = 0.2f*pow(r_inner/a.orbit_radius, 1.5f);
+        a.height = 0.02f*(r_outer - r_inner)*normal(rng);
+        a.spin_axis = glm::normalize(glm::vec3(normal(rng), normal(rng), normal(rng)) + glm::vec3(0.0f,0.0f,1e-3f));
+        a.spin_rate = 2.0f*(uniform(rng) - 0.5f);
+        a.scale = 0.3f + 0.7f*uniform(rng)*uniform(rng); //Many small ones, few large ones.
+    }
+    return belt;
+}
+
+//Where the asteroid is at time t.
+instance_transform belt_transform(const belt_asteroid &a, float t)
+{
+    float theta = a.orbit_phase + a.orbit_rate*t;
+    glm::vec3 pos(a.orbit_radius*cos(theta), a.orbit_radius*sin(theta), a.height);
+    return instance_transform(pos, glm::angleAxis(a.spin_rate*t, a.spin_axis), a.scale);
+}
+
+void key_callback(GLFWwindow *window, int key, int /*scancode*/, int action, int /*mods*/)
+{
+    if (key == GLFW_KEY_ESCAPE && action == GLFW_RELEASE)
+        glfwSetWindowShouldClose(window, true);
+}
+
+void framebuffer_size_callback(GLFWwindow */*win*/, int w, int h)
+{
+    if (w < 1) w = 1;
+    if (h < 1) h = 1;
+    win_width = w;
+    win_height = h;
+    glViewport(0,0,w,h);
+}
+
+int main()
+{
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_SAMPLES, 4);
+    glfwWindowHint(GLFW_MAXIMIZED, GLFW_TRUE);
+    GLFWwindow *window = glfwCreateWindow(win_width, win_height, "Asteroid belt (instanced rendering)", NULL, NULL);
+    if (window == NULL)
+    {
+        printf("Failed to create glfw window. Exiting...\n");
+        glfwTerminate();
+        return 0;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetKeyCallback(window, key_callback);
+    glfwSwapInterval(0); //No vsync, so that the frame rate shows the cost of the belt.
+
+    glewExperimental = GL_TRUE;
+    if (glewInit() != GLEW_OK)
+    {
+        printf("Failed to initialize glew. Exiting...\n");
+        return 0;
+    }
+
+    meshvfn asteroids[2] = { meshvfn("../obj/vfn/asteroids/kleopatra4k.obj"), meshvfn("../obj/vfn/asteroids/toutatis3k_radar.obj") };
+    const char *asteroid_names[] = { "Kleopatra", "Toutatis" };
+    //1 shader per instance format (see instance_buffer.h).
+    shader shad_compact("../shaders/vertex/trans_mvpn_instanced_compact.vert","../shaders/fragment/dir_light_ad.frag");
+    shader shad_matrix("../shaders/vertex/trans_mvpn_instanced.vert","../shaders/fragment/dir_light_ad.frag");
+
+    //1 instance buffer per instance format and update mode, so that they can be compared. They grow to the belt's size on their first update.
+    instance_buffer<instance_transform> compact_instances[2] = { instance_buffer<instance_transform>(10000, instance_update_persistent),
+                                                                 instance_buffer<instance_transform>(10000, instance_update_orphan) };
+    instance_buffer<glm::mat4> matrix_instances[2] = { instance_buffer<glm::mat4>(10000, instance_update_persistent),
+                                                       instance_buffer<glm::mat4>(10000, instance_update_orphan) };
+
+    IMGUI_CHECKVERSION();
+    ImGui::CreateContext();
+    ImGuiIO &io = ImGui::GetIO();
+    io.IniFilename = NULL;
+    io.Fonts->AddFontFromFileTTF("../fonts/Arial.ttf", 15.0f);
+    (void)io;
+    ImGui::StyleColorsDark();
+    ImGui_ImplGlfw_InitForOpenGL(window, true);
+    ImGui_ImplOpenGL3_Init("#version 450");
+    ImGuiStyle &imstyle = ImGui::GetStyle();
+    imstyle.WindowMinSize = ImVec2(200.0f,200.0f);
+    imstyle.FrameRounding = 5.0f;
+    imstyle.WindowRounding = 5.0f;
+
+    glm::vec3 mesh_col = glm::vec3(0.8f,0.75f,0.7f);
+    glm::vec3 light_col = glm::vec3(1.0f,1.0f,1.0f);
+    for (shader *s : {&shad_compact, &shad_matrix})
+    {
+        s->use();
+        s->set_vec3_uniform("mesh_col", mesh_col);
+        s->set_vec3_uniform("light_col", light_col);
+    }
+
+    float rmax = asteroids[0].get_farthest_vertex_distance(); //[km]
+    float r_inner = 400.0f*rmax, r_outer = 800.0f*rmax; //[km]
+    float fov = 45.0f; //[deg]
+
+    const int belt_sizes[] = { 10000, 100000, 1000000 };
+    int belt_size_index = 0;
+    std::vector<belt_asteroid> belt = make_belt(belt_sizes[belt_size_index], r_inner, r_outer);
+
+    //With culling on, only the asteroids inside the camera's frustum are written to the instance buffer.
+    frustum_culler culler;
+    std::vector<instance_transform> transforms; //Of the whole belt, before culling.
+    std::vector<unsigned int> visible;
+    frustum_cull_stats cull_stats = {0, 0};
+
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+    glClearColor(0.0f,0.0f,0.0f,1.0f);
+
+    while (!glfwWindowShouldClose(window))
+    {
+        //Essential calculation needed for rendering :
+
+        static float dir_light_lon = 30.0f, dir_light_lat = 60.0f;
+        glm::vec3 light_dir = glm::vec3(cos(glm::radians(dir_light_lon))*sin(glm::radians(dir_light_lat)),
+                                        sin(glm::radians(dir_light_lon))*sin(glm::radians(dir_light_lat)),
+                                        cos(glm::radians(dir_light_lat)));
+
+        glm::mat4 projection = glm::infinitePerspective(glm::radians(fov), (float)win_width/win_height, 0.5f*rmax);
+        static float cam_dist = 2.0f*r_outer, cam_lon = 270.0f, cam_lat = 60.0f;
+        glm::vec3 cam_pos = cam_dist*glm::vec3(cos(glm::radians(cam_lon))*sin(glm::radians(cam_lat)),
+                                               sin(glm::radians(cam_lon))*sin(glm::radians(cam_lat)),
+                                               cos(glm::radians(cam_lat)));
+        //cam_up vector is equal to the minus unit latitude basis vector (expressed as a function of the cartesian unit vectors). cam_up = -hat(θ(hat(x),hat(y),hat(z))).
+        glm::vec3 cam_up = -glm::vec3(cos(glm::radians(cam_lat))*cos(glm::radians(cam_lon)),
+                                      cos(glm::radians(cam_lat))*sin(glm::radians(cam_lon)),
+                                     -sin(glm::radians(cam_lat)));
+        glm::mat4 view = glm::lookAt(cam_pos, glm::vec3(0.0f), cam_up);
+
+        //Move the asteroids and rewrite the instances. This is the cpu side cost of an animated belt, so it is timed.
+        //Culling depends on the camera too, so with culling on the instances are rewritten every frame.
+        static int asteroid_index = 0, format_index = 0, update_mode_index = 0;
+        static bool animate = true, frustum_culling = false;
+        static float t = 0.0f; //[sec]
+        static bool instances_written = false;
+        static float update_ms = 0.0f, draw_ms = 0.0f;
+        std::chrono::steady_clock::time_point update_start = std::chrono::steady_clock::now();
+        if (animate || frustum_culling || !instances_written)
+        {
+            transforms.resize(belt.size());
+            for (size_t i = 0; i < belt.size(); i++)
+                transforms[i] = belt_transform(belt[i], t);
+            if (frustum_culling)
+            {
+                glm::vec4 sphere = asteroids[asteroid_index].get_bounding_sphere();
+                culler.clear();
+                for (const instance_transform &transform : transforms)
+                    culler.add(transform.get_model_matrix(), sphere);
+                cull_stats = culler.cull(frustum(projection*view), visible);
+            }
+            else
+            {
+                visible.resize(transforms.size());
+                for (unsigned int i = 0; i < visible.size(); i++)
+                    visible[i] = i;
+                cull_stats.visible = (unsigned int)visible.size();
+                cull_stats.culled = 0;
+            }
+
+            if (format_index == 0)
+            {
+                instance_transform *instances = compact_instances[update_mode_index].begin_update(visible.size());
+                for (size_t i = 0; i < visible.size(); i++)
+                    instances[i] = transforms[visible[i]];
+                compact_instances[update_mode_index].end_update();
+            }
+            else
+            {
+                glm::mat4 *instances = matrix_instances[update_mode_index].begin_update(visible.size());
+                for (size_t i = 0; i < visible.size(); i++)
+                    instances[i] = transforms[visible[i]].get_model_matrix();
+                matrix_instances[update_mode_index].end_update();
+            }
+            instances_written = true;
+        }
+        std::chrono::duration<float, std::milli> update_time = std::chrono::steady_clock::now() - update_start;
+        update_ms += 0.05f*(update_time.count() - update_ms);
+
+        //Now we render :
+
+        glViewport(0,0, win_width,win_height);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        shader &shad = (format_index == 0) ? shad_compact : shad_matrix;
+        shad.use();
+        shad.set_mat4_uniform("projection", projection);
+        shad.set_mat4_uniform("view", view);
+        shad.set_vec3_uniform("light_dir", light_dir);
+        std::chrono::steady_clock::time_point draw_start = std::chrono::steady_clock::now();
+        if (format_index == 0)
+            asteroids[asteroid_index].draw_triangles_instanced(compact_instances[update_mode_index]);
+        else
+            asteroids[asteroid_index].draw_triangles_instanced(matrix_instances[update_mode_index]);
+        std::chrono::duration<float, std::milli> draw_time = std::chrono::steady_clock::now() - draw_start;
+        draw_ms += 0.05f*(draw_time.count() - draw_ms);
+
+        if (animate)
+            t += ImGui::GetIO().DeltaTime; //[sec]
+
+        //Render GUI :
+
+        ImGui_ImplOpenGL3_NewFrame();
+        ImGui_ImplGlfw_NewFrame();
+        ImGui::NewFrame();
+
+        ImGui::SetNextWindowSize(ImVec2(300.0f, 600.0f), ImGuiCond_FirstUseEver);
+        static bool popen = true;
+        ImGui::Begin("Controls", &popen); //Imgui window with title and a close button.
+        if (!popen)
+            glfwSetWindowShouldClose(window, true);
+        ImGui::BulletText("Belt");
+        //Changing anything below rewrites the instances, even if the belt is not animated.
+        bool changed = false;
+        for (int i = 0; i < 3; i++)
+        {
+            char label[32];
+            snprintf(label, sizeof(label), "%d##belt_size", belt_sizes[i]);
+            if (ImGui::RadioButton(label, &belt_size_index, i))
+            {
+                belt = make_belt(belt_sizes[belt_size_index], r_inner, r_outer);
+                changed = true;
+            }
+            if (i < 2)
+                ImGui::SameLine();
+        }
+        changed |= ImGui::Combo("Asteroid", &asteroid_index, asteroid_names, IM_ARRAYSIZE(asteroid_names));
+        ImGui::Checkbox("Animate", &animate);
+        ImGui::Checkbox("Frustum culling", &frustum_culling);
+        ImGui::Text("%u visible, %u culled", cull_stats.visible, cull_stats.culled);
+        ImGui::BulletText("Instances");
+        changed |= ImGui::RadioButton("pos/quat/scale (32 B)", &format_index, 0);
+        changed |= ImGui::RadioButton("mat4 (64 B)", &format_index, 1);
+        changed |= ImGui::RadioButton("Persistent mapping", &update_mode_index, 0);
+        changed |= ImGui::RadioButton("Orphaning", &update_mode_index, 1);
+        if (changed)
+            instances_written = false;
+        ImGui::BulletText("Light's direction");
+        ImGui::SliderFloat("lon [deg]##dir_light_lon", &dir_light_lon, 0.0f, 360.0f);
+        ImGui::SliderFloat("lat [deg]##dir_light_lat", &dir_light_lat, 0.0f, 180.0f);
+        ImGui::BulletText("Camera's position");
+        ImGui::SliderFloat("dist [km]##cam_dist", &cam_dist, 0.5f*r_inner, 4.0f*r_outer);
+        ImGui::SliderFloat("lon [deg]##cam_lon", &cam_lon, 0.0f, 360.0f);
+        ImGui::SliderFloat("lat [deg]##cam_lat", &cam_lat, 0.0f, 180.0f);
+        ImGui::BulletText("Performance");
+        ImGui::Text("FPS : [%.0f] ",ImGui::GetIO().Framerate);
+        ImGui::Text("Instance update : %.2f ms", update_ms);
+        ImGui::Text("Draw call : %.3f ms", draw_ms);
+        ImGui::End();
+
+        ImGui::Render();
+        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+    }
+
+    ImGui_ImplOpenGL3_Shutdown();
+    ImGui_ImplGlfw_Shutdown();
+    ImGui::DestroyContext();
+
+    glfwTerminate();
+    return 0;
+}
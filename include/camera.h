@@ -4,6 +4,14 @@
 #include<GL/glew.h>
 #include<glm/glm.hpp>
 #include<glm/gtc/matrix_transform.hpp>
+#include<algorithm>
+
+//Pixels covered by 1 world unit at a distance from a perspective camera with a vertical field of view fov [deg], in a viewport viewport_height
+//pixels tall. Used to choose levels of detail by their screen space error (see mesh::select_lod()).
+inline float screen_pixels_per_unit(float fov, float distance, int viewport_height)
+{
+    return (float)viewport_height/(2.0f*std::max(distance, 1e-6f)*tan(glm::radians(fov)/2.0f));
+}
 
 class camera
 {
@@ -126,6 +134,12 @@ public:
     {
         return glm::lookAt(pos, pos + front, up);
     }
+
+    //Pixels covered by 1 world unit at a distance from the camera (see screen_pixels_per_unit()).
+    float pixels_per_unit(float distance, int viewport_height) const
+    {
+        return screen_pixels_per_unit(fov, distance, viewport_height);
+    }
 };
 
 #endif
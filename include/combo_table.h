@@ -0,0 +1,119 @@
+#ifndef COMBO_TABLE_H
+#define COMBO_TABLE_H
+
+#include<cstdint>
+#include<cstddef>
+#include<vector>
+
+//Flat open addressing hash table that maps a vertex-attribute index combination (a 'combo', e.g. vertex 12 with normal 7) to the index
+//of the unique interleaved vertex created for it. Keys are the indices packed into integers, the slots live in 2 flat arrays and the table
+//is sized up front for the worst case (every face corner is a new combo), so lookups and insertions never allocate and never rehash.
+//The key type is chosen at compile time by the mesh layout : 2 attributes fit in 64 bits, 3 attributes need the 96-bit combo_key3.
+
+
+
+//Pack 2 indices into one 64-bit key.
+inline uint64_t combo_key(unsigned int first, unsigned int second)
+{
+    return ((uint64_t)first << 32) | (uint64_t)second;
+}
+
+//3 indices (position, uv, normal) packed into 96 bits.
+struct combo_key3
+{
+    uint64_t first_second;
+    uint32_t third;
+
+    bool operator==(const combo_key3 &other) const
+    {
+        return first_second == other.first_second && third == other.third;
+    }
+    bool operator!=(const combo_key3 &other) const
+    {
+        return !(*this == other);
+    }
+};
+
+inline combo_key3 combo_key(unsigned int first, unsigned int second, unsigned int third)
+{
+    return { combo_key(first, second), third };
+}
+
+//Mix all key bits into 64 bits. The table uses the high bits of the result (Fibonacci hashing).
+inline uint64_t combo_hash(uint64_t key)
+{
+    return key*0x9E3779B97F4A7C15ull;
+}
+
+inline uint64_t combo_hash(const combo_key3 &key)
+{
+    return (key.first_second ^ ((uint64_t)key.third*0xC2B2AE3D27D4EB4Full))*0x9E3779B97F4A7C15ull;
+}
+
+//Keys that cannot be real keys, because obj_no_index is never used as a vertex index.
+inline uint64_t combo_empty_key(uint64_t)
+{
+    return ~0ull;
+}
+
+inline combo_key3 combo_empty_key(const combo_key3 &)
+{
+    return { ~0ull, ~0u };
+}
+
+
+
+template<typename key_type>
+class combo_table
+{
+private:
+    key_type empty_key;
+    std::vector<key_type> keys;
+    std::vector<unsigned int> values;
+    size_t mask; //Number of slots - 1. The number of slots is a power of 2, so (hash & mask) replaces a modulo.
+    unsigned int shift;
+
+    size_t slot_of(const key_type &key) const
+    {
+        return (size_t)(combo_hash(key) >> shift);
+    }
+
+public:
+    //Allocate the table for at most max_entries keys. The load factor stays at or below 0.5, so probe sequences remain short.
+    combo_table(size_t max_entries)
+    {
+        empty_key = combo_empty_key(key_type());
+        size_t num_slots = 16;
+        shift = 60;
+        while (num_slots < 2*max_entries)
+        {
+            num_slots *= 2;
+            --shift;
+        }
+        mask = num_slots - 1;
+        keys.assign(num_slots, empty_key);
+        values.resize(num_slots);
+    }
+
+    //Return the value stored for key. If the key is not in the table, store new_value for it, set inserted to true and return new_value.
+    //Lookup and insertion share a single linear probe sequence.
+    unsigned int find_or_insert(const key_type &key, unsigned int new_value, bool &inserted)
+    {
+        size_t slot = slot_of(key);
+        while (keys[slot] != empty_key)
+        {
+            if (keys[slot] == key)
+            {
+                inserted = false;
+                return values[slot];
+            }
+            slot = (slot + 1) & mask;
+        }
+        keys[slot] = key;
+        values[slot] = new_value;
+        inserted = true;
+        return new_value;
+    }
+};
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef CUBE_MAP_CONVERT_H
+#define CUBE_MAP_CONVERT_H
+
+#include<GL/glew.h>
+#include<chrono>
+#include<cstdio>
+#include<cstdlib>
+#include<memory>
+
+#include"mesh.h"
+#include"shader.h"
+#include"gl_handle.h"
+
+//Cube maps from 1 image. The skybox's usual load reads and decodes 6 face images, which must all have the same size. Skies often come
+//as 1 image instead : an equirectangular panorama (2:1, longitude along the width, latitude along the height), or the 6 faces laid
+//out in a horizontal (4:3) or vertical (3:4) cross. cube_map_from_image() decodes that single image, uploads it as a temporary texture,
+//and fills all 6 faces in 1 compute pass (shaders/compute/cube_map_from_image.comp) : the panorama is sampled bilinearly along each
+//texel's direction, the cross is copied texel for texel. Then the mipmaps are built on the gpu too, and seamless cube map filtering
+//is enabled, so the edges between the faces do not show when the sky is minified.
+//
+//Usage :
+//    shader converter("../shaders/compute/cube_map_from_image.comp");
+//    skybox sb(cube_map_from_image("../images/skyboxes/sky_equirectangular_4k.jpg", converter));
+
+
+
+//How the 6 faces are stored in the image. The values are the image_layout uniform of cube_map_from_image.comp.
+enum cube_map_image_layout : int
+{
+    cube_map_auto = 0, //Tell from the image's aspect ratio.
+    cube_map_equirect = 1,
+    cube_map_horizontal_cross = 2,
+    cube_map_vertical_cross = 3
+};
+
+//What a conversion did, for the demos to print.
+struct cube_map_conversion_stats
+{
+    cube_map_image_layout layout;
+    int face_size;
+    float decode_ms; //Decoding the image.
+    float convert_ms; //Uploading it, the compute pass and the mipmaps (waits for the gpu to finish them).
+};
+
+//Build a cube map from 1 image, with converter being the cube_map_from_image.comp compute shader. face_size only applies to panoramas
+//(0 : a quarter of the panorama's width, i.e. about the panorama's resolution), the faces of a cross keep their size.
+//The cube map is rgba, and can be drawn with skybox(std::shared_ptr<mesh_texture>).
+inline std::shared_ptr<mesh_texture> cube_map_from_image(const char *img_path, shader &converter, cube_map_image_layout layout = cube_map_auto,
+                                                         int face_size = 0, cube_map_conversion_stats *stats = nullptr)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int width, height, channels;
+    stbi_set_flip_vertically_on_load_thread(false); //Row 0 is the top of the image, like the skybox's faces.
+    unsigned char *pixels = stbi_load(img_path, &width, &height, &channels, 4);
+    if (!pixels)
+    {
+        fprintf(stderr, "Error : File '%s' was not found. Exiting...\n", img_path);
+        exit(EXIT_FAILURE);
+    }
+    std::chrono::steady_clock::time_point decoded = std::chrono::steady_clock::now();
+
+    if (layout == cube_map_auto)
+    {
+        if (width == 2*height)
+            layout = cube_map_equirect;
+        else if (3*width == 4*height)
+            layout = cube_map_horizontal_cross;
+        else if (4*width == 3*height)
+            layout = cube_map_vertical_cross;
+        else
+        {
+            fprintf(stderr, "Error : Image '%s' is %dx%d, which is neither an equirectangular (2:1) nor a cross layout (4:3 or 3:4) image. Exiting...\n",
+                    img_path, width, height);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (layout == cube_map_horizontal_cross)
+        face_size = width/4;
+    else if (layout == cube_map_vertical_cross)
+        face_size = width/3;
+    else if (face_size <= 0)
+        face_size = width/4;
+    if (face_size < 1 || (layout == cube_map_horizontal_cross && 3*face_size > height) || (layout == cube_map_vertical_cross && 4*face_size > height))
+    {
+        fprintf(stderr, "Error : Image '%s' (%dx%d) is too small for its cube map layout. Exiting...\n", img_path, width, height);
+        exit(EXIT_FAILURE);
+    }
+
+    //The image, as a temporary texture. The panorama wraps around horizontally, so that the longitude seam is filtered across.
+    gl_texture source = gl_texture::create();
+    glBindTexture(GL_TEXTURE_2D, source.get());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    stbi_image_free(pixels);
+
+    //The cube map, with storage for its whole mip chain.
+    std::shared_ptr<mesh_texture> cube_map = std::make_shared<mesh_texture>();
+    cube_map->tex = gl_texture::create();
+    GLsizei num_levels = (GLsizei)texture_num_levels(face_size, face_size);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cube_map->tex.get());
+    glTexStorage2D(GL_TEXTURE_CUBE_MAP, num_levels, GL_RGBA8, face_size, face_size);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    for (int level = 0; level < num_levels; ++level)
+        cube_map->bytes += 6*(size_t)texture_level_dim(face_size, level)*texture_level_dim(face_size, level)*4;
+
+    //1 pass for all 6 faces : the cube map is bound as a layered image, 1 layer per face.
+    converter.use();
+    converter.set_int_uniform("image_layout", (int)layout);
+    converter.set_int_uniform("face_size", face_size);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, source.get());
+    glBindImageTexture(0, cube_map->tex.get(), 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA8);
+    glDispatchCompute((face_size + 7)/8, (face_size + 7)/8, 6);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT); //The mipmaps (and later draws) read what the pass wrote.
+    glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS); //Filter across the edges between faces (global state, like in the skybox's 6 image load).
+
+    if (stats != nullptr)
+    {
+        glFinish(); //Only to time the gpu work.
+        std::chrono::steady_clock::time_point converted = std::chrono::steady_clock::now();
+        stats->layout = layout;
+        stats->face_size = face_size;
+        stats->decode_ms = std::chrono::duration<float, std::milli>(decoded - start).count();
+        stats->convert_ms = std::chrono::duration<float, std::milli>(converted - decoded).count();
+    }
+    return cube_map;
+}
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include<glm/glm.hpp>
+#include<algorithm>
+#include<cmath>
+#include<vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include<emmintrin.h>
+#define FRUSTUM_SSE2 //x86-64 always has SSE2, i.e. 4 floats per instruction.
+#endif
+
+//View frustum culling on the cpu. Objects whose bounding sphere lies entirely outside the frustum of a projection*view matrix are skipped
+//before they are ever submitted, so they cost neither a draw call nor any vertex work on the gpu. The 6 planes are extracted directly from
+//the matrix (Gribb & Hartmann), so the same code culls the camera's perspective pass (projection*view) and the shadow pass of a
+//directional light (dir_light_pv, an orthographic cuboid).
+//frustum_culler tests many spheres at once : they are kept as separate x, y, z, radius arrays, so that 4 spheres are tested against a
+//plane with a few SSE2 instructions. Objects only count as culled if they are certainly invisible, never the other way around.
+//
+//Usage :
+//    frustum_culler culler;
+//    culler.clear();
+//    culler.add(model_ryugu, ryugu.get_bounding_sphere());
+//    culler.add(model_bennu, bennu.get_bounding_sphere());
+//    std::vector<unsigned int> visible;
+//    frustum_cull_stats stats = culler.cull(frustum(projection*view), visible);
+//    for (unsigned int i : visible)
+//        ...
+
+
+
+//A bounding sphere (center xyz, radius w) transformed by a model matrix. The radius grows with the largest scale of the matrix.
+inline glm::vec4 transform_bounding_sphere(const glm::mat4 &model, const glm::vec4 &sphere)
+{
+    glm::vec4 center = model*glm::vec4(glm::vec3(sphere), 1.0f);
+    float scale_squared = std::max(std::max(glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+                                            glm::dot(glm::vec3(model[1]), glm::vec3(model[1]))),
+                                            glm::dot(glm::vec3(model[2]), glm::vec3(model[2])));
+    return glm::vec4(glm::vec3(center), sphere.w*std::sqrt(scale_squared));
+}
+
+class frustum
+{
+public:
+    //Left, right, bottom, top, near, far. A point p is inside a plane if dot(plane.xyz, p) + plane.w >= 0. The planes are normalized,
+    //so that dot(plane.xyz, p) + plane.w is the signed distance of p.
+    glm::vec4 planes[6];
+
+    //Frustum of a projection*view matrix, in world coordinates (or of projection*view*model, in the model's local coordinates).
+    explicit frustum(const glm::mat4 &pv)
+    {
+        //Rows of the matrix (glm is column major).
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(pv[0][i], pv[1][i], pv[2][i], pv[3][i]);
+        for (int i = 0; i < 3; i++)
+        {
+            planes[2*i] = rows[3] + rows[i];
+            planes[2*i + 1] = rows[3] - rows[i];
+        }
+        for (glm::vec4 &plane : planes)
+        {
+            float length = glm::length(glm::vec3(plane));
+            //An infinite far plane (glm::infinitePerspective()) comes out as a zero normal. It culls nothing.
+            plane = (length > 1e-12f) ? plane/length : glm::vec4(0.0f,0.0f,0.0f,1.0f);
+        }
+    }
+
+    //Whether a sphere (center, radius) is at least partly inside the frustum.
+    bool sphere_visible(const glm::vec3 &center, float radius) const
+    {
+        for (const glm::vec4 &plane : planes)
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+                return false;
+        return true;
+    }
+
+    //Whether an axis aligned box is at least partly inside the frustum. Tighter than the sphere for elongated objects.
+    //Only the corner farthest along each plane's normal is tested, which may keep a few boxes near the frustum's edges (never drops a visible one).
+    bool aabb_visible(const glm::vec3 &aabb_min, const glm::vec3 &aabb_max) const
+    {
+        for (const glm::vec4 &plane : planes)
+        {
+            glm::vec3 corner(plane.x >= 0.0f ? aabb_max.x : aabb_min.x,
+                             plane.y >= 0.0f ? aabb_max.y : aabb_min.y,
+                             plane.z >= 0.0f ? aabb_max.z : aabb_min.z);
+            if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+};
+
+//Result of a culling pass.
+struct frustum_cull_stats
+{
+    unsigned int visible, culled;
+};
+
+class frustum_culler
+{
+private:
+    //World space spheres, as separate arrays (structure of arrays), padded to a multiple of 4 with spheres that are never visible.
+    std::vector<float> xs, ys, zs, radii;
+    unsigned int num_spheres;
+
+    void pad()
+    {
+        size_t padded = (num_spheres + 3)/4*4;
+        xs.resize(padded, 0.0f);
+        ys.resize(padded, 0.0f);
+        zs.resize(padded, 0.0f);
+        radii.resize(padded, -INFINITY);
+    }
+
+public:
+    frustum_culler() : num_spheres(0) {}
+
+    //Forget the spheres of the previous frame. The memory is kept.
+    void clear()
+    {
+        xs.clear();
+        ys.clear();
+        zs.clear();
+        radii.clear();
+        num_spheres = 0;
+    }
+
+    //Add an object by its world space bounding sphere (center xyz, radius w). Returns its index, as reported by cull().
+    unsigned int add(const glm::vec4 &world_sphere)
+    {
+        if (xs.size() != num_spheres) //Drop the padding of the last cull().
+        {
+            xs.resize(num_spheres);
+            ys.resize(num_spheres);
+            zs.resize(num_spheres);
+            radii.resize(num_spheres);
+        }
+        xs.push_back(world_sphere.x);
+        ys.push_back(world_sphere.y);
+        zs.push_back(world_sphere.z);
+        radii.push_back(world_sphere.w);
+        return num_spheres++;
+    }
+
+    //Add an object by its local bounding sphere (e.g. mesh::get_bounding_sphere()) and its model matrix.
+    unsigned int add(const glm::mat4 &model, const glm::vec4 &local_sphere)
+    {
+        return add(transform_bounding_sphere(model, local_sphere));
+    }
+
+    //Test all the spheres against a frustum. The indices of the visible ones are written to visible, in increasing order.
+    frustum_cull_stats cull(const frustum &f, std::vector<unsigned int> &visible)
+    {
+        pad();
+        visible.clear();
+#ifdef FRUSTUM_SSE2
+        __m128 plane_x[6], plane_y[6], plane_z[6], plane_w[6];
+        for (int p = 0; p < 6; p++)
+        {
+            plane_x[p] = _mm_set1_ps(f.planes[p].x);
+            plane_y[p] = _mm_set1_ps(f.planes[p].y);
+            plane_z[p] = _mm_set1_ps(f.planes[p].z);
+            plane_w[p] = _mm_set1_ps(f.planes[p].w);
+        }
+        for (unsigned int i = 0; i < num_spheres; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(&xs[i]), y = _mm_loadu_ps(&ys[i]), z = _mm_loadu_ps(&zs[i]);
+            __m128 minus_radius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&radii[i]));
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int p = 0; p < 6; p++)
+            {
+                __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(plane_x[p], x), _mm_mul_ps(plane_y[p], y)),
+                                         _mm_add_ps(_mm_mul_ps(plane_z[p], z), plane_w[p]));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, minus_radius));
+            }
+            int mask = _mm_movemask_ps(inside); //Bit k is set if sphere i + k is visible.
+            for (unsigned int k = 0; mask != 0; k++, mask >>= 1)
+                if (mask & 1)
+                    visible.push_back(i + k);
+        }
+#else
+        for (unsigned int i = 0; i < num_spheres; i++)
+            if (f.sphere_visible(glm::vec3(xs[i], ys[i], zs[i]), radii[i]))
+                visible.push_back(i);
+#endif
+        frustum_cull_stats stats;
+        stats.visible = (unsigned int)visible.size();
+        stats.culled = num_spheres - stats.visible;
+        return stats;
+    }
+
+    unsigned int size() const
+    {
+        return num_spheres;
+    }
+};
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef GL_HANDLE_H
+#define GL_HANDLE_H
+
+#include<GL/glew.h>
+
+//Owning wrappers of OpenGL object names (vao, buffer, texture, framebuffer, renderbuffer, shader, program).
+//A handle deletes its object when it is destroyed, and it can be moved but never copied, so exactly 1 handle owns every object.
+//Classes built on handles (mesh, skybox, quadtex, shader) therefore get correct move operations for free, i.e. they can be stored
+//by value in containers like std::vector, and a copy that would delete the same object twice does not compile.
+//A handle is just the name (no extra memory, no indirection). Name 0 means "no object", which OpenGL silently ignores on deletion anyway.
+//
+//Usage :
+//    gl_buffer vbo = gl_buffer::create();
+//    glBindBuffer(GL_ARRAY_BUFFER, vbo.get());
+
+
+
+//How every kind of object is created and deleted.
+struct gl_vertex_array_traits
+{
+    static GLuint create() { GLuint id = 0; glGenVertexArrays(1, &id); return id; }
+    static void destroy(GLuint id) { glDeleteVertexArrays(1, &id); }
+};
+
+struct gl_buffer_traits
+{
+    static GLuint create() { GLuint id = 0; glGenBuffers(1, &id); return id; }
+    static void destroy(GLuint id) { glDeleteBuffers(1, &id); }
+};
+
+struct gl_texture_traits
+{
+    static GLuint create() { GLuint id = 0; glGenTextures(1, &id); return id; }
+    static void destroy(GLuint id) { glDeleteTextures(1, &id); }
+};
+
+struct gl_framebuffer_traits
+{
+    static GLuint create() { GLuint id = 0; glGenFramebuffers(1, &id); return id; }
+    static void destroy(GLuint id) { glDeleteFramebuffers(1, &id); }
+};
+
+struct gl_renderbuffer_traits
+{
+    static GLuint create() { GLuint id = 0; glGenRenderbuffers(1, &id); return id; }
+    static void destroy(GLuint id) { glDeleteRenderbuffers(1, &id); }
+};
+
+struct gl_program_traits
+{
+    static GLuint create() { return glCreateProgram(); }
+    static void destroy(GLuint id) { glDeleteProgram(id); }
+};
+
+//Shader objects need a type to be created, so they are made with gl_shader(glCreateShader(type)).
+struct gl_shader_traits
+{
+    static void destroy(GLuint id) { glDeleteShader(id); }
+};
+
+
+
+template<typename traits>
+class gl_handle
+{
+private:
+    GLuint id;
+
+public:
+    //No object.
+    gl_handle() : id(0) {}
+
+    //Take ownership of an existing object.
+    explicit gl_handle(GLuint owned_id) : id(owned_id) {}
+
+    //Create a new object.
+    static gl_handle create()
+    {
+        return gl_handle(traits::create());
+    }
+
+    ~gl_handle()
+    {
+        reset();
+    }
+
+    gl_handle(gl_handle &&other) noexcept : id(other.id)
+    {
+        other.id = 0;
+    }
+
+    //The object held so far is deleted.
+    gl_handle &operator=(gl_handle &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            id = other.id;
+            other.id = 0;
+        }
+        return *this;
+    }
+
+    gl_handle(const gl_handle &) = delete;
+    gl_handle &operator=(const gl_handle &) = delete;
+
+    GLuint get() const
+    {
+        return id;
+    }
+
+    explicit operator bool() const
+    {
+        return id != 0;
+    }
+
+    //Delete the object now.
+    void reset()
+    {
+        if (id != 0)
+        {
+            traits::destroy(id);
+            id = 0;
+        }
+    }
+};
+
+using gl_vertex_array = gl_handle<gl_vertex_array_traits>;
+using gl_buffer = gl_handle<gl_buffer_traits>;
+using gl_texture = gl_handle<gl_texture_traits>;
+using gl_framebuffer = gl_handle<gl_framebuffer_traits>;
+using gl_renderbuffer = gl_handle<gl_renderbuffer_traits>;
+using gl_program = gl_handle<gl_program_traits>;
+using gl_shader = gl_handle<gl_shader_traits>;
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef IMAGE_BATCH_H
+#define IMAGE_BATCH_H
+
+#include<algorithm>
+#include<chrono>
+#include<cstdio>
+#include<memory>
+#include<string>
+#include<vector>
+
+#include"stb_image.h"
+#include"texture_cache.h"
+#include"thread_pool.h"
+
+//Concurrent image decoding. Decoding a 2k jpg takes tens of milliseconds, and a skybox (6 faces) or a textured scene decodes several of
+//them before the first frame. Decoding touches no OpenGL state, so the images of a batch are decoded all at once on a thread pool,
+//and only the uploads (glTexImage2D) are left to the main thread, in the order the images were added.
+//Images added with compress = true come out block compressed instead (see texture_cache.h) : from their cache file, or compressed on the
+//worker (and cached) the first time.
+//Failed decodes are not fatal here : the image stays empty (see loaded()) and the caller decides what to do (on the main thread).
+//
+//Usage :
+//    image_batch batch;
+//    size_t grass = batch.add("../images/texture/aerial_grass_rock_diff_4k.jpg", true);
+//    size_t brick = batch.add("../images/texture/red_brick_diff_2k.jpg", true);
+//    batch.decode();
+//    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, batch[grass].width, batch[grass].height, 0, GL_RGB, GL_UNSIGNED_BYTE, batch[grass].data);
+
+
+
+//1 image of a batch, as stbi_load() returns it, or block compressed.
+struct decoded_image
+{
+    std::string path;
+    bool flip; //Flip vertically on load (the meshes' textures do, the skybox faces do not).
+    bool compress; //Get the block compressed texture instead of the pixels.
+    unsigned char *data; //Null until decoded, if the decode failed, or if the image is compressed.
+    int width, height, channels;
+    compressed_texture compressed; //The texture of images with compress = true.
+    float decode_ms; //Time the decode took on its worker thread.
+    bool decoded; //Set once decoded (successfully or not), so that a later decode() of the batch skips it even if its data was released.
+
+    decoded_image() : flip(false), compress(false), data(nullptr), width(0), height(0), channels(0), decode_ms(0.0f), decoded(false) {}
+
+    decoded_image(const decoded_image &) = delete;
+    decoded_image &operator=(const decoded_image &) = delete;
+
+    ~decoded_image()
+    {
+        if (data != nullptr)
+            stbi_image_free(data);
+    }
+
+    //True if the image was decoded (or its compressed texture found) successfully.
+    bool loaded() const
+    {
+        return data != nullptr || compressed.data != nullptr;
+    }
+
+    //Hand the pixels over to someone else, who must free them with stbi_image_free().
+    unsigned char *release()
+    {
+        unsigned char *pixels = data;
+        data = nullptr;
+        return pixels;
+    }
+
+    //Decode on the calling thread.
+    void decode()
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (compress)
+        {
+            if (texture_cache_load(path.c_str(), flip, compressed))
+            {
+                width = (int)compressed.width;
+                height = (int)compressed.height;
+                channels = (int)compressed.channels;
+            }
+        }
+        else
+        {
+            stbi_set_flip_vertically_on_load_thread(flip); //Per thread, so the images of a batch cannot change it under each other's feet.
+            data = stbi_load(path.c_str(), &width, &height, &channels, 0);
+        }
+        std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        decode_ms = elapsed.count();
+        decoded = true;
+    }
+};
+
+class image_batch
+{
+private:
+    std::vector<std::unique_ptr<decoded_image>> images; //Pointers, so the workers write into images that never move.
+    float decode_ms; //Wall clock time of the decode() calls so far.
+    unsigned int num_threads_used; //Most threads a decode() call used.
+
+public:
+    image_batch() : decode_ms(0.0f), num_threads_used(0) {}
+
+    image_batch(const image_batch &) = delete;
+    image_batch &operator=(const image_batch &) = delete;
+
+    //Queue an image. Returns its index in the batch.
+    size_t add(const char *path, bool flip, bool compress = false)
+    {
+        images.emplace_back(new decoded_image());
+        images.back()->path = path;
+        images.back()->flip = flip;
+        images.back()->compress = compress;
+        return images.size() - 1;
+    }
+
+    //Decode the queued images that are not decoded yet, all at once, and return when they are done.
+    //num_threads = 0 means one thread per hardware thread (minus the main thread), but never more threads than images.
+    void decode(unsigned int num_threads = 0)
+    {
+        std::vector<decoded_image*> pending;
+        for (std::unique_ptr<decoded_image> &image : images)
+        {
+            if (!image->decoded)
+                pending.push_back(image.get());
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (num_threads == 0)
+            num_threads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+        num_threads = std::min(num_threads, (unsigned int)pending.size());
+        if (num_threads <= 1)
+        {
+            for (decoded_image *image : pending)
+                image->decode(); //No point in a worker that the main thread would only wait for.
+        }
+        else
+        {
+            thread_pool pool(num_threads);
+            for (decoded_image *image : pending)
+                pool.submit([image]() { image->decode(); });
+            pool.wait_idle();
+        }
+        std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        decode_ms += elapsed.count();
+        num_threads_used = std::max(num_threads_used, num_threads);
+    }
+
+    size_t size() const
+    {
+        return images.size();
+    }
+
+    decoded_image &operator[](size_t i)
+    {
+        return *images[i];
+    }
+
+    const decoded_image &operator[](size_t i) const
+    {
+        return *images[i];
+    }
+
+    //Wall clock time of the decode() calls. With enough threads it is about the slowest image, instead of the sum of all.
+    float get_decode_ms() const
+    {
+        return decode_ms;
+    }
+
+    //Sum of the decode times of the images, i.e. what decoding them one after the other would have cost.
+    float get_serial_decode_ms() const
+    {
+        float sum = 0.0f;
+        for (const std::unique_ptr<decoded_image> &image : images)
+            sum += image->decode_ms;
+        return sum;
+    }
+
+    //Print the decode time of every image and of the whole batch.
+    void print_timings(const char *title) const
+    {
+        printf("%s : decoded %u images in %.1f ms on %u threads (%.1f ms one after the other).\n",
+               title, (unsigned int)images.size(), decode_ms, std::max(1u, num_threads_used), get_serial_decode_ms());
+        for (const std::unique_ptr<decoded_image> &image : images)
+        {
+            const char *source = !image->compress ? "" : (image->compressed.from_cache ? "  (texture cache)" : "  (compressed and cached)");
+            printf("    %7.1f ms  %dx%d  %s%s\n", image->decode_ms, image->width, image->height, image->path.c_str(), source);
+        }
+    }
+};
+
+#endif
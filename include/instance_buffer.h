@@ -0,0 +1,253 @@
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include<GL/glew.h>
+#include<glm/glm.hpp>
+#include<glm/gtc/quaternion.hpp>
+#include<algorithm>
+#include<cstdio>
+#include<cstdlib>
+#include<cstring>
+
+#include"gl_handle.h"
+
+//Per instance data for drawing many copies of 1 mesh with a single instanced draw call (see mesh::draw_triangles_instanced()).
+//Drawing an asteroid belt with 1 draw call and 1 model matrix uniform per asteroid costs 1 driver round trip per copy. An instance buffer
+//holds the transforms of all the copies instead, and the *_instanced.vert shaders read them as vertex attributes that advance once per
+//instance (glVertexAttribDivisor). 2 instance formats exist :
+//- glm::mat4 : any model matrix, 64 bytes per instance. Read by trans_mvpn_instanced.vert.
+//- instance_transform : position, rotation (quaternion) and uniform scale, 32 bytes per instance. Half the bandwidth, and the normals
+//  need no matrix inverse in the shader. Read by trans_mvpn_instanced_compact.vert.
+//The instances can be rewritten every frame. 2 ways of doing it without stalling on the draws of the previous frames :
+//- instance_update_persistent : the buffer is mapped once (glBufferStorage, persistent and coherent) and split into 3 regions, written
+//  frame after frame in turn. A fence per region tells when the gpu is done reading it, so the cpu only waits if it runs 3 frames ahead.
+//- instance_update_orphan : the buffer is reallocated before every update (glBufferData with no data), and the driver hands out new
+//  memory while the old one is still read.
+//Like every OpenGL object, an instance buffer must be used on the main thread.
+//
+//Usage :
+//    instance_buffer<instance_transform> belt(100000);
+//    instance_transform *instances = belt.begin_update(100000);
+//    for (...)
+//        instances[i] = instance_transform(pos, rot, scale);
+//    belt.end_update();
+//    shad_instanced.use();
+//    asteroid.draw_triangles_instanced(belt);
+
+
+
+//Position, rotation and uniform scale of an instance, in the layout read by trans_mvpn_instanced_compact.vert.
+struct instance_transform
+{
+    glm::vec4 pos_scale; //xyz : position, w : scale.
+    glm::vec4 rot; //Unit quaternion (x,y,z,w).
+
+    instance_transform() : pos_scale(0.0f,0.0f,0.0f,1.0f), rot(0.0f,0.0f,0.0f,1.0f) {}
+
+    instance_transform(const glm::vec3 &pos, const glm::quat &q, float scale) : pos_scale(pos, scale), rot(q.x, q.y, q.z, q.w) {}
+
+    //The equivalent model matrix.
+    glm::mat4 get_model_matrix() const
+    {
+        glm::mat4 model = glm::mat4_cast(glm::quat(rot.w, rot.x, rot.y, rot.z))*pos_scale.w;
+        model[3] = glm::vec4(glm::vec3(pos_scale), 1.0f);
+        return model;
+    }
+};
+
+//How the instances are rewritten. See above.
+enum instance_update_mode
+{
+    instance_update_persistent,
+    instance_update_orphan
+};
+
+//Vertex attributes of the instance formats. They come after the mesh's attributes (position, normal, uv), so the first one is at location 3.
+const unsigned int instance_location = 3;
+
+inline void set_instance_attributes(const glm::mat4 *, size_t offset)
+{
+    for (unsigned int column = 0; column < 4; column++) //A mat4 attribute takes 4 locations, 1 per column.
+    {
+        glVertexAttribPointer(instance_location + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(offset + column*sizeof(glm::vec4)));
+        glVertexAttribDivisor(instance_location + column, 1);
+        glEnableVertexAttribArray(instance_location + column);
+    }
+}
+
+inline void set_instance_attributes(const instance_transform *, size_t offset)
+{
+    glVertexAttribPointer(instance_location, 4, GL_FLOAT, GL_FALSE, sizeof(instance_transform), (void*)offset);
+    glVertexAttribPointer(instance_location + 1, 4, GL_FLOAT, GL_FALSE, sizeof(instance_transform), (void*)(offset + sizeof(glm::vec4)));
+    for (unsigned int i = 0; i < 2; i++)
+    {
+        glVertexAttribDivisor(instance_location + i, 1);
+        glEnableVertexAttribArray(instance_location + i);
+    }
+}
+
+//Number of locations an instance format takes.
+inline unsigned int num_instance_locations(const glm::mat4 *) { return 4; }
+inline unsigned int num_instance_locations(const instance_transform *) { return 2; }
+
+
+
+template<typename instance_type>
+class instance_buffer
+{
+private:
+    static const unsigned int num_regions = 3; //Persistent mode only : frames the cpu may write ahead of the gpu.
+
+    instance_update_mode mode;
+    gl_buffer vbo;
+    size_t capacity; //Instances per region.
+    size_t num_instances; //Of the last update.
+    unsigned int region; //Persistent mode only : the region of the last update.
+    instance_type *mapped; //Persistent mode : the whole buffer. Orphan mode : the region being updated, between begin_update() and end_update().
+    GLsync fences[num_regions];
+
+    //(Re)create the buffer for at least min_instances per region. Whatever it held is lost.
+    void allocate(size_t min_instances)
+    {
+        release_fences();
+        capacity = std::max(min_instances, (size_t)1);
+        vbo = gl_buffer::create();
+        glBindBuffer(GL_ARRAY_BUFFER, vbo.get());
+        if (mode == instance_update_persistent)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_ARRAY_BUFFER, num_regions*capacity*sizeof(instance_type), nullptr, flags);
+            mapped = (instance_type*)glMapBufferRange(GL_ARRAY_BUFFER, 0, num_regions*capacity*sizeof(instance_type), flags);
+            if (mapped == nullptr)
+            {
+                fprintf(stderr, "Error : Failed to map an instance buffer of %u instances. Exiting...\n", (unsigned int)capacity);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else
+        {
+            glBufferData(GL_ARRAY_BUFFER, capacity*sizeof(instance_type), nullptr, GL_STREAM_DRAW);
+            mapped = nullptr;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void release_fences()
+    {
+        for (GLsync &fence : fences)
+        {
+            if (fence != nullptr)
+                glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+
+public:
+    //Room for max_instances per update. An update with more instances reallocates the buffer.
+    instance_buffer(size_t max_instances, instance_update_mode update_mode = instance_update_persistent)
+        : mode(update_mode), capacity(0), num_instances(0), region(0), mapped(nullptr)
+    {
+        for (GLsync &fence : fences)
+            fence = nullptr;
+        allocate(max_instances);
+    }
+
+    //The buffer is unmapped when it is deleted.
+    ~instance_buffer()
+    {
+        release_fences();
+    }
+
+    instance_buffer(const instance_buffer &) = delete;
+    instance_buffer &operator=(const instance_buffer &) = delete;
+
+    //Start rewriting the instances : the returned pointer has room for count instances, which must all be written before end_update().
+    //It is write only (reading it back may be very slow), and it is invalidated by the next begin_update(). With count == 0 (nothing
+    //visible, say), there is nothing to write and it may be nullptr.
+    instance_type *begin_update(size_t count)
+    {
+        if (count > capacity)
+            allocate(std::max(count, 2*capacity));
+        num_instances = count;
+
+        if (mode == instance_update_persistent)
+        {
+            //The draws of the previous update were all issued by now, so its region is done when they are.
+            if (fences[region] != nullptr)
+                glDeleteSync(fences[region]);
+            fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+            region = (region + 1)%num_regions;
+            if (fences[region] != nullptr)
+            {
+                GLbitfield wait_flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+                while (glClientWaitSync(fences[region], wait_flags, 1000000) == GL_TIMEOUT_EXPIRED)
+                    wait_flags = 0;
+                glDeleteSync(fences[region]);
+                fences[region] = nullptr;
+            }
+            return mapped + region*capacity;
+        }
+
+        if (count == 0)
+            return nullptr; //Mapping 0 bytes is an error.
+        glBindBuffer(GL_ARRAY_BUFFER, vbo.get());
+        glBufferData(GL_ARRAY_BUFFER, capacity*sizeof(instance_type), nullptr, GL_STREAM_DRAW); //Orphan.
+        mapped = (instance_type*)glMapBufferRange(GL_ARRAY_BUFFER, 0, count*sizeof(instance_type), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return mapped;
+    }
+
+    //Done writing the instances.
+    void end_update()
+    {
+        if (mode == instance_update_orphan && mapped != nullptr) //Nothing is mapped after an empty update.
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, vbo.get());
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            mapped = nullptr;
+        }
+    }
+
+    //Rewrite the instances from an array.
+    void update(const instance_type *instances, size_t count)
+    {
+        instance_type *destination = begin_update(count);
+        if (count > 0)
+            memcpy(destination, instances, count*sizeof(instance_type));
+        end_update();
+    }
+
+    //Point the instance attributes of the bound vao to the last update.
+    void bind_attributes() const
+    {
+        size_t offset = (mode == instance_update_persistent) ? region*capacity*sizeof(instance_type) : 0;
+        glBindBuffer(GL_ARRAY_BUFFER, vbo.get());
+        set_instance_attributes((const instance_type*)nullptr, offset);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    //Switch the instance attributes of the bound vao off again, so that it draws like before.
+    void unbind_attributes() const
+    {
+        for (unsigned int i = 0; i < num_instance_locations((const instance_type*)nullptr); i++)
+        {
+            glDisableVertexAttribArray(instance_location + i);
+            glVertexAttribDivisor(instance_location + i, 0);
+        }
+    }
+
+    //Number of instances of the last update.
+    size_t size() const
+    {
+        return num_instances;
+    }
+
+    instance_update_mode get_update_mode() const
+    {
+        return mode;
+    }
+};
+
+#endif
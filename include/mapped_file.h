@@ -0,0 +1,109 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include<cstdio>
+#include<cstddef>
+
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+        #define NOMINMAX //Otherwise windows.h defines min() and max() macros that break std::min(), glm::max(), etc...
+    #endif
+    #include<windows.h>
+#else
+    #include<fcntl.h>
+    #include<sys/mman.h>
+    #include<sys/stat.h>
+    #include<unistd.h>
+#endif
+
+
+
+//Read-only view of a whole file, mapped directly into the process' address space (no copies, no read() calls).
+//The operating system pages the file in on demand, so the mapped bytes can be parsed as if they were one big char array.
+class mapped_file
+{
+private:
+    const char *ptr; //First byte of the file (nullptr if the file could not be opened or is empty).
+    size_t len; //File size in bytes.
+    bool opened;
+#ifdef _WIN32
+    HANDLE file_handle, map_handle;
+#endif
+
+public:
+    mapped_file(const char *path) : ptr(nullptr), len(0), opened(false)
+    {
+#ifdef _WIN32
+        map_handle = NULL;
+        file_handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file_handle == INVALID_HANDLE_VALUE)
+            return;
+        opened = true;
+
+        LARGE_INTEGER file_size;
+        GetFileSizeEx(file_handle, &file_size);
+        len = (size_t)file_size.QuadPart;
+        if (len == 0) //Empty files cannot be mapped, but they are still valid (empty) files.
+            return;
+
+        map_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (map_handle != NULL)
+            ptr = (const char *)MapViewOfFile(map_handle, FILE_MAP_READ, 0, 0, 0);
+#else
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            return;
+        opened = true;
+
+        struct stat st;
+        if (fstat(fd, &st) == 0)
+            len = (size_t)st.st_size;
+        if (len > 0)
+        {
+            void *addr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED)
+            {
+                ptr = (const char *)addr;
+                madvise(addr, len, MADV_SEQUENTIAL); //We read front to back, so let the kernel read ahead aggressively.
+            }
+        }
+        close(fd); //The mapping stays valid after the descriptor is closed.
+#endif
+        if (len > 0 && ptr == nullptr)
+        {
+            fprintf(stderr, "Error : Failed to map file '%s' into memory.\n", path);
+            opened = false;
+            len = 0;
+        }
+    }
+
+    //Unmap the file.
+    ~mapped_file()
+    {
+#ifdef _WIN32
+        if (ptr != nullptr)
+            UnmapViewOfFile(ptr);
+        if (map_handle != NULL)
+            CloseHandle(map_handle);
+        if (file_handle != INVALID_HANDLE_VALUE)
+            CloseHandle(file_handle);
+#else
+        if (ptr != nullptr)
+            munmap((void *)ptr, len);
+#endif
+    }
+
+    //A mapping owns the view of the file, so it must never be copied (double unmap).
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+
+    bool is_open() const { return opened; }
+    const char *data() const { return ptr; }
+    const char *end() const { return ptr + len; }
+    size_t size() const { return len; }
+};
+
+#endif
@@ -2,405 +2,874 @@
 #define MESH_H
 
 #include<GL/glew.h>
+#include<glm/glm.hpp>
 #include<iostream>
 #include<string>
-#include<fstream>
 #include<vector>
-#include<unordered_map>
+#include<algorithm>
+#include<type_traits>
+#include<memory>
+
+#include"obj_parser.h"
+#include"mesh_cache.h"
+#include"combo_table.h"
+#include"mesh_optimizer.h"
+#include"mesh_quantize.h"
+#include"mesh_simplify.h"
+#include"mesh_meshlet.h"
+#include"gl_handle.h"
+#include"instance_buffer.h"
+#include"texture_cache.h"
+#include"image_batch.h"
 
 #define STB_IMAGE_IMPLEMENTATION //This must happen only once.
 #include"stb_image.h"
 
 
 
-class meshvf
+//Release a vector's heap memory. clear() alone keeps the capacity allocated.
+template<typename T>
+void free_vector(std::vector<T> &v)
 {
-private:
-    unsigned int vao, vbo, ebo; //Vertex array object, vertex buffer object, element (index) buffer object.
-    std::vector<float> verts; //Mesh's vertices {x1,y1,z1, x2,y2,z2, ...}.
-    std::vector<unsigned int> inds; //Mesh's indices {vi1,vi2,vi3, vi4,vi5,vi6, ...}.
+    std::vector<T>().swap(v);
+}
 
-public:
-    //Load the obj file, construct the mesh vectors and do the gpu memory setup.
-    meshvf(const char *obj_path)
-    {
-        std::ifstream fp;
-        fp.open(obj_path);
-        if (!fp.is_open())
-        {
-            fprintf(stderr, "Error : File '%s' was not found. Exiting...\n", obj_path);
-            exit(EXIT_FAILURE);
-        }
+//Heap bytes held by a vector.
+template<typename T>
+size_t vector_bytes(const std::vector<T> &v)
+{
+    return v.capacity()*sizeof(T);
+}
 
-        float x,y,z;
-        unsigned int vi1,vi2,vi3;
-        std::string line;
-        while (getline(fp, line))
-        {
-            if (line[0] == 'v' && line[1] == ' ') //Then we have a vertex line.
-            {
-                sscanf(line.c_str(), "v %f %f %f", &x,&y,&z);
-                verts.push_back(x);
-                verts.push_back(y);
-                verts.push_back(z);
-            }
-            else if (line[0] == 'f') //Then we have an index line.
-            {
-                sscanf(line.c_str(), "f %u %u %u", &vi1,&vi2,&vi3); //This must be the faces format of the obj file, so that everything works.
-                //Append indices to inds and subtract 1 from each, to convert to 0-based indexing. Obj files are 1-based.
-                inds.push_back(vi1-1);
-                inds.push_back(vi2-1);
-                inds.push_back(vi3-1);
-            }
-        }
 
-        glGenVertexArrays(1, &vao);
-        glBindVertexArray(vao);
 
-        glGenBuffers(1, &vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, verts.size()*sizeof(float), &verts[0], GL_STATIC_DRAW);
+//Load options of the mesh constructors. They can be combined, e.g. mesh_optimize | mesh_gpu_resident_only.
+enum mesh_load_flags : unsigned int
+{
+    mesh_gpu_resident_only = 1u << 0, //Free the cpu copies of the mesh data right after the upload (memory budget mode).
+    mesh_optimize = 1u << 1, //Reorder triangles and vertices for the vertex cache, overdraw and vertex fetch (see mesh_optimizer.h).
+    mesh_quantize = 1u << 2, //Compact vertex formats (see mesh_quantize.h). Such meshes must be drawn with the *_quantized.vert shaders.
+    mesh_lod = 1u << 3, //Also build simplified levels of detail (see mesh_simplify.h), drawn with draw_triangles(lod).
+    mesh_meshlets = 1u << 4, //Split every level of detail into meshlets, culled with cull_meshlets() (see mesh_meshlet.h).
+    mesh_compress_texture = 1u << 5 //Block compressed texture (BC1, or BC3 with alpha) with precomputed mipmaps, cached next to the image (see texture_cache.h).
+};
+
+//The options that change the gpu buffers. They are stored in the cache file, so e.g. an optimized load never uses an unoptimized cache
+//(and the optimization is paid for only once).
+const unsigned int mesh_buffer_flags = mesh_optimize | mesh_quantize | mesh_lod | mesh_meshlets;
+
 
-        glGenBuffers(1, &ebo); //OpenGL expects the indices stored in the ebo to reference positions in the verts[] buffer.
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, inds.size()*sizeof(unsigned int), &inds[0], GL_STATIC_DRAW);
-        
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
-        
-        glBindVertexArray(0);
-    }
 
-    //Cleanup memory.
-    ~meshvf()
+//Everything the gpu upload of a mesh needs. The cpu side of a load (cache lookup or obj parsing, image decoding) fills it without touching
+//any OpenGL state, so it can run on any thread (see mesh_loader.h). The upload then happens on the thread that owns the OpenGL context.
+struct mesh_staging
+{
+    std::unique_ptr<mapped_file> cache_file; //Keeps the buffers mapped if they come from the cache file.
+    std::vector<unsigned char> quantized_vertices;
+    std::vector<uint16_t> short_inds;
+    const void *vertex_data; //Point into the cache file, the vectors above or the mesh's own cpu copies.
+    const void *index_data;
+    size_t num_vertices;
+    unsigned int index_size; //Bytes per index, 2 or 4.
+    unsigned char *img_data; //Decoded texture (layouts with uvs only).
+    int img_width, img_height, img_channels;
+    compressed_texture compressed_img; //Or the block compressed texture (mesh_compress_texture).
+
+    mesh_staging() : vertex_data(nullptr), index_data(nullptr), num_vertices(0), index_size(sizeof(unsigned int)),
+                     img_data(nullptr), img_width(0), img_height(0), img_channels(0) {}
+
+    mesh_staging(const mesh_staging &) = delete;
+    mesh_staging &operator=(const mesh_staging &) = delete;
+
+    ~mesh_staging()
     {
-        glDeleteVertexArrays(1, &vao);
-        glDeleteBuffers(1, &vbo);
-        glDeleteBuffers(1, &ebo);
+        if (img_data != nullptr)
+            stbi_image_free(img_data);
     }
 
-    //Draw the mesh in the form of individual triangles (filled).
-    void draw_triangles()
+    bool has_image() const
     {
-        glBindVertexArray(vao); //Bind the mesh's vao.
-        glDrawElements(GL_TRIANGLES, (int)inds.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0); //Unbind the vao.
+        return img_data != nullptr || compressed_img.data != nullptr;
     }
+};
 
-    //Draw the mesh in the form of individual lines (wireframe).
-    void draw_lines(const float line_width = 1.0f)
+//The gpu side of a mesh's geometry. Meshes loaded through a resource_registry share it if they come from the same obj file,
+//and the last mesh that uses it frees it (the handles delete their objects).
+struct mesh_buffers
+{
+    gl_vertex_array vao; //Vertex array object.
+    gl_buffer vbo, ebo; //Vertex buffer object, element (index) buffer object.
+    size_t bytes; //Size of the vertex and index buffers.
+
+    mesh_buffers() : bytes(0) {}
+};
+
+//The image attached to a mesh, on the gpu. Shared like mesh_buffers by the meshes that use the same image file.
+//It can also be 1 layer of a texture array (see texture_array.h) : then tex is empty, the meshes do not bind anything when they draw
+//(the array is bound once for all of them), and the shader picks the layer from get_texture_layer().
+struct mesh_texture
+{
+    gl_texture tex;
+    size_t bytes; //Size of the texture and its mipmap chain (approximately, because drivers may pad e.g. RGB texels to 4 bytes).
+    std::shared_ptr<mesh_texture> array; //The texture array this is a layer of, if it is one. The layer itself counts 0 bytes.
+    unsigned int layer;
+
+    mesh_texture() : bytes(0), layer(0) {}
+};
+
+//Upload the first num_levels mip levels of a block compressed texture to the bound texture's target (GL_TEXTURE_2D, or a cube map face).
+//Returns their size in bytes, which is exact : compressed formats are not padded.
+inline size_t upload_compressed_levels(GLenum target, const compressed_texture &texture, uint32_t num_levels)
+{
+    if (!GLEW_EXT_texture_compression_s3tc)
     {
-        glBindVertexArray(vao);
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE); //Switch to line mode for wireframe/edge only drawing.
-        glLineWidth(line_width);
-        glDrawElements(GL_TRIANGLES, (int)inds.size(), GL_UNSIGNED_INT, 0);
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL); //Restore fill mode.
-        glBindVertexArray(0);
+        fprintf(stderr, "Error : The gpu does not support S3TC (BC1/BC3) compressed textures. Load without mesh_compress_texture. Exiting...\n");
+        exit(EXIT_FAILURE);
     }
 
-    //Draw the mesh in the form of individual points (vertices).
-    void draw_points(const float point_size = 2.0f)
+    GLenum internal_format = (texture.format == texture_bc3) ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    const unsigned char *level_data = texture.data;
+    size_t bytes = 0;
+    for (uint32_t level = 0; level < num_levels; ++level)
     {
-        glBindVertexArray(vao);
-        glPointSize(point_size);
-        glDrawElements(GL_POINTS, (int)inds.size(), GL_UNSIGNED_INT, 0); //Point mode.
-        glBindVertexArray(0);
+        uint32_t w = texture_level_dim(texture.width, level), h = texture_level_dim(texture.height, level);
+        size_t level_bytes = texture_level_bytes(texture.format, w, h);
+        glCompressedTexImage2D(target, (GLint)level, internal_format, (GLsizei)w, (GLsizei)h, 0, (GLsizei)level_bytes, level_data);
+        level_data += level_bytes;
+        bytes += level_bytes;
     }
+    return bytes;
+}
+
+//Where a mesh lives inside a mesh_pool (see mesh_pool.h) : its vertices start at first_vertex in the pool's vbo (the base vertex of its
+//draws) and its indices at index_offset bytes in the pool's ebo. The pool updates the range when it moves the data around, and takes
+//the space back when the last mesh that uses the range is destroyed.
+struct mesh_pool_range
+{
+    class mesh_pool_base *pool; //Null if the pool was destroyed before the mesh.
+    unsigned int vao; //The pool's vao, shared by all its meshes.
+    size_t first_vertex, num_vertices;
+    size_t index_offset, index_bytes;
+    size_t vertex_size;
 };
 
+class mesh_loader;
+class resource_registry;
+template<typename mesh_type> class mesh_pool;
+
 
 
-class meshvfn
+//Compile time description of a mesh's vertex layout, i.e. which attributes every vertex has besides its position.
+//Everything that differs between mesh types is derived from it : which obj lines are parsed, the width of the
+//dedup key, the interleaved stride and the vertex attribute setup. Attribute locations are 0 position, then normal, then uv.
+template<bool with_normals, bool with_uvs>
+struct mesh_layout
 {
-private:
-    unsigned int vao, vbo, ebo; //Vertex array object, vertex buffer object, element (index) buffer object.
-    std::vector<std::vector<float>> verts; //Mesh's vertices {{x1,y1,z1}, {x2,y2,z2}, ...}.
-    std::vector<std::vector<float>> norms; //Mesh's normals {{nx1,ny1,nz1}, {nx2,ny2,nz2}, ...}.
-    std::vector<unsigned int> inds; //Mesh's indices. Every index is used to reference BOTH vertex and normal attributes.
-    std::vector<float> interleaved_buffer; //Interleaved buffer that contains vertex and normal coordinates as pairs {x1,y1,z1, nx1,ny1,nz1, x2,y2,z2, nx2,ny2,nz2, ...}.
+    static constexpr bool has_normals = with_normals;
+    static constexpr bool has_uvs = with_uvs;
+
+    static constexpr unsigned int normal_offset = 3; //Offsets (in floats) of the attributes inside an interleaved vertex.
+    static constexpr unsigned int uv_offset = has_normals ? 6 : 3;
+    static constexpr unsigned int stride = uv_offset + (has_uvs ? 2 : 0); //Floats per interleaved vertex.
+
+    static constexpr unsigned int normal_location = 1;
+    static constexpr unsigned int uv_location = has_normals ? 2 : 1;
+
+    static constexpr uint32_t cache_layout = (has_normals ? 1 : 0) + (has_uvs ? 2 : 0); //See mesh_cache_layout.
+
+    typedef quantized_vertex_format<has_normals, has_uvs> quantized_format;
 
-    void process_inds_and_push_back(unsigned int vindex, unsigned int nindex, std::unordered_map<std::string, unsigned int> &combo_map)
+    //Bytes per vertex in the vbo.
+    static unsigned int vertex_size(bool quantized)
     {
-        //Create a key for the current vertex-normal pair.
-        std::string key = std::to_string(vindex) + "//" + std::to_string(nindex);
-        if (combo_map.find(key) == combo_map.end())
+        return quantized ? quantized_format::size : stride*(unsigned int)sizeof(float);
+    }
+
+    //Describe the vertex layout to the bound vao. The vbo must be bound to GL_ARRAY_BUFFER.
+    static void set_vertex_attributes(bool quantized)
+    {
+        const unsigned int size = vertex_size(quantized);
+        if (quantized)
         {
-            //This is a new vertex-normal combination, so store it.
-            interleaved_buffer.push_back(verts[vindex][0]);
-            interleaved_buffer.push_back(verts[vindex][1]);
-            interleaved_buffer.push_back(verts[vindex][2]);
-
-            interleaved_buffer.push_back(norms[nindex][0]);
-            interleaved_buffer.push_back(norms[nindex][1]);
-            interleaved_buffer.push_back(norms[nindex][2]);
-
-            //Assign a new index for this unique vertex-normal combo.
-            unsigned int new_index = (unsigned int)(interleaved_buffer.size()/6 - 1);
-            combo_map[key] = new_index;
-            inds.push_back(new_index);
+            glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, size, (void*)0); //snorm16 positions, in [-1,1].
+            glEnableVertexAttribArray(0);
+            if constexpr (has_normals)
+            {
+                glVertexAttribPointer(normal_location, 2, GL_SHORT, GL_TRUE, size, (void*)(size_t)quantized_format::normal_offset); //Octahedral snorm16 normals.
+                glEnableVertexAttribArray(normal_location);
+            }
+            if constexpr (has_uvs)
+            {
+                glVertexAttribPointer(uv_location, 2, GL_HALF_FLOAT, GL_FALSE, size, (void*)(size_t)quantized_format::uv_offset); //Half float uvs.
+                glEnableVertexAttribArray(uv_location);
+            }
         }
         else
         {
-            //This vertex-normal pair already exists, so use its existing index.
-            inds.push_back(combo_map[key]);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, size, (void*)0); //For vertices.
+            glEnableVertexAttribArray(0);
+            if constexpr (has_normals)
+            {
+                glVertexAttribPointer(normal_location, 3, GL_FLOAT, GL_FALSE, size, (void*)(normal_offset*sizeof(float))); //For normals.
+                glEnableVertexAttribArray(normal_location);
+            }
+            if constexpr (has_uvs)
+            {
+                glVertexAttribPointer(uv_location, 2, GL_FLOAT, GL_FALSE, size, (void*)(uv_offset*sizeof(float))); //For uvs.
+                glEnableVertexAttribArray(uv_location);
+            }
         }
     }
 
-public:
-    //Load the obj file, construct the mesh vectors and do the gpu memory setup.
-    meshvfn(const char *obj_path)
+    //Dedup key of a face corner, i.e. the indices of all the attributes the interleaved vertex is made of. 2 indices fit in 64 bits, 3 do not.
+    typedef typename std::conditional<has_normals && has_uvs, combo_key3, uint64_t>::type key_type;
+
+    static key_type corner_key(const obj_corner &c)
     {
-        std::ifstream fp;
-        fp.open(obj_path);
-        if (!fp.is_open())
-        {
-            fprintf(stderr, "Error : File '%s' was not found. Exiting...\n", obj_path);
-            exit(EXIT_FAILURE);
-        }
+        if constexpr (has_normals && has_uvs)
+            return combo_key(c.v, c.t, c.n);
+        else if constexpr (has_normals)
+            return combo_key(c.v, c.n);
+        else
+            return combo_key(c.v, c.t);
+    }
+};
+
+
 
-        std::unordered_map<std::string, unsigned int> combo_map; //Map to store unique vertex-normal pairs. Let's call them combos.
-        float x,y,z, nx,ny,nz;
-        unsigned int vi1,ni1, vi2,ni2, vi3,ni3;
-        std::string line;
-        while (getline(fp, line))
+template<typename layout>
+class mesh
+{
+private:
+    friend class mesh_loader; //Creates empty meshes and runs the 2 halves of the load on different threads.
+    friend class resource_registry; //Creates meshes that share their gpu objects with others.
+    friend class mesh_pool<mesh>; //Draws its meshes without rebinding the vao.
+
+    std::shared_ptr<mesh_buffers> buffers; //Vao, vbo and ebo. Null until the mesh is uploaded, and for meshes that live in a mesh_pool.
+    std::shared_ptr<mesh_pool_range> pool_range; //Set instead of buffers for meshes that live in a mesh_pool.
+    std::shared_ptr<mesh_texture> texture; //Layouts with uvs only.
+    std::vector<glm::vec3> verts; //Mesh's vertices {{x1,y1,z1}, {x2,y2,z2}, ...}, stored contiguously. Empty if the mesh was loaded from its cache file.
+    std::vector<glm::vec3> norms; //Mesh's normals {{nx1,ny1,nz1}, {nx2,ny2,nz2}, ...}. Empty if the layout has no normals.
+    std::vector<glm::vec2> uvs; //Mesh's texture coords (u,v) {{u1,v1}, {u2,v2}, ...}. Empty if the layout has no uvs.
+    std::vector<unsigned int> inds; //Mesh's indices, the levels of detail one after the other. Every index is used to reference ALL attributes of a vertex.
+    std::vector<float> interleaved_buffer; //Interleaved buffer that contains the attributes of every vertex in a row {x1,y1,z1, nx1,ny1,nz1, u1,v1, x2,...}. Not used by position-only meshes.
+    unsigned int num_inds; //Number of indices in the ebo.
+    mesh_lod_chain lods; //Range of the ebo of every level of detail. Meshes loaded without mesh_lod have level 0 only, the whole ebo.
+    std::vector<mesh_meshlet> meshlets; //Meshlets of all the levels (mesh_meshlets only). Kept even by mesh_gpu_resident_only, culling needs them.
+    GLenum index_type; //GL_UNSIGNED_SHORT if every index fits in 16 bits, otherwise GL_UNSIGNED_INT.
+    bool quantized; //True if the vbo holds compact vertices (mesh_quantize).
+    mesh_bounds bounds; //Bounds of the vertices, computed once at load time.
+
+    void process_inds_and_push_back(const obj_corner &c, combo_table<typename layout::key_type> &combos)
+    {
+        //Look up the current attribute combination. If it is new, it gets the next free index.
+        bool is_new;
+        unsigned int index = combos.find_or_insert(layout::corner_key(c), (unsigned int)(interleaved_buffer.size()/layout::stride), is_new);
+        if (is_new)
         {
-            if (line[0] == 'v' && line[1] == ' ')
-            {
-                sscanf(line.c_str(), "v %f %f %f", &x,&y,&z);
-                verts.push_back({x,y,z});
-            }
-            else if (line[0] == 'v' && line[1] == 'n')
+            //This is a new combination, so store it.
+            interleaved_buffer.push_back(verts[c.v].x);
+            interleaved_buffer.push_back(verts[c.v].y);
+            interleaved_buffer.push_back(verts[c.v].z);
+
+            if constexpr (layout::has_normals)
             {
-                sscanf(line.c_str(), "vn %f %f %f", &nx,&ny,&nz);
-                norms.push_back({nx,ny,nz});
+                interleaved_buffer.push_back(norms[c.n].x);
+                interleaved_buffer.push_back(norms[c.n].y);
+                interleaved_buffer.push_back(norms[c.n].z);
             }
-            else if (line[0] == 'f')
+            if constexpr (layout::has_uvs)
             {
-                sscanf(line.c_str(), "f %u//%u %u//%u %u//%u", &vi1,&ni1, &vi2,&ni2, &vi3,&ni3); //This must be the faces format of the obj file, so that everything works.
-                process_inds_and_push_back(vi1-1, ni1-1, combo_map);
-                process_inds_and_push_back(vi2-1, ni2-1, combo_map);
-                process_inds_and_push_back(vi3-1, ni3-1, combo_map);
+                interleaved_buffer.push_back(uvs[c.t].x);
+                interleaved_buffer.push_back(uvs[c.t].y);
             }
         }
-
-        glGenVertexArrays(1, &vao);
-        glBindVertexArray(vao);
-
-        glGenBuffers(1, &vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, interleaved_buffer.size()*sizeof(float), &interleaved_buffer[0], GL_STATIC_DRAW);
-        
-        glGenBuffers(1, &ebo);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, inds.size()*sizeof(unsigned int), &inds[0], GL_STATIC_DRAW);
-        
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6*sizeof(float), (void*)0); //For vertices.
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6*sizeof(float), (void*)(3*sizeof(float)));  //For normals.
-        glEnableVertexAttribArray(1);
-        
-        glBindVertexArray(0);
+        inds.push_back(index);
     }
 
-    //Free resources.
-    ~meshvfn()
+    //Send the vertex and index buffers (index_size bytes per index) to the gpu and describe the vertex layout.
+    void upload_buffers(const void *vertex_data, size_t num_vertices, const void *index_data, unsigned int index_size)
     {
-        glDeleteVertexArrays(1, &vao);
-        glDeleteBuffers(1, &vbo);
-        glDeleteBuffers(1, &ebo);
-    }
+        const unsigned int vertex_size = layout::vertex_size(quantized);
+        index_type = (index_size == 2) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        buffers = std::make_shared<mesh_buffers>();
+        buffers->bytes = num_vertices*vertex_size + (size_t)num_inds*index_size;
 
-    void draw_triangles()
-    {
-        //Remember : glDrawElements() uses 1 index to reference all attributes like positions, normals, UVs, etc...
-        glBindVertexArray(vao);
-        glDrawElements(GL_TRIANGLES, (int)inds.size(), GL_UNSIGNED_INT, 0);
+        buffers->vao = gl_vertex_array::create();
+        glBindVertexArray(buffers->vao.get());
+
+        buffers->vbo = gl_buffer::create();
+        glBindBuffer(GL_ARRAY_BUFFER, buffers->vbo.get());
+        glBufferData(GL_ARRAY_BUFFER, num_vertices*vertex_size, vertex_data, GL_STATIC_DRAW);
+
+        buffers->ebo = gl_buffer::create(); //OpenGL expects the indices stored in the ebo to reference whole (interleaved) vertices.
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers->ebo.get());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (size_t)num_inds*index_size, index_data, GL_STATIC_DRAW);
+
+        layout::set_vertex_attributes(quantized);
         glBindVertexArray(0);
     }
 
-    //Farthest vertex distance with respect to the local coordinate system.
-    float get_farthest_vertex_distance()
+    //Stage the buffers straight from the mapped cache file. Returns false if there is no valid cache for this obj file.
+    bool prepare_from_cache(const char *obj_path, const mapped_file &obj_file, uint64_t obj_hash, unsigned int flags, mesh_staging &staging)
     {
-        float farthest = std::sqrt(verts[0][0]*verts[0][0] + verts[0][1]*verts[0][1] + verts[0][2]*verts[0][2]); //Assume that the farthest vertex distance is the first one.
-        for (size_t i = 1; i < verts.size(); ++i)
-        {
-            float dist = std::sqrt(verts[i][0]*verts[i][0] + verts[i][1]*verts[i][1] + verts[i][2]*verts[i][2]);
-            if (dist > farthest)
-                farthest = dist;
-        }
-        return farthest;
+        std::unique_ptr<mapped_file> cache_file(new mapped_file(mesh_cache_path(obj_path, layout::cache_layout, flags & mesh_buffer_flags).c_str()));
+        const mesh_cache_header *header = mesh_cache_validate(*cache_file, layout::cache_layout, layout::vertex_size(quantized), flags & mesh_buffer_flags, obj_file.size(), obj_hash);
+        if (header == nullptr)
+            return false;
+
+        num_inds = header->num_indices;
+        bounds = header->bounds;
+        lods = header->lods;
+        meshlets.resize(header->num_meshlets);
+        if (!meshlets.empty())
+            memcpy(meshlets.data(), mesh_cache_meshlets(header), meshlets.size()*sizeof(mesh_meshlet));
+        staging.vertex_data = mesh_cache_vertices(header);
+        staging.num_vertices = header->num_vertices;
+        staging.index_data = mesh_cache_indices(header);
+        staging.index_size = header->index_size;
+        staging.cache_file = std::move(cache_file);
+        return true;
     }
 
-    //Nearest vertex distance with respect to the local coordinate system.
-    float get_nearest_vertex_distance()
+    //Parse the obj file, combine the attributes of every face corner, stage the gpu buffers and write the cache file for the next time.
+    void prepare_from_obj(const char *obj_path, const mapped_file &obj_file, uint64_t obj_hash, unsigned int flags, mesh_staging &staging)
     {
-        float nearest = std::sqrt(verts[0][0]*verts[0][0] + verts[0][1]*verts[0][1] + verts[0][2]*verts[0][2]); //Assume that the nearest vertex distance is the first one.
-        for (size_t i = 1; i < verts.size(); ++i)
+        obj_data data;
+        obj_parse<layout::has_normals, layout::has_uvs>(obj_file, data);
+
+        size_t num_defaulted;
+        if (!obj_check_indices<layout::has_normals, layout::has_uvs>(data, num_defaulted))
         {
-            float dist = std::sqrt(verts[i][0]*verts[i][0] + verts[i][1]*verts[i][1] + verts[i][2]*verts[i][2]);
-            if (dist < nearest)
-                nearest = dist;
+            fprintf(stderr, "Error : File '%s' has faces that reference vertices that do not exist. Exiting...\n", obj_path);
+            exit(EXIT_FAILURE);
         }
-        return nearest;
-    }
-};
-
+        if (num_defaulted > 0)
+            fprintf(stderr, "Warning : %u face corners in '%s' have no normal or uv. A zero one is used instead.\n", (unsigned int)num_defaulted, obj_path);
 
+        verts = std::move(data.verts);
+        norms = std::move(data.norms);
+        uvs = std::move(data.uvs);
+        inds.reserve(data.corners.size());
 
-class meshvft
-{
-private:
-    unsigned int vao, vbo, ebo, tex; //Vertex array object, vertex buffer object, element (index) buffer object and texture ID.
-    std::vector<std::vector<float>> verts; //Mesh's vertices {{x1,y1,z1}, {x2,y2,z2}, ...}.
-    std::vector<std::vector<float>> uvs; //Mesh's texture coords (u,v) {{u1,v1}, {u2,v2}, ...}.
-    std::vector<unsigned int> inds; //Mesh's indices. Every index is used to reference BOTH vertex and uv attributes.
-    std::vector<float> interleaved_buffer; //Interleaved buffer that contains vertex and uv coordinates as pairs {x1,y1,z1, u1,v1, x2,y2,z2, u2,v2, ...}.
-
-    void process_inds_and_push_back(unsigned int vindex, unsigned int tindex, std::unordered_map<std::string, unsigned int> &combo_map)
-    {
-        //Create a key for the current vertex-uv pair.
-        std::string key = std::to_string(vindex) + "/" + std::to_string(tindex);
-        if (combo_map.find(key) == combo_map.end())
+        float *vertex_data;
+        size_t num_vertices;
+        if constexpr (!layout::has_normals && !layout::has_uvs)
         {
-            //This is a new vertex-normal combination, so store it.
-            interleaved_buffer.push_back(verts[vindex][0]);
-            interleaved_buffer.push_back(verts[vindex][1]);
-            interleaved_buffer.push_back(verts[vindex][2]);
-
-            interleaved_buffer.push_back(uvs[tindex][0]);
-            interleaved_buffer.push_back(uvs[tindex][1]);
-
-            //Assign a new index for this unique vertex-normal combo.
-            unsigned int new_index = (unsigned int)(interleaved_buffer.size()/5 - 1);
-            combo_map[key] = new_index;
-            inds.push_back(new_index);
+            //The vertices are used as they are. The indices are already converted to 0-based by the parser (obj files are 1-based).
+            for (const obj_corner &c : data.corners)
+                inds.push_back(c.v);
+            vertex_data = &verts[0].x;
+            num_vertices = verts.size();
         }
         else
         {
-            //This vertex-uv pair already exists, so use its existing index.
-            inds.push_back(combo_map[key]);
+            combo_table<typename layout::key_type> combos(data.corners.size()); //Table of the unique attribute combinations. Let's call them combos. There can't be more combos than face corners.
+            interleaved_buffer.reserve(layout::stride*std::max({verts.size(), norms.size(), uvs.size()})); //Good guess for smooth meshes. Sharp edges and uv seams need more.
+            for (const obj_corner &c : data.corners)
+                process_inds_and_push_back(c, combos);
+            vertex_data = interleaved_buffer.data();
+            num_vertices = interleaved_buffer.size()/layout::stride;
+        }
+        if (flags & mesh_optimize)
+            mesh_optimize_buffers(inds, vertex_data, num_vertices, layout::stride);
+        if (flags & mesh_lod)
+            lods = mesh_build_lods(inds, vertex_data, num_vertices, layout::stride, layout::has_normals ? (int)layout::normal_offset : -1,
+                                   layout::has_uvs ? (int)layout::uv_offset : -1, (flags & mesh_optimize) != 0);
+        else
+            lods = mesh_single_lod((uint32_t)inds.size());
+        meshlets.clear();
+        if (flags & mesh_meshlets)
+            for (uint32_t i = 0; i < lods.num_lods; ++i)
+            {
+                lods.lods[i].first_meshlet = (uint32_t)meshlets.size();
+                mesh_build_meshlets(inds, lods.lods[i].first_index, lods.lods[i].num_indices, vertex_data, num_vertices, layout::stride, meshlets);
+                lods.lods[i].num_meshlets = (uint32_t)meshlets.size() - lods.lods[i].first_meshlet;
+            }
+        num_inds = (unsigned int)inds.size();
+        bounds = mesh_compute_bounds(&verts[0].x, verts.size(), 3);
+
+        //The gpu gets 16-bit indices whenever they fit, which halves the ebo and the index fetch bandwidth.
+        staging.index_data = inds.data();
+        staging.index_size = sizeof(unsigned int);
+        if (num_vertices <= 65536)
+        {
+            staging.short_inds.assign(inds.begin(), inds.end());
+            staging.index_data = staging.short_inds.data();
+            staging.index_size = sizeof(uint16_t);
         }
+
+        //Compact vertices, if asked for. The cpu copies stay in full precision.
+        staging.vertex_data = vertex_data;
+        staging.num_vertices = num_vertices;
+        if (quantized)
+        {
+            mesh_quantize_vertices<layout::has_normals, layout::has_uvs>(vertex_data, num_vertices, layout::stride, bounds, staging.quantized_vertices);
+            staging.vertex_data = staging.quantized_vertices.data();
+        }
+
+        mesh_cache_write(obj_path, layout::cache_layout, flags & mesh_buffer_flags, obj_file.size(), obj_hash, bounds, lods,
+                         staging.vertex_data, layout::vertex_size(quantized), num_vertices, staging.index_data, staging.index_size, num_inds,
+                         meshlets.data(), meshlets.size());
     }
 
-public:
-    //Load the obj file, construct the mesh vectors and do the gpu memory setup regarding both the mesh data and the image attached to the mesh.
-    meshvft(const char *obj_path, const char *img_path)
+    //Free the cpu copies of the mesh data. Only what the queries need (the bounds) and what drawing needs (vao, number of indices) is kept.
+    void release_cpu_data()
     {
-        std::ifstream fp;
-        fp.open(obj_path);
-        if (!fp.is_open())
+        free_vector(verts);
+        free_vector(norms);
+        free_vector(uvs);
+        free_vector(inds);
+        free_vector(interleaved_buffer);
+    }
+
+    //Cpu side of the load : find the mesh's cache file (or parse the obj file if there is no up-to-date cache) and stage the gpu buffers.
+    //No OpenGL calls, so this can run on a worker thread. obj_hash is the obj file's mesh_cache_hash(), if the caller already knows it
+    //(e.g. the resource registry), so that the file is not hashed twice.
+    void prepare(const char *obj_path, unsigned int flags, mesh_staging &staging, const uint64_t *obj_hash = nullptr)
+    {
+        quantized = (flags & mesh_quantize) != 0;
+        mapped_file obj_file(obj_path);
+        if (!obj_file.is_open())
         {
             fprintf(stderr, "Error : File '%s' was not found. Exiting...\n", obj_path);
             exit(EXIT_FAILURE);
         }
 
-        std::unordered_map<std::string, unsigned int> combo_map; //Map to store unique vertex-uv pairs. Let's call them combos.
-        float x,y,z, u,v;
-        unsigned int vi1,ti1, vi2,ti2, vi3,ti3;
-        std::string line;
-        while (getline(fp, line))
+        uint64_t hash = (obj_hash != nullptr) ? *obj_hash : mesh_cache_hash(obj_file.data(), obj_file.size());
+        if (!prepare_from_cache(obj_path, obj_file, hash, flags, staging))
+            prepare_from_obj(obj_path, obj_file, hash, flags, staging);
+    }
+
+    //Decode the image attached to the mesh (or find its compressed texture, with mesh_compress_texture). No OpenGL calls, so this can run on a worker thread.
+    void prepare_texture(const char *img_path, unsigned int flags, mesh_staging &staging)
+    {
+        decoded_image image;
+        image.path = img_path;
+        image.flip = true; //Per thread (see decoded_image::decode()), so that concurrent loads (e.g. a skybox) cannot change it under our feet.
+        image.compress = (flags & mesh_compress_texture) != 0;
+        image.decode();
+        take_texture(image, staging);
+    }
+
+    //Stage an image that was already decoded, e.g. by an image_batch that decoded all the textures of a scene at once.
+    void take_texture(decoded_image &image, mesh_staging &staging)
+    {
+        if (!image.loaded())
         {
-            if (line[0] == 'v' && line[1] == ' ')
-            {
-                sscanf(line.c_str(), "v %f %f %f", &x,&y,&z);
-                verts.push_back({x,y,z});
-            }
-            else if (line[0] == 'v' && line[1] == 't')
-            {
-                sscanf(line.c_str(), "vt %f %f", &u,&v);
-                uvs.push_back({u,v});
-            }
-            else if (line[0] == 'f')
-            {
-                sscanf(line.c_str(), "f %u/%u %u/%u %u/%u", &vi1,&ti1, &vi2,&ti2, &vi3,&ti3); //This must be the faces format of the obj file, so that everything works.
-                process_inds_and_push_back(vi1-1, ti1-1, combo_map);
-                process_inds_and_push_back(vi2-1, ti2-1, combo_map);
-                process_inds_and_push_back(vi3-1, ti3-1, combo_map);
-            }
+            fprintf(stderr, "Error : File '%s' was not found. Exiting...\n", image.path.c_str());
+            exit(EXIT_FAILURE);
         }
+        staging.img_width = image.width;
+        staging.img_height = image.height;
+        staging.img_channels = image.channels;
+        staging.img_data = image.release();
+        staging.compressed_img = std::move(image.compressed);
+    }
 
-        glGenVertexArrays(1, &vao);
-        glBindVertexArray(vao);
-
-        glGenBuffers(1, &vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, interleaved_buffer.size()*sizeof(float), &interleaved_buffer[0], GL_STATIC_DRAW);
+    //Gpu side of the load : send the staged buffers (and texture) to the gpu. Must run on the thread that owns the OpenGL context.
+    void upload(mesh_staging &staging, unsigned int flags)
+    {
+        upload_buffers(staging.vertex_data, staging.num_vertices, staging.index_data, staging.index_size);
+        if (staging.has_image())
+            upload_texture(staging);
+        if (flags & mesh_gpu_resident_only)
+            release_cpu_data();
+    }
 
-        glGenBuffers(1, &ebo);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, inds.size()*sizeof(unsigned int), &inds[0], GL_STATIC_DRAW);
-        
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5*sizeof(float), (void*)0); //For vertices.
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5*sizeof(float), (void*)(3*sizeof(float))); //For uvs.
-        glEnableVertexAttribArray(1);
-        glBindVertexArray(0);
+    //Same, but the buffers go into a range of the pool's buffers (see mesh_pool.h).
+    void upload(mesh_staging &staging, unsigned int flags, mesh_pool<mesh> &pool)
+    {
+        index_type = (staging.index_size == 2) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        pool_range = pool.allocate(staging.vertex_data, staging.num_vertices, quantized, staging.index_data, (size_t)num_inds*staging.index_size);
+        if (staging.has_image())
+            upload_texture(staging);
+        if (flags & mesh_gpu_resident_only)
+            release_cpu_data();
+    }
 
-        //Tell OpenGL how to apply the texture on the mesh.
-        glGenTextures(1, &tex);
-        glBindTexture(GL_TEXTURE_2D, tex);
+    //Tell OpenGL how to apply the decoded image on the mesh.
+    void upload_texture(mesh_staging &staging)
+    {
+        texture = std::make_shared<mesh_texture>();
+        texture->tex = gl_texture::create();
+        glBindTexture(GL_TEXTURE_2D, texture->tex.get());
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glPixelStorei(GL_UNPACK_ALIGNMENT, 1); //This is useful for textures with non-standard widths or single-channel textures.
 
-        //Load the image texture.
-        int img_width, img_height, img_channels;
-        stbi_set_flip_vertically_on_load(true);
-        unsigned char *img_data = stbi_load(img_path, &img_width, &img_height, &img_channels, 0);
-        if (!img_data)
+        //Compressed textures come with their mipmaps, so they are uploaded as they are.
+        if (staging.compressed_img.data != nullptr)
         {
-            fprintf(stderr, "Error : File '%s' was not found. Exiting...\n", img_path);
-            exit(EXIT_FAILURE);
+            texture->bytes = upload_compressed_levels(GL_TEXTURE_2D, staging.compressed_img, staging.compressed_img.num_levels);
+            staging.compressed_img = compressed_texture(); //Unmap the cache file.
+            return;
         }
 
+        int img_width = staging.img_width, img_height = staging.img_height, img_channels = staging.img_channels;
+
         //Determine the correct format based on the number of channels (img_channels).
-        GLenum format;
+        GLenum format = GL_RGB;
         if (img_channels == 1)
             format = GL_RED; //Single-channel (grayscale image).
+        else if (img_channels == 2)
+            format = GL_RG; //Grayscale + alpha.
         else if (img_channels == 3)
             format = GL_RGB; //Classical 3-channel image (e.g. jpg).
         else if (img_channels == 4)
             format = GL_RGBA; //4-channel image, i.e. RGB + alpha channel for opacity (e.g. png).
 
-        glTexImage2D(GL_TEXTURE_2D, 0, format, img_width, img_height, 0, format, GL_UNSIGNED_BYTE, img_data);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, img_width, img_height, 0, format, GL_UNSIGNED_BYTE, staging.img_data);
         glGenerateMipmap(GL_TEXTURE_2D);
-        stbi_image_free(img_data); //Free image resources.
+        stbi_image_free(staging.img_data); //Free image resources.
+        staging.img_data = nullptr;
+
+        //Account for the texture and its mipmap chain (approximately, because drivers may pad e.g. RGB texels to 4 bytes).
+        for (int w = img_width, h = img_height; ; w = std::max(w/2, 1), h = std::max(h/2, 1))
+        {
+            texture->bytes += (size_t)w*h*img_channels;
+            if (w == 1 && h == 1)
+                break;
+        }
     }
 
-    //Free resources.
-    ~meshvft()
+    //The vao to draw the mesh with (its own or its pool's).
+    unsigned int get_vao() const
     {
-        glDeleteVertexArrays(1, &vao);
-        glDeleteBuffers(1, &vbo);
-        glDeleteBuffers(1, &ebo);
-        glDeleteTextures(1, &tex);
+        return pool_range ? pool_range->vao : buffers->vao.get();
     }
 
-    void draw_triangles()
+    //Byte offset of a level of detail in the ebo (the pool's ebo for meshes in a pool). Levels past the last one draw the last one.
+    const mesh_lod_level &get_lod(unsigned int lod) const
     {
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, tex);
-        glBindVertexArray(vao);
-        glDrawElements(GL_TRIANGLES, (int)inds.size(), GL_UNSIGNED_INT, 0);
+        return lods.lods[std::min(lod, lods.num_lods - 1)];
+    }
+
+    size_t get_index_offset(unsigned int lod) const
+    {
+        return (pool_range ? pool_range->index_offset : 0) + (size_t)get_lod(lod).first_index*((index_type == GL_UNSIGNED_SHORT) ? 2 : 4);
+    }
+
+    //Draw call with the vao already bound. Meshes in a pool start at their base vertex and index offset.
+    void draw_elements(GLenum mode, unsigned int lod = 0) const
+    {
+        if (pool_range)
+            glDrawElementsBaseVertex(mode, (int)get_lod(lod).num_indices, index_type, (void*)get_index_offset(lod), (int)pool_range->first_vertex);
+        else
+            glDrawElements(mode, (int)get_lod(lod).num_indices, index_type, (void*)get_index_offset(lod));
+    }
+
+    //Draw the runs of a culled meshlet list with the vao already bound.
+    void draw_meshlet_runs(const meshlet_draw_list &visible) const
+    {
+        if (!visible.counts.empty())
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, visible.counts.data(), index_type, visible.offsets.data(), (GLsizei)visible.counts.size(),
+                                          visible.base_vertices.data());
+    }
+
+    //Same, for num_instances copies of the mesh.
+    void draw_elements_instanced(GLenum mode, size_t num_instances, unsigned int lod = 0) const
+    {
+        if (pool_range)
+            glDrawElementsInstancedBaseVertex(mode, (int)get_lod(lod).num_indices, index_type, (void*)get_index_offset(lod), (int)num_instances, (int)pool_range->first_vertex);
+        else
+            glDrawElementsInstanced(mode, (int)get_lod(lod).num_indices, index_type, (void*)get_index_offset(lod), (int)num_instances);
+    }
+
+    //Empty mesh that draws nothing, filled in later by mesh_loader. It owns no gpu objects yet, so it may be created and destroyed on any thread.
+    mesh() : num_inds(0), lods(mesh_single_lod(0)), index_type(GL_UNSIGNED_INT), quantized(false), bounds() {}
+
+public:
+    typedef layout layout_type;
+
+    //Load the mesh and do the gpu memory setup. This constructor exists for layouts without uvs.
+    //flags is a combination of mesh_load_flags (e.g. mesh_gpu_resident_only). For loading in the background, see mesh_loader.h.
+    template<typename L = layout, typename = typename std::enable_if<!L::has_uvs>::type>
+    mesh(const char *obj_path, unsigned int flags = 0) : mesh()
+    {
+        mesh_staging staging;
+        prepare(obj_path, flags, staging);
+        upload(staging, flags);
+    }
+
+    //Load the mesh and do the gpu memory setup regarding both the mesh data and the image attached to the mesh. This constructor exists for layouts with uvs.
+    template<typename L = layout, typename = typename std::enable_if<L::has_uvs>::type>
+    mesh(const char *obj_path, const char *img_path, unsigned int flags = 0) : mesh()
+    {
+        mesh_staging staging;
+        prepare(obj_path, flags, staging);
+        prepare_texture(img_path, flags, staging);
+        upload(staging, flags);
+    }
+
+    //Load the mesh into a pool that holds the vertices and indices of many meshes of the same layout, instead of into buffers of its own.
+    //The pool must outlive the mesh. See mesh_pool.h.
+    template<typename L = layout, typename = typename std::enable_if<!L::has_uvs>::type>
+    mesh(const char *obj_path, mesh_pool<mesh> &pool, unsigned int flags = 0) : mesh()
+    {
+        mesh_staging staging;
+        prepare(obj_path, flags, staging);
+        upload(staging, flags, pool);
+    }
+
+    //Load the mesh into a pool, with its image (which gets a texture of its own).
+    template<typename L = layout, typename = typename std::enable_if<L::has_uvs>::type>
+    mesh(const char *obj_path, const char *img_path, mesh_pool<mesh> &pool, unsigned int flags = 0) : mesh()
+    {
+        mesh_staging staging;
+        prepare(obj_path, flags, staging);
+        prepare_texture(img_path, flags, staging);
+        upload(staging, flags, pool);
+    }
+
+    //Load the mesh, with a texture that is loaded elsewhere, e.g. streamed in over several frames by a texture_streamer (see texture_streamer.h).
+    template<typename L = layout, typename = typename std::enable_if<L::has_uvs>::type>
+    mesh(const char *obj_path, std::shared_ptr<mesh_texture> shared_texture, unsigned int flags = 0) : mesh()
+    {
+        mesh_staging staging;
+        prepare(obj_path, flags, staging);
+        upload(staging, flags);
+        texture = std::move(shared_texture);
+    }
+
+    //Meshes are not copied. Sharing gpu objects between meshes is the job of resource_registry.
+    mesh(const mesh &) = delete;
+    mesh &operator=(const mesh &) = delete;
+
+    //Meshes can be moved, e.g. stored by value in a std::vector that grows. The moved from mesh is left empty and must not be drawn.
+    mesh(mesh &&) noexcept = default;
+    mesh &operator=(mesh &&) noexcept = default;
+
+    //The gpu objects are freed by the last mesh that refers to them (see mesh_buffers). A mesh that was never uploaded refers to none,
+    //so it may even be destroyed on a thread without the OpenGL context.
+
+    //Bind the mesh's texture to texture unit 0. Layers of a texture array bind nothing, the array is bound once (see texture_array::bind()).
+    void bind_texture() const
+    {
+        if (!texture->array)
+        {
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, texture->tex.get());
+        }
+    }
+
+    void unbind_texture() const
+    {
+        if (!texture->array)
+            glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    //The layer of the texture array that the mesh's texture is in (0 for plain textures), for the layer uniform of texture_array.frag.
+    unsigned int get_texture_layer() const
+    {
+        return texture->layer;
+    }
+
+    //Draw the mesh in the form of individual triangles (filled). lod picks a level of detail of meshes loaded with mesh_lod (see select_lod()).
+    void draw_triangles(unsigned int lod = 0)
+    {
+        //Remember : glDrawElements() uses 1 index to reference all attributes like positions, normals, UVs, etc...
+        if constexpr (layout::has_uvs)
+            bind_texture();
+        glBindVertexArray(get_vao());
+        draw_elements(GL_TRIANGLES, lod);
         glBindVertexArray(0);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        if constexpr (layout::has_uvs)
+            unbind_texture();
+    }
+
+    //Draw the meshlets that the last cull_meshlets() into this list found visible (filled triangles).
+    void draw_triangles(const meshlet_draw_list &visible)
+    {
+        if constexpr (layout::has_uvs)
+            bind_texture();
+        glBindVertexArray(get_vao());
+        draw_meshlet_runs(visible);
+        glBindVertexArray(0);
+        if constexpr (layout::has_uvs)
+            unbind_texture();
+    }
+
+    //Draw 1 copy of the mesh (filled triangles) per instance of the last update of an instance buffer, with 1 draw call.
+    //Use it with the *_instanced.vert shaders, which read the instances instead of the model matrix uniform. See instance_buffer.h.
+    template<typename instance_type>
+    void draw_triangles_instanced(const instance_buffer<instance_type> &instances, unsigned int lod = 0)
+    {
+        if (instances.size() == 0)
+            return;
+        if constexpr (layout::has_uvs)
+            bind_texture();
+        glBindVertexArray(get_vao());
+        instances.bind_attributes();
+        draw_elements_instanced(GL_TRIANGLES, instances.size(), lod);
+        instances.unbind_attributes();
+        glBindVertexArray(0);
+        if constexpr (layout::has_uvs)
+            unbind_texture();
+    }
+
+    //Draw the mesh in the form of individual lines (wireframe).
+    void draw_lines(const float line_width = 1.0f)
+    {
+        glBindVertexArray(get_vao());
+        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE); //Switch to line mode for wireframe/edge only drawing.
+        glLineWidth(line_width);
+        draw_elements(GL_TRIANGLES);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL); //Restore fill mode.
+        glBindVertexArray(0);
+    }
+
+    //Draw the mesh in the form of individual points (vertices).
+    void draw_points(const float point_size = 2.0f)
+    {
+        glBindVertexArray(get_vao());
+        glPointSize(point_size);
+        draw_elements(GL_POINTS); //Point mode.
+        glBindVertexArray(0);
+    }
+
+    //Coarsest level of detail whose simplification error covers at most max_pixel_error pixels on screen, when 1 unit of the mesh's local
+    //coordinates covers pixels_per_unit pixels (see camera::pixels_per_unit(), and scale it by the model matrix's scale if there is one).
+    //Level 0 is the full mesh. The error is a root mean square distance (see mesh_simplify.h), so 1 pixel keeps the silhouette within ~2.
+    unsigned int select_lod(float pixels_per_unit, float max_pixel_error = 1.0f) const
+    {
+        unsigned int lod = 0;
+        while (lod + 1 < lods.num_lods && lods.lods[lod + 1].error*pixels_per_unit <= max_pixel_error)
+            ++lod;
+        return lod;
+    }
+
+    unsigned int get_num_lods() const
+    {
+        return lods.num_lods;
+    }
+
+    //Triangles drawn by a level of detail.
+    unsigned int get_num_triangles(unsigned int lod = 0) const
+    {
+        return get_lod(lod).num_indices/3;
+    }
+
+    //Cull the meshlets of a level of detail (see mesh_meshlet.h) against the view frustum of a projection*view matrix and a camera position
+    //(world coordinates), for a model matrix. The visible ones replace the contents of visible, drawn with draw_triangles(visible).
+    //cone_culling = false keeps the back facing meshlets, e.g. for a shadow map or an open mesh drawn without face culling.
+    //A mesh loaded without mesh_meshlets counts as 1 meshlet, the whole level, culled by its bounding sphere only.
+    void cull_meshlets(const glm::mat4 &projection_view, const glm::mat4 &model, const glm::vec3 &camera_pos, meshlet_draw_list &visible,
+                       unsigned int lod = 0, bool cone_culling = true) const
+    {
+        visible.counts.clear();
+        visible.offsets.clear();
+        visible.base_vertices.clear();
+        visible.index_type = index_type;
+        visible.stats = meshlet_cull_stats();
+
+        const mesh_lod_level &level = get_lod(lod);
+        mesh_meshlet whole_level = {};
+        const mesh_meshlet *level_meshlets = meshlets.data() + level.first_meshlet;
+        size_t num_meshlets = level.num_meshlets;
+        if (num_meshlets == 0)
+        {
+            for (int k = 0; k < 3; ++k)
+                whole_level.center[k] = bounds.sphere_center[k];
+            whole_level.radius = bounds.sphere_radius;
+            whole_level.cone_cutoff = 1.0f;
+            whole_level.first_index = level.first_index;
+            whole_level.num_indices = level.num_indices;
+            level_meshlets = &whole_level;
+            num_meshlets = 1;
+        }
+        glm::vec3 local_camera_pos = glm::vec3(glm::inverse(model)*glm::vec4(camera_pos, 1.0f));
+        mesh_cull_meshlets(level_meshlets, num_meshlets, frustum(projection_view*model), local_camera_pos, cone_culling,
+                           pool_range ? pool_range->index_offset : 0, (index_type == GL_UNSIGNED_SHORT) ? 2 : 4,
+                           pool_range ? (GLint)pool_range->first_vertex : 0, visible);
+    }
+
+    //Meshlets of a level of detail, 0 for meshes loaded without mesh_meshlets.
+    unsigned int get_num_meshlets(unsigned int lod = 0) const
+    {
+        return get_lod(lod).num_meshlets;
+    }
+
+    //Farthest vertex distance with respect to the local coordinate system.
+    float get_farthest_vertex_distance()
+    {
+        return bounds.farthest;
+    }
+
+    //Nearest vertex distance with respect to the local coordinate system.
+    float get_nearest_vertex_distance()
+    {
+        return bounds.nearest;
+    }
+
+    //Bounding sphere with respect to the local coordinate system : center (xyz) and radius (w). Computed at load time, like all the bounds.
+    glm::vec4 get_bounding_sphere() const
+    {
+        return glm::vec4(bounds.sphere_center[0], bounds.sphere_center[1], bounds.sphere_center[2], bounds.sphere_radius);
+    }
+
+    //Axis aligned bounding box with respect to the local coordinate system.
+    void get_aabb(glm::vec3 &aabb_min, glm::vec3 &aabb_max) const
+    {
+        aabb_min = glm::vec3(bounds.aabb_min[0], bounds.aabb_min[1], bounds.aabb_min[2]);
+        aabb_max = glm::vec3(bounds.aabb_max[0], bounds.aabb_max[1], bounds.aabb_max[2]);
+    }
+
+    //Matrix that maps quantized positions (in [-1,1]) back to the mesh's local coordinates, i.e. the bounding box center and half extents.
+    //The *_quantized.vert shaders apply it before the model matrix. It is the identity for meshes that are not quantized.
+    glm::mat4 get_dequantization_matrix() const
+    {
+        glm::mat4 dequantization(1.0f);
+        if (quantized)
+        {
+            glm::vec3 center, half_extent;
+            mesh_quantization_box(bounds, center, half_extent);
+            dequantization[0][0] = half_extent.x;
+            dequantization[1][1] = half_extent.y;
+            dequantization[2][2] = half_extent.z;
+            dequantization[3] = glm::vec4(center, 1.0f);
+        }
+        return dequantization;
+    }
+
+    //Heap memory held by the mesh object (its cpu side copies of the mesh data), in bytes.
+    size_t get_cpu_memory_bytes() const
+    {
+        return sizeof(*this) + vector_bytes(verts) + vector_bytes(norms) + vector_bytes(uvs) + vector_bytes(inds) + vector_bytes(interleaved_buffer) +
+               vector_bytes(meshlets);
+    }
+
+    //Gpu memory used by the mesh (vertex and index buffers or its range of a pool, texture), in bytes. Buffers and textures shared with
+    //other meshes count for each of them.
+    size_t get_gpu_memory_bytes() const
+    {
+        size_t pool_bytes = pool_range ? pool_range->num_vertices*pool_range->vertex_size + pool_range->index_bytes : 0;
+        return (buffers ? buffers->bytes : 0) + pool_bytes + (texture ? texture->bytes : 0);
     }
 };
 
+//The mesh types used by the demos. v : positions, f : faces, n : normals, t : texture coords.
+using meshvf = mesh<mesh_layout<false, false>>;
+using meshvfn = mesh<mesh_layout<true, false>>;
+using meshvft = mesh<mesh_layout<false, true>>;
+using meshvfnt = mesh<mesh_layout<true, true>>;
+
 
 
 class skybox
 {
 private:
-    unsigned int vao, vbo, ebo, tex; //Vertex array object, vertex buffer object, element (index) buffer object and texture ID.
-
-public:
-    //Construct the mesh procedurally (i.e. no geometry data like vertices or uvs are read from a file), setup the mesh in the gpu memory, load the 6 images and tell how to wrap them.
-    //Note : Make sure that all 6 images have the same size in pixels (e.g. 2048x2048, 500x500, etc...) AND the same type of extensions (e.g. jpg, png, bmp, ...).
-    skybox(const char *right_img_path, const char *left_img_path, const char *top_img_path, const char *bottom_img_path, const char *front_img_path, const char *back_img_path)
-    {   
+    gl_vertex_array vao; //Vertex array object.
+    gl_buffer vbo, ebo; //Vertex buffer object, element (index) buffer object.
+    gl_texture tex;
+    std::shared_ptr<mesh_texture> shared_tex; //Cube map loaded elsewhere (e.g. streamed in by a texture_streamer), drawn instead of tex.
+    float face_decode_ms[6], decode_ms; //How long each face took to decode, and the whole concurrent decode (wall clock).
+
+    //Construct the mesh procedurally (i.e. no geometry data like vertices or uvs are read from a file) and setup the mesh in the gpu memory.
+    void setup_cube()
+    {
         //Cube vertices. This is basically the interleaved buffer itself.
         float verts[] = { -1.0f, -1.0f,  1.0f,
                            1.0f, -1.0f,  1.0f,
@@ -432,55 +901,84 @@ public:
                                 5, 4, 0 };
 
         //Setup skybox's data in the memory.
-        glGenVertexArrays(1, &vao);
-        glBindVertexArray(vao);
+        vao = gl_vertex_array::create();
+        glBindVertexArray(vao.get());
 
-        glGenBuffers(1, &vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        vbo = gl_buffer::create();
+        glBindBuffer(GL_ARRAY_BUFFER, vbo.get());
         glBufferData(GL_ARRAY_BUFFER, sizeof(verts), &verts, GL_STATIC_DRAW);
 
-        glGenBuffers(1, &ebo);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        ebo = gl_buffer::create();
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo.get());
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(inds), &inds, GL_STATIC_DRAW);
 
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(float), (void*)0);
         glEnableVertexAttribArray(0);
         glBindVertexArray(0);
+    }
+
+public:
+    //Setup the cube, load the 6 images and tell how to wrap them.
+    //Note : Make sure that all 6 images have the same size in pixels (e.g. 2048x2048, 500x500, etc...) AND the same type of extensions (e.g. jpg, png, bmp, ...).
+    //For skies that come as 1 image (a panorama or a cross of the 6 faces), see cube_map_convert.h.
+    //flags : only mesh_compress_texture matters, which makes the faces block compressed (and cached) like the meshes' textures.
+    skybox(const char *right_img_path, const char *left_img_path, const char *top_img_path, const char *bottom_img_path, const char *front_img_path, const char *back_img_path,
+           unsigned int flags = 0)
+    {
+        setup_cube();
 
         //Create the skybox's texture.
-        glGenTextures(1, &tex);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, tex);
+        tex = gl_texture::create();
+        glBindTexture(GL_TEXTURE_CUBE_MAP, tex.get());
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
         glPixelStorei(GL_UNPACK_ALIGNMENT, 1); //This is useful for textures with non-standard widths or single-channel textures (e.g. grayscale).
-        //glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+        glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS); //Filter across the edges between faces, so that they do not show as seams.
 
-        //Skybox's expected image names. Do not change their order!
-        std::string paths[6] = { right_img_path, left_img_path, top_img_path, bottom_img_path, front_img_path, back_img_path };
-        int img_widths[6], img_heights[6], img_channels[6];
+        //Skybox's expected image names. Do not change their order! The 6 faces are decoded at once on worker threads,
+        //then uploaded one after the other here, on the thread that owns the OpenGL context.
+        const char *paths[6] = { right_img_path, left_img_path, top_img_path, bottom_img_path, front_img_path, back_img_path };
+        image_batch faces;
+        for (int i = 0; i < 6; i++)
+            faces.add(paths[i], false, (flags & mesh_compress_texture) != 0);
+        faces.decode();
 
-        stbi_set_flip_vertically_on_load(false);
+        int img_widths[6], img_heights[6], img_channels[6];
         for (int i = 0; i < 6; i++)
         {
-            unsigned char *data = stbi_load(paths[i].c_str(), &img_widths[i], &img_heights[i], &img_channels[i], 0);
-            if (!data)
-                fprintf(stderr, "Error : Failed to load texture '%s'\n", paths[i].c_str());
+            const decoded_image &face = faces[i];
+            img_widths[i] = face.width;
+            img_heights[i] = face.height;
+            img_channels[i] = face.channels;
+            face_decode_ms[i] = face.decode_ms;
+            if (!face.loaded())
+            {
+                fprintf(stderr, "Error : Failed to load texture '%s'. Exiting...\n", paths[i]);
+                exit(EXIT_FAILURE);
+            }
+            if (face.compressed.data != nullptr)
+            {
+                upload_compressed_levels(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, face.compressed, 1); //The skybox is sampled without mipmaps.
+                continue;
+            }
 
             //Determine the correct format for glTexImage2D based on the number of channels (img_channels).
-            GLenum format;
+            GLenum format = GL_RGB;
             if (img_channels[i] == 1)
                 format = GL_RED; //Single-channel grayscale image.
+            else if (img_channels[i] == 2)
+                format = GL_RG; //Grayscale + alpha.
             else if (img_channels[i] == 3)
                 format = GL_RGB; //Classical 3-channel image (e.g. jpg).
             else if (img_channels[i] == 4)
                 format = GL_RGBA; //4-channel image, i.e. RGB + alpha channel for opacity (e.g. png).
 
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, format, img_widths[i], img_heights[i], 0, format, GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, format, img_widths[i], img_heights[i], 0, format, GL_UNSIGNED_BYTE, face.data);
         }
+        decode_ms = faces.get_decode_ms();
 
         //Check if all images have the same width, height, and channels. Otherwise the skybox may not render.
         bool img_consistency = true;
@@ -497,21 +995,34 @@ public:
 
     }
 
-    //Delete the skybox's resources.
-    ~skybox()
+    //Setup the cube, with a cube map texture that is loaded elsewhere, e.g. streamed in over several frames by a texture_streamer (see texture_streamer.h).
+    skybox(std::shared_ptr<mesh_texture> cube_map) : shared_tex(std::move(cube_map)), face_decode_ms(), decode_ms(0.0f)
     {
-        glDeleteVertexArrays(1, &vao);
-        glDeleteBuffers(1, &ebo);
-        glDeleteBuffers(1, &vbo);
-        glDeleteTextures(1, &tex);
+        setup_cube();
+    }
+
+    //The skybox's resources are deleted by their handles. Like the meshes, it can be moved but not copied.
+    skybox(skybox &&) noexcept = default;
+    skybox &operator=(skybox &&) noexcept = default;
+
+    //Decode time of face i (in the constructor's order : right, left, top, bottom, front, back), in milliseconds.
+    float get_face_decode_ms(int i) const
+    {
+        return face_decode_ms[i];
+    }
+
+    //Wall clock time of decoding all 6 faces, in milliseconds. The faces decode concurrently, so it is close to the slowest face.
+    float get_decode_ms() const
+    {
+        return decode_ms;
     }
 
     //Draw the skybox.
     void draw_triangles()
     {
         glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, tex);
-        glBindVertexArray(vao);
+		glBindTexture(GL_TEXTURE_CUBE_MAP, shared_tex ? shared_tex->tex.get() : tex.get());
+        glBindVertexArray(vao.get());
         glDepthFunc(GL_LEQUAL); //Ensures that the skybox fragments will render behind everything else. (A bit dangerous to place it here. Be cautious.)
 		glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
         glDepthFunc(GL_LESS); //Restore the default depth test function for rendering the rest of the scene.
@@ -525,7 +1036,8 @@ public:
 class quadtex
 {
 private:
-    unsigned int vao, vbo;
+    gl_vertex_array vao;
+    gl_buffer vbo;
 
 public:
     quadtex()
@@ -540,11 +1052,11 @@ public:
                                          1.0f, -1.0f, 0.0f,  1.0f, 0.0f,
                                          1.0f,  1.0f, 0.0f,  1.0f, 1.0f };
 
-        glGenVertexArrays(1, &vao);
-        glBindVertexArray(vao);
+        vao = gl_vertex_array::create();
+        glBindVertexArray(vao.get());
 
-        glGenBuffers(1, &vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        vbo = gl_buffer::create();
+        glBindBuffer(GL_ARRAY_BUFFER, vbo.get());
         glBufferData(GL_ARRAY_BUFFER, sizeof(interleaved_buffer), &interleaved_buffer, GL_STATIC_DRAW);
 
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5*sizeof(float), (void*)0); //Positions.
@@ -554,19 +1066,16 @@ public:
         glBindVertexArray(0);
     }
 
-    //Delete the quadtex mesh.
-    ~quadtex()
-    {
-        glDeleteVertexArrays(1, &vao);
-        glDeleteBuffers(1, &vbo);
-    }
+    //The quadtex mesh is deleted by its handles.
+    quadtex(quadtex &&) noexcept = default;
+    quadtex &operator=(quadtex &&) noexcept = default;
 
     //Draw the quadtex mesh (2 triangles).
     void draw_triangles(unsigned int fbo_tex)
     {
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, fbo_tex);
-        glBindVertexArray(vao);
+        glBindVertexArray(vao.get());
         glDrawArrays(GL_TRIANGLES, 0, 6);
         glBindVertexArray(0);
         glBindTexture(GL_TEXTURE_2D, 0);
@@ -0,0 +1,699 @@
+#ifndef MESH_BVH_H
+#define MESH_BVH_H
+
+#include<glm/glm.hpp>
+#include<algorithm>
+#include<cmath>
+#include<cstdio>
+#include<cstdlib>
+#include<vector>
+
+#include"obj_parser.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include<emmintrin.h>
+#define MESH_BVH_SSE2 //x86-64 always has SSE2, i.e. 4 floats per instruction.
+#endif
+
+//Bounding volume hierarchy over the triangles of a mesh, for cpu queries : picking the surface point under the cursor, line of sight
+//(is a point visible from another one, e.g. lit by the sun) and the closest surface point to a position (e.g. the altitude of a spacecraft).
+//A brute force loop tests every triangle (a 256k triangle asteroid per query), the bvh only the few whose boxes the query reaches.
+//The tree is built with the surface area heuristic (SAH) : at every node, the triangles are split where the expected cost of a ray
+//query, i.e. the child box areas times their triangle counts, is the lowest (binned, 16 candidate planes per axis). It is stored flat :
+//nodes in 1 array with the 2 children of a node next to each other, triangles in 1 array ordered by leaf, so a query walks contiguous memory.
+//Optionally the binary tree is collapsed into a 4-wide tree whose nodes keep the boxes of their 4 children as separate x, y, z arrays,
+//so a ray is tested against 4 boxes at once with SSE2. Ray queries then use the wide nodes, closest point queries always the binary ones.
+//The bvh is built in the mesh's local coordinates : transform rays and points with the inverse model matrix before querying.
+//
+//Usage :
+//    mesh_bvh bvh("../obj/vfn/asteroids/didymos/didymain2019.obj");
+//    bvh_ray_hit hit;
+//    if (bvh.intersect(ray_origin, ray_dir, hit))
+//        printf("Hit triangle %u at (%f, %f, %f).\n", hit.triangle, hit.point.x, hit.point.y, hit.point.z);
+//    bool in_shadow = bvh.occluded(hit.point + 1e-4f*sun_dir, sun_dir);
+
+
+
+//Closest intersection of a ray with the mesh.
+struct bvh_ray_hit
+{
+    float t; //Distance along the ray, in units of the ray's direction length.
+    float u, v; //Barycentric coordinates of the hit in its triangle (the weights of the triangle's 2nd and 3rd vertex).
+    unsigned int triangle; //Index of the triangle, in the order of the mesh's (or obj file's) faces.
+    glm::vec3 point;
+};
+
+//Closest point of the mesh's surface to a point.
+struct bvh_closest_point
+{
+    glm::vec3 point;
+    float distance;
+    unsigned int triangle;
+};
+
+//What was built.
+struct bvh_stats
+{
+    unsigned int num_triangles;
+    unsigned int num_nodes, num_leaves, max_depth;
+    unsigned int num_wide_nodes; //0 if the wide nodes were not built.
+    float sah_cost; //Expected cost of a ray query, in triangle tests (traversal steps count as 1 triangle test).
+};
+
+class mesh_bvh
+{
+private:
+    static const unsigned int num_bins = 16; //Candidate split planes per axis and node.
+    static const unsigned int max_leaf_size = 8; //Larger leaves are always split.
+    static const unsigned int max_depth = 64; //Deepest binary node (the root is at depth 1). The traversal stacks are sized for it.
+    static const unsigned int median_levels = 16; //The last levels above max_depth split at the median, see build().
+
+    //Node of the binary tree. Inner nodes have count 0 and their children at first and first + 1. Leaves hold the triangles [first, first + count).
+    struct node
+    {
+        glm::vec3 bmin;
+        unsigned int first;
+        glm::vec3 bmax;
+        unsigned int count;
+    };
+
+    //4-wide node : the boxes of up to 4 children. A child with count > 0 is a leaf (triangles [child, child + count)), with count 0 an
+    //inner wide node (index child), and child -1 an empty slot, whose box is inverted so that nothing ever hits it.
+    struct wide_node
+    {
+        float min_x[4], min_y[4], min_z[4];
+        float max_x[4], max_y[4], max_z[4];
+        int child[4];
+        unsigned int count[4];
+    };
+
+    //Triangle as needed by the ray test : 1 vertex and the 2 edges from it.
+    struct triangle
+    {
+        glm::vec3 v0, e1, e2;
+    };
+
+    std::vector<node> nodes;
+    std::vector<wide_node> wide_nodes;
+    std::vector<triangle> triangles; //In leaf order.
+    std::vector<unsigned int> triangle_ids; //Original index of every triangle of the triangles array.
+    bvh_stats stats;
+
+    static float half_area(const glm::vec3 &bmin, const glm::vec3 &bmax)
+    {
+        glm::vec3 d = bmax - bmin;
+        return d.x*d.y + d.y*d.z + d.z*d.x;
+    }
+
+    //Build the binary tree (binned SAH) over triangles given by their 3 vertices.
+    void build(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices)
+    {
+        const unsigned int n = (unsigned int)(indices.size()/3);
+        stats = bvh_stats();
+        stats.num_triangles = n;
+        nodes.clear();
+        if (n == 0)
+            return;
+
+        //Per triangle box and centroid, and the triangle order that the build permutes.
+        std::vector<glm::vec3> tri_min(n), tri_max(n), centroids(n);
+        triangle_ids.resize(n);
+        for (unsigned int i = 0; i < n; i++)
+        {
+            const glm::vec3 &a = positions[indices[3*i]], &b = positions[indices[3*i + 1]], &c = positions[indices[3*i + 2]];
+            tri_min[i] = glm::min(a, glm::min(b, c));
+            tri_max[i] = glm::max(a, glm::max(b, c));
+            centroids[i] = (a + b + c)/3.0f;
+            triangle_ids[i] = i;
+        }
+
+        nodes.reserve(2*n);
+        nodes.push_back(node());
+        nodes[0].first = 0;
+        nodes[0].count = n;
+        std::vector<std::pair<unsigned int, unsigned int>> todo(1, std::make_pair(0u, 1u)); //(node, depth) still to process.
+        while (!todo.empty())
+        {
+            unsigned int index = todo.back().first, depth = todo.back().second;
+            todo.pop_back();
+            stats.max_depth = std::max(stats.max_depth, depth);
+            unsigned int first = nodes[index].first, count = nodes[index].count;
+
+            //Bounds of the node's triangles and of their centroids.
+            glm::vec3 bmin(INFINITY), bmax(-INFINITY), cmin(INFINITY), cmax(-INFINITY);
+            for (unsigned int i = first; i < first + count; i++)
+            {
+                unsigned int t = triangle_ids[i];
+                bmin = glm::min(bmin, tri_min[t]);
+                bmax = glm::max(bmax, tri_max[t]);
+                cmin = glm::min(cmin, centroids[t]);
+                cmax = glm::max(cmax, centroids[t]);
+            }
+            nodes[index].bmin = bmin;
+            nodes[index].bmax = bmax;
+
+            //Binned SAH alone has no depth bound : skewed input (e.g. triangles spaced exponentially) peels 1 triangle off per level.
+            //So the last median_levels levels split at the median of the widest centroid axis, which halves the triangles at every
+            //level, and nodes at max_depth are leaves, however many triangles they hold.
+            if (depth == max_depth)
+            {
+                stats.num_leaves++;
+                continue;
+            }
+            bool median = (max_depth - depth <= median_levels && count > max_leaf_size);
+
+            //Best split among the bins of every axis.
+            float best_cost = INFINITY;
+            int best_axis = -1;
+            unsigned int best_split = 0;
+            if (count > 1 && !median)
+            {
+                for (int axis = 0; axis < 3; axis++)
+                {
+                    float extent = cmax[axis] - cmin[axis];
+                    if (extent <= 0.0f)
+                        continue;
+                    float scale = num_bins/extent;
+                    glm::vec3 bin_min[num_bins], bin_max[num_bins];
+                    unsigned int bin_count[num_bins] = {};
+                    for (unsigned int b = 0; b < num_bins; b++)
+                    {
+                        bin_min[b] = glm::vec3(INFINITY);
+                        bin_max[b] = glm::vec3(-INFINITY);
+                    }
+                    for (unsigned int i = first; i < first + count; i++)
+                    {
+                        unsigned int t = triangle_ids[i];
+                        unsigned int b = std::min((unsigned int)((centroids[t][axis] - cmin[axis])*scale), num_bins - 1);
+                        bin_min[b] = glm::min(bin_min[b], tri_min[t]);
+                        bin_max[b] = glm::max(bin_max[b], tri_max[t]);
+                        bin_count[b]++;
+                    }
+                    //Sweep from the right to get the cost of the right side of every split, then from the left.
+                    float right_cost[num_bins];
+                    glm::vec3 rmin(INFINITY), rmax(-INFINITY);
+                    unsigned int rcount = 0;
+                    for (unsigned int b = num_bins - 1; b > 0; b--)
+                    {
+                        rmin = glm::min(rmin, bin_min[b]);
+                        rmax = glm::max(rmax, bin_max[b]);
+                        rcount += bin_count[b];
+                        right_cost[b] = (rcount > 0) ? rcount*half_area(rmin, rmax) : 0.0f;
+                    }
+                    glm::vec3 lmin(INFINITY), lmax(-INFINITY);
+                    unsigned int lcount = 0;
+                    for (unsigned int b = 0; b < num_bins - 1; b++) //Split between bin b and b + 1.
+                    {
+                        lmin = glm::min(lmin, bin_min[b]);
+                        lmax = glm::max(lmax, bin_max[b]);
+                        lcount += bin_count[b];
+                        if (lcount == 0 || lcount == count)
+                            continue;
+                        float cost = lcount*half_area(lmin, lmax) + right_cost[b + 1];
+                        if (cost < best_cost)
+                        {
+                            best_cost = cost;
+                            best_axis = axis;
+                            best_split = b;
+                        }
+                    }
+                }
+            }
+
+            //Leaf if splitting is not cheaper than testing all the triangles (1 traversal step = 1 triangle test).
+            float leaf_cost = (float)count;
+            float split_cost = 1.0f + best_cost/std::max(half_area(bmin, bmax), 1e-30f);
+            if (!median && (best_axis < 0 || (split_cost >= leaf_cost && count <= max_leaf_size)))
+            {
+                if (best_axis < 0 && count > max_leaf_size)
+                    best_split = num_bins; //All centroids coincide : split in the middle of the list instead.
+                else
+                {
+                    stats.num_leaves++;
+                    continue;
+                }
+            }
+
+            unsigned int mid;
+            if (median)
+            {
+                glm::vec3 extent = cmax - cmin;
+                int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : ((extent.y >= extent.z) ? 1 : 2);
+                mid = first + count/2;
+                std::nth_element(&triangle_ids[first], &triangle_ids[mid], &triangle_ids[first] + count, [&](unsigned int a, unsigned int b)
+                {
+                    return centroids[a][axis] < centroids[b][axis];
+                });
+            }
+            else if (best_split == num_bins)
+                mid = first + count/2;
+            else
+            {
+                float scale = num_bins/(cmax[best_axis] - cmin[best_axis]);
+                unsigned int *middle = std::partition(&triangle_ids[first], &triangle_ids[first] + count, [&](unsigned int t)
+                {
+                    return std::min((unsigned int)((centroids[t][best_axis] - cmin[best_axis])*scale), num_bins - 1) <= best_split;
+                });
+                mid = (unsigned int)(middle - &triangle_ids[0]);
+            }
+
+            unsigned int left = (unsigned int)nodes.size();
+            nodes.push_back(node());
+            nodes.push_back(node());
+            nodes[left].first = first;
+            nodes[left].count = mid - first;
+            nodes[left + 1].first = mid;
+            nodes[left + 1].count = first + count - mid;
+            nodes[index].first = left;
+            nodes[index].count = 0;
+            todo.push_back(std::make_pair(left + 1, depth + 1));
+            todo.push_back(std::make_pair(left, depth + 1));
+        }
+        nodes.shrink_to_fit(); //2*n were reserved, about half is used.
+        stats.num_nodes = (unsigned int)nodes.size();
+
+        //Triangles in leaf order.
+        triangles.resize(n);
+        for (unsigned int i = 0; i < n; i++)
+        {
+            unsigned int t = triangle_ids[i];
+            const glm::vec3 &a = positions[indices[3*t]], &b = positions[indices[3*t + 1]], &c = positions[indices[3*t + 2]];
+            triangles[i].v0 = a;
+            triangles[i].e1 = b - a;
+            triangles[i].e2 = c - a;
+        }
+
+        //Expected ray query cost, for the stats.
+        float root_area = std::max(half_area(nodes[0].bmin, nodes[0].bmax), 1e-30f);
+        stats.sah_cost = 0.0f;
+        for (const node &nd : nodes)
+            stats.sah_cost += half_area(nd.bmin, nd.bmax)/root_area*((nd.count > 0) ? (float)nd.count : 1.0f);
+    }
+
+    //Collapse the binary subtree under a binary inner node into 1 wide node (recursively). Returns the wide node's index.
+    int collapse(unsigned int binary_index)
+    {
+        //Open the child with the largest area until there are 4 children (or only leaves left).
+        unsigned int children[4] = { nodes[binary_index].first, nodes[binary_index].first + 1, 0, 0 };
+        unsigned int num_children = 2;
+        while (num_children < 4)
+        {
+            int largest = -1;
+            float largest_area = -1.0f;
+            for (unsigned int i = 0; i < num_children; i++)
+            {
+                const node &c = nodes[children[i]];
+                float area = half_area(c.bmin, c.bmax);
+                if (c.count == 0 && area > largest_area)
+                {
+                    largest = (int)i;
+                    largest_area = area;
+                }
+            }
+            if (largest < 0)
+                break;
+            unsigned int opened = children[largest];
+            children[largest] = nodes[opened].first;
+            children[num_children++] = nodes[opened].first + 1;
+        }
+
+        int index = (int)wide_nodes.size();
+        wide_nodes.push_back(wide_node());
+        for (unsigned int i = 0; i < 4; i++)
+        {
+            wide_node &w = wide_nodes[index];
+            if (i >= num_children)
+            {
+                w.min_x[i] = w.min_y[i] = w.min_z[i] = INFINITY;
+                w.max_x[i] = w.max_y[i] = w.max_z[i] = -INFINITY;
+                w.child[i] = -1;
+                w.count[i] = 0;
+                continue;
+            }
+            const node &c = nodes[children[i]];
+            w.min_x[i] = c.bmin.x; w.min_y[i] = c.bmin.y; w.min_z[i] = c.bmin.z;
+            w.max_x[i] = c.bmax.x; w.max_y[i] = c.bmax.y; w.max_z[i] = c.bmax.z;
+            w.count[i] = c.count;
+            if (c.count > 0)
+                w.child[i] = (int)c.first;
+            else
+            {
+                int child = collapse(children[i]); //May reallocate wide_nodes, so w is not used across this call.
+                wide_nodes[index].child[i] = child;
+            }
+        }
+        return index;
+    }
+
+    void build_wide()
+    {
+        wide_nodes.clear();
+        if (nodes.empty())
+            return;
+        if (nodes[0].count > 0)
+        {
+            //A single leaf : 1 wide node with 1 child.
+            wide_nodes.push_back(wide_node());
+            wide_node &w = wide_nodes[0];
+            for (unsigned int i = 0; i < 4; i++)
+            {
+                w.min_x[i] = w.min_y[i] = w.min_z[i] = INFINITY;
+                w.max_x[i] = w.max_y[i] = w.max_z[i] = -INFINITY;
+                w.child[i] = -1;
+                w.count[i] = 0;
+            }
+            w.min_x[0] = nodes[0].bmin.x; w.min_y[0] = nodes[0].bmin.y; w.min_z[0] = nodes[0].bmin.z;
+            w.max_x[0] = nodes[0].bmax.x; w.max_y[0] = nodes[0].bmax.y; w.max_z[0] = nodes[0].bmax.z;
+            w.child[0] = 0;
+            w.count[0] = nodes[0].count;
+        }
+        else
+            collapse(0);
+        stats.num_wide_nodes = (unsigned int)wide_nodes.size();
+    }
+
+    //Möller–Trumbore. Updates the hit if the triangle is hit closer than hit.t.
+    static bool intersect_triangle(const triangle &tri, const glm::vec3 &origin, const glm::vec3 &dir, bvh_ray_hit &hit)
+    {
+        glm::vec3 p = glm::cross(dir, tri.e2);
+        float det = glm::dot(tri.e1, p);
+        if (std::fabs(det) < 1e-20f)
+            return false; //Parallel to the triangle (or degenerate triangle).
+        float inv_det = 1.0f/det;
+        glm::vec3 s = origin - tri.v0;
+        float u = glm::dot(s, p)*inv_det;
+        if (u < 0.0f || u > 1.0f)
+            return false;
+        glm::vec3 q = glm::cross(s, tri.e1);
+        float v = glm::dot(dir, q)*inv_det;
+        if (v < 0.0f || u + v > 1.0f)
+            return false;
+        float t = glm::dot(tri.e2, q)*inv_det;
+        if (t < 0.0f || t >= hit.t)
+            return false;
+        hit.t = t;
+        hit.u = u;
+        hit.v = v;
+        return true;
+    }
+
+    //Slab test of a ray against a box. Returns the entry distance, or INFINITY if the box is missed (or entered beyond t_max).
+    static float intersect_box(const glm::vec3 &bmin, const glm::vec3 &bmax, const glm::vec3 &origin, const glm::vec3 &inv_dir, float t_max)
+    {
+        glm::vec3 t0 = (bmin - origin)*inv_dir, t1 = (bmax - origin)*inv_dir;
+        glm::vec3 tnear = glm::min(t0, t1), tfar = glm::max(t0, t1);
+        float t_enter = std::max(std::max(tnear.x, tnear.y), std::max(tnear.z, 0.0f));
+        float t_exit = std::min(std::min(tfar.x, tfar.y), std::min(tfar.z, t_max));
+        return (t_enter <= t_exit) ? t_enter : INFINITY;
+    }
+
+    //Closest point of a triangle to p (Ericson, Real-Time Collision Detection, 5.1.5).
+    static glm::vec3 closest_point_on_triangle(const triangle &tri, const glm::vec3 &p)
+    {
+        const glm::vec3 &a = tri.v0, &ab = tri.e1, &ac = tri.e2;
+        glm::vec3 ap = p - a;
+        float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+        if (d1 <= 0.0f && d2 <= 0.0f)
+            return a;
+        glm::vec3 bp = ap - ab;
+        float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+        if (d3 >= 0.0f && d4 <= d3)
+            return a + ab;
+        float vc = d1*d4 - d3*d2;
+        if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+            return a + ab*(d1/(d1 - d3));
+        glm::vec3 cp = ap - ac;
+        float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+        if (d6 >= 0.0f && d5 <= d6)
+            return a + ac;
+        float vb = d5*d2 - d1*d6;
+        if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+            return a + ac*(d2/(d2 - d6));
+        float va = d3*d6 - d5*d4;
+        if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+            return a + ab + (ac - ab)*((d4 - d3)/((d4 - d3) + (d5 - d6)));
+        float denom = 1.0f/(va + vb + vc);
+        return a + ab*(vb*denom) + ac*(vc*denom);
+    }
+
+    //Squared distance from p to a box (0 inside).
+    static float box_distance_squared(const glm::vec3 &bmin, const glm::vec3 &bmax, const glm::vec3 &p)
+    {
+        glm::vec3 d = glm::max(glm::max(bmin - p, p - bmax), glm::vec3(0.0f));
+        return glm::dot(d, d);
+    }
+
+    //Ray traversal of the binary tree. any_hit stops at the first hit (for occlusion).
+    bool traverse_binary(const glm::vec3 &origin, const glm::vec3 &dir, bvh_ray_hit &hit, bool any_hit) const
+    {
+        glm::vec3 inv_dir = 1.0f/dir;
+        bool found = false;
+        unsigned int stack[max_depth]; //At most 1 pending sibling per level, plus the 2 children of the deepest inner node.
+        unsigned int stack_size = 0;
+        if (intersect_box(nodes[0].bmin, nodes[0].bmax, origin, inv_dir, hit.t) == INFINITY)
+            return false;
+        stack[stack_size++] = 0;
+        while (stack_size > 0)
+        {
+            const node &nd = nodes[stack[--stack_size]];
+            if (nd.count > 0)
+            {
+                for (unsigned int i = nd.first; i < nd.first + nd.count; i++)
+                {
+                    if (intersect_triangle(triangles[i], origin, dir, hit))
+                    {
+                        hit.triangle = i;
+                        found = true;
+                        if (any_hit)
+                            return true;
+                    }
+                }
+                continue;
+            }
+            //Visit the nearer child first, so that the farther one is often pruned by the shortened hit.t.
+            float t_left = intersect_box(nodes[nd.first].bmin, nodes[nd.first].bmax, origin, inv_dir, hit.t);
+            float t_right = intersect_box(nodes[nd.first + 1].bmin, nodes[nd.first + 1].bmax, origin, inv_dir, hit.t);
+            unsigned int near_child = nd.first, far_child = nd.first + 1;
+            if (t_right < t_left)
+            {
+                std::swap(t_left, t_right);
+                std::swap(near_child, far_child);
+            }
+            if (t_right != INFINITY)
+                stack[stack_size++] = far_child;
+            if (t_left != INFINITY)
+                stack[stack_size++] = near_child;
+        }
+        return found;
+    }
+
+    //Ray traversal of the wide tree : the 4 children boxes of a node are tested together.
+    bool traverse_wide(const glm::vec3 &origin, const glm::vec3 &dir, bvh_ray_hit &hit, bool any_hit) const
+    {
+        glm::vec3 inv_dir = 1.0f/dir;
+        bool found = false;
+        //Nodes and leaves : a leaf is pushed as -(first triangle + 1), with its count in leaf_counts. A wide node's children are at least 1
+        //binary level deeper than it, so there are fewer than max_depth wide levels, with at most 3 pending children each, plus 4.
+        int stack[3*max_depth + 1];
+        unsigned int leaf_counts[3*max_depth + 1];
+        unsigned int stack_size = 0;
+        stack[stack_size++] = 0;
+        leaf_counts[0] = 0;
+#ifdef MESH_BVH_SSE2
+        const __m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+        const __m128 ix = _mm_set1_ps(inv_dir.x), iy = _mm_set1_ps(inv_dir.y), iz = _mm_set1_ps(inv_dir.z);
+#endif
+        while (stack_size > 0)
+        {
+            stack_size--;
+            int entry = stack[stack_size];
+            if (entry < 0)
+            {
+                unsigned int first = (unsigned int)(-entry - 1), count = leaf_counts[stack_size];
+                for (unsigned int i = first; i < first + count; i++)
+                {
+                    if (intersect_triangle(triangles[i], origin, dir, hit))
+                    {
+                        hit.triangle = i;
+                        found = true;
+                        if (any_hit)
+                            return true;
+                    }
+                }
+                continue;
+            }
+
+            const wide_node &w = wide_nodes[entry];
+            float t_enter[4];
+#ifdef MESH_BVH_SSE2
+            __m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(w.min_x), ox), ix), t1x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(w.max_x), ox), ix);
+            __m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(w.min_y), oy), iy), t1y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(w.max_y), oy), iy);
+            __m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(w.min_z), oz), iz), t1z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(w.max_z), oz), iz);
+            __m128 tnear = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)), _mm_max_ps(_mm_min_ps(t0z, t1z), _mm_setzero_ps()));
+            __m128 tfar = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)), _mm_min_ps(_mm_max_ps(t0z, t1z), _mm_set1_ps(hit.t)));
+            __m128 missed = _mm_cmpgt_ps(tnear, tfar); //Also true for the inverted boxes of empty slots.
+            _mm_storeu_ps(t_enter, _mm_or_ps(_mm_and_ps(missed, _mm_set1_ps(INFINITY)), _mm_andnot_ps(missed, tnear)));
+#else
+            for (unsigned int i = 0; i < 4; i++)
+                t_enter[i] = intersect_box(glm::vec3(w.min_x[i], w.min_y[i], w.min_z[i]), glm::vec3(w.max_x[i], w.max_y[i], w.max_z[i]), origin, inv_dir, hit.t);
+#endif
+            //Push the children that are hit, farthest first, so the nearest is visited next.
+            unsigned int order[4] = {0, 1, 2, 3};
+            for (unsigned int i = 1; i < 4; i++)
+                for (unsigned int j = i; j > 0 && t_enter[order[j]] > t_enter[order[j - 1]]; j--)
+                    std::swap(order[j], order[j - 1]);
+            for (unsigned int k = 0; k < 4; k++)
+            {
+                unsigned int i = order[k];
+                if (t_enter[i] == INFINITY || w.child[i] < 0)
+                    continue;
+                stack[stack_size] = (w.count[i] > 0) ? -(w.child[i] + 1) : w.child[i];
+                leaf_counts[stack_size] = w.count[i];
+                stack_size++;
+            }
+        }
+        return found;
+    }
+
+    bool query_ray(const glm::vec3 &origin, const glm::vec3 &dir, bvh_ray_hit &hit, float t_max, bool any_hit) const
+    {
+        hit.t = t_max;
+        hit.u = hit.v = 0.0f;
+        hit.triangle = 0;
+        if (nodes.empty())
+            return false;
+        bool found = wide_nodes.empty() ? traverse_binary(origin, dir, hit, any_hit) : traverse_wide(origin, dir, hit, any_hit);
+        if (found)
+        {
+            hit.point = origin + hit.t*dir;
+            hit.triangle = triangle_ids[hit.triangle];
+        }
+        return found;
+    }
+
+public:
+    //Bvh of a triangle list : 3 indices into positions per triangle. wide_nodes also builds the 4-wide nodes for the ray queries.
+    mesh_bvh(const std::vector<glm::vec3> &positions, const std::vector<unsigned int> &indices, bool wide_nodes = true)
+    {
+        build(positions, indices);
+        if (wide_nodes)
+            build_wide();
+    }
+
+    //Bvh of the faces of an obj file. Only the positions are parsed, so the triangle indices are those of the file's faces (after
+    //triangulation). Works for meshes that were loaded from their cache file, which keep no cpu copy of their triangles.
+    explicit mesh_bvh(const char *obj_path, bool wide_nodes = true)
+    {
+        obj_data data;
+        size_t num_defaulted;
+        if (!obj_load<false, false>(obj_path, data))
+        {
+            fprintf(stderr, "Error : File '%s' was not found. Exiting...\n", obj_path);
+            exit(EXIT_FAILURE);
+        }
+        if (!obj_check_indices<false, false>(data, num_defaulted))
+        {
+            fprintf(stderr, "Error : File '%s' has faces that reference vertices that do not exist. Exiting...\n", obj_path);
+            exit(EXIT_FAILURE);
+        }
+        std::vector<unsigned int> indices(data.corners.size());
+        for (size_t i = 0; i < indices.size(); i++)
+            indices[i] = data.corners[i].v;
+        build(data.verts, indices);
+        if (wide_nodes)
+            build_wide();
+    }
+
+    //Closest hit of the ray origin + t*dir, 0 <= t < t_max. dir need not be normalized (t is in units of its length).
+    bool intersect(const glm::vec3 &origin, const glm::vec3 &dir, bvh_ray_hit &hit, float t_max = INFINITY) const
+    {
+        return query_ray(origin, dir, hit, t_max, false);
+    }
+
+    //Whether the ray hits anything before t_max (line of sight). Faster than intersect(), because it stops at the first hit.
+    //Start the ray slightly off the surface (e.g. hit.point + 1e-4f*dir), otherwise it may hit the triangle it starts from.
+    bool occluded(const glm::vec3 &origin, const glm::vec3 &dir, float t_max = INFINITY) const
+    {
+        bvh_ray_hit hit;
+        return query_ray(origin, dir, hit, t_max, true);
+    }
+
+    //Closest surface point to p, if it is nearer than max_distance.
+    bool closest_point(const glm::vec3 &p, bvh_closest_point &result, float max_distance = INFINITY) const
+    {
+        if (nodes.empty())
+            return false;
+        float best = max_distance*max_distance; //Squared.
+        bool found = false;
+        unsigned int stack[max_depth]; //Like in traverse_binary().
+        unsigned int stack_size = 0;
+        stack[stack_size++] = 0;
+        while (stack_size > 0)
+        {
+            const node &nd = nodes[stack[--stack_size]];
+            if (box_distance_squared(nd.bmin, nd.bmax, p) >= best)
+                continue;
+            if (nd.count > 0)
+            {
+                for (unsigned int i = nd.first; i < nd.first + nd.count; i++)
+                {
+                    glm::vec3 q = closest_point_on_triangle(triangles[i], p);
+                    float d = glm::dot(q - p, q - p);
+                    if (d < best)
+                    {
+                        best = d;
+                        result.point = q;
+                        result.triangle = triangle_ids[i];
+                        found = true;
+                    }
+                }
+                continue;
+            }
+            //Nearer child on top of the stack.
+            float d_left = box_distance_squared(nodes[nd.first].bmin, nodes[nd.first].bmax, p);
+            float d_right = box_distance_squared(nodes[nd.first + 1].bmin, nodes[nd.first + 1].bmax, p);
+            if (d_left <= d_right)
+            {
+                stack[stack_size++] = nd.first + 1;
+                stack[stack_size++] = nd.first;
+            }
+            else
+            {
+                stack[stack_size++] = nd.first;
+                stack[stack_size++] = nd.first + 1;
+            }
+        }
+        if (found)
+            result.distance = std::sqrt(best);
+        return found;
+    }
+
+    const bvh_stats &get_stats() const
+    {
+        return stats;
+    }
+
+    //Heap memory of the bvh, in bytes.
+    size_t get_memory_bytes() const
+    {
+        return nodes.capacity()*sizeof(node) + wide_nodes.capacity()*sizeof(wide_node) + triangles.capacity()*sizeof(triangle) + triangle_ids.capacity()*sizeof(unsigned int);
+    }
+};
+
+//Ray through a window pixel (e.g. the cursor, from glfwGetCursorPos()), in world coordinates. Window coordinates start at the top left.
+//Works for perspective (also infinite) and orthographic projections.
+inline void screen_ray(double x, double y, int width, int height, const glm::mat4 &projection, const glm::mat4 &view, glm::vec3 &origin, glm::vec3 &dir)
+{
+    //Unproject in eye coordinates first : the near plane is very close to the eye, and going through inverse(projection*view) at once
+    //would lose the direction to rounding for a camera far from the origin.
+    glm::mat4 inv_projection = glm::inverse(projection), inv_view = glm::inverse(view);
+    float ndc_x = 2.0f*(float)x/width - 1.0f, ndc_y = 1.0f - 2.0f*(float)y/height;
+    glm::vec4 near_point = inv_projection*glm::vec4(ndc_x, ndc_y, -1.0f, 1.0f);
+    glm::vec4 mid_point = inv_projection*glm::vec4(ndc_x, ndc_y, 0.0f, 1.0f); //Not the far plane, which is at infinity for glm::infinitePerspective().
+    glm::vec3 eye_origin = glm::vec3(near_point)/near_point.w;
+    glm::vec3 eye_dir = glm::vec3(mid_point)/mid_point.w - eye_origin;
+    origin = glm::vec3(inv_view*glm::vec4(eye_origin, 1.0f));
+    dir = glm::normalize(glm::vec3(inv_view*glm::vec4(eye_dir, 0.0f)));
+}
+
+#endif
@@ -0,0 +1,271 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include<cstdio>
+#include<cstdint>
+#include<cstring>
+#include<cmath>
+#include<string>
+#include<algorithm>
+#include<atomic>
+#include<chrono>
+#include<functional>
+#include<thread>
+
+#include"mapped_file.h"
+
+//Binary mesh cache. The first time an obj file is loaded, the final (deduplicated, interleaved) vertex buffer and the index buffer
+//are written next to it as '<obj_path>.<layout>.<options>.meshcache' : loads of the same obj with another vertex layout or other options
+//(e.g. 1 demo plain, another with mesh_lod) keep their own cache instead of overwriting each other's. Later loads map the cache file and
+//hand its bytes straight to glBufferData(), so no parsing happens at all. The cache stores a hash of the obj file it was built from, so
+//editing the obj invalidates it.
+//
+//File layout : mesh_cache_header | num_vertices*vertex_size bytes | num_indices*index_size bytes | num_meshlets mesh_meshlet. The buffers
+//are stored exactly as the gpu gets them (e.g. quantized vertices, 16-bit indices). The indices of all the levels of detail follow each
+//other (see mesh_simplify.h), and so do their meshlets (see mesh_meshlet.h).
+
+
+
+//Vertex layouts of the mesh classes. A cache built by one mesh class is never used by another.
+//The values are (has normals ? 1 : 0) + (has uvs ? 2 : 0), see mesh_layout in mesh.h.
+enum mesh_cache_layout : uint32_t
+{
+    mesh_cache_layout_vf = 0, //{x,y,z}
+    mesh_cache_layout_vfn = 1, //{x,y,z, nx,ny,nz}
+    mesh_cache_layout_vft = 2, //{x,y,z, u,v}
+    mesh_cache_layout_vfnt = 3 //{x,y,z, nx,ny,nz, u,v}
+};
+
+//Bounds of the mesh's vertices with respect to its local coordinate system.
+struct mesh_bounds
+{
+    float aabb_min[3], aabb_max[3]; //Axis aligned bounding box.
+    float nearest, farthest; //Nearest and farthest vertex distance from the origin.
+    float sphere_center[3], sphere_radius; //Bounding sphere, centered at the center of the aabb (tighter than the farthest distance for off center meshes).
+};
+
+//Levels of detail of a mesh : level 0 is the mesh itself, the next ones are simplified versions of it (see mesh_simplify.h).
+//They share the vertex buffer, and each one is a range of the index buffer.
+const unsigned int mesh_max_lods = 5;
+
+struct mesh_lod_level
+{
+    uint32_t first_index, num_indices; //Range of the index buffer.
+    float error; //Geometric error of the simplification, in the mesh's local units (0 for level 0).
+    uint32_t first_meshlet, num_meshlets; //Its meshlets, if the mesh has any.
+};
+
+struct mesh_lod_chain
+{
+    uint32_t num_lods;
+    mesh_lod_level lods[mesh_max_lods];
+};
+
+//The chain of a mesh that has no simplified levels.
+inline mesh_lod_chain mesh_single_lod(uint32_t num_indices)
+{
+    mesh_lod_chain chain = {};
+    chain.num_lods = 1;
+    chain.lods[0].num_indices = num_indices;
+    return chain;
+}
+
+//A meshlet (see mesh_meshlet.h) : a range of the index buffer with a bounding sphere and a cone that holds all its triangles' normals.
+struct mesh_meshlet
+{
+    float center[3], radius;
+    float cone_axis[3], cone_cutoff; //Unit axis, and the sine of the widest angle between it and a normal (1 : too wide to ever cull).
+    uint32_t first_index, num_indices;
+};
+
+const char mesh_cache_magic[4] = { 'M', 'S', 'H', 'C' };
+const uint32_t mesh_cache_version = 7; //Bump this whenever the file layout or the meaning of the buffers (or the parsed values) changes.
+
+struct mesh_cache_header
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t layout;
+    uint32_t vertex_size; //Bytes per vertex. Always a multiple of 4, so the indices that follow the vertices stay aligned.
+    uint32_t index_size; //Bytes per index, 2 or 4.
+    uint32_t num_vertices;
+    uint32_t num_indices;
+    uint32_t num_meshlets;
+    uint32_t options; //Load options that changed the buffers (e.g. mesh_optimize). A cache is only used by loads with the same options.
+    mesh_bounds bounds;
+    mesh_lod_chain lods;
+    uint64_t source_size; //Size and hash of the obj file this cache was built from.
+    uint64_t source_hash;
+};
+
+
+
+//64-bit FNV-1a variant that consumes 8 bytes per step. This is not a cryptographic hash, it only has to notice that the obj file changed.
+inline uint64_t mesh_cache_hash(const char *data, size_t size)
+{
+    const uint64_t prime = 0x100000001b3ull;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data + i, 8); //memcpy, because data + i is not necessarily 8-byte aligned.
+        hash = (hash ^ word)*prime;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; ++i)
+        hash = (hash ^ (unsigned char)data[i])*prime;
+    return hash;
+}
+
+inline std::string mesh_cache_path(const char *obj_path, uint32_t layout, uint32_t options)
+{
+    return std::string(obj_path) + "." + std::to_string(layout) + "." + std::to_string(options) + ".meshcache";
+}
+
+//A temporary file name next to a cache file, unique to the writer (process, thread and call), so that concurrent loads of the same file
+//(e.g. mesh_loader jobs, or 2 demos) never write into each other's temporary file before the rename.
+inline std::string cache_temp_path(const std::string &cache_path)
+{
+    static std::atomic<unsigned int> counter(0);
+    unsigned long long process = (unsigned long long)std::chrono::system_clock::now().time_since_epoch().count(); //Differs between processes.
+    unsigned long long thread = (unsigned long long)std::hash<std::thread::id>()(std::this_thread::get_id());
+    char suffix[80];
+    snprintf(suffix, sizeof(suffix), ".tmp%llx-%llx-%x", process, thread, counter++);
+    return cache_path + suffix;
+}
+
+//Compute the bounds of num_verts vertices, whose positions are the first 3 floats of every 'stride' floats.
+inline mesh_bounds mesh_compute_bounds(const float *verts, size_t num_verts, size_t stride)
+{
+    mesh_bounds bounds = { {0.0f,0.0f,0.0f}, {0.0f,0.0f,0.0f}, 0.0f, 0.0f, {0.0f,0.0f,0.0f}, 0.0f };
+    for (size_t i = 0; i < num_verts; ++i)
+    {
+        const float *v = verts + i*stride;
+        float dist = std::sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+        for (int k = 0; k < 3; ++k)
+        {
+            if (i == 0 || v[k] < bounds.aabb_min[k]) bounds.aabb_min[k] = v[k];
+            if (i == 0 || v[k] > bounds.aabb_max[k]) bounds.aabb_max[k] = v[k];
+        }
+        if (i == 0 || dist < bounds.nearest) bounds.nearest = dist;
+        if (i == 0 || dist > bounds.farthest) bounds.farthest = dist;
+    }
+
+    //2nd pass for the bounding sphere, now that its center is known.
+    float radius_squared = 0.0f;
+    for (int k = 0; k < 3; ++k)
+        bounds.sphere_center[k] = 0.5f*(bounds.aabb_min[k] + bounds.aabb_max[k]);
+    for (size_t i = 0; i < num_verts; ++i)
+    {
+        const float *v = verts + i*stride;
+        float dx = v[0] - bounds.sphere_center[0], dy = v[1] - bounds.sphere_center[1], dz = v[2] - bounds.sphere_center[2];
+        radius_squared = std::max(radius_squared, dx*dx + dy*dy + dz*dz);
+    }
+    bounds.sphere_radius = std::sqrt(radius_squared);
+    return bounds;
+}
+
+//The buffers that follow a validated header.
+inline const char *mesh_cache_vertices(const mesh_cache_header *header)
+{
+    return (const char *)(header + 1);
+}
+
+inline const char *mesh_cache_indices(const mesh_cache_header *header)
+{
+    return mesh_cache_vertices(header) + (size_t)header->num_vertices*header->vertex_size;
+}
+
+//Not necessarily aligned (16-bit indices may end at an odd multiple of 2 bytes), copy them out with memcpy().
+inline const char *mesh_cache_meshlets(const mesh_cache_header *header)
+{
+    return mesh_cache_indices(header) + (size_t)header->num_indices*header->index_size;
+}
+
+//Return the header of a mapped cache file if it is valid for the given layout and obj file, otherwise nullptr (missing, stale, corrupt or truncated cache).
+inline const mesh_cache_header *mesh_cache_validate(const mapped_file &cache, uint32_t layout, uint32_t vertex_size, uint32_t options, uint64_t source_size, uint64_t source_hash)
+{
+    if (!cache.is_open() || cache.size() < sizeof(mesh_cache_header))
+        return nullptr;
+
+    const mesh_cache_header *header = (const mesh_cache_header *)cache.data(); //Mapped memory is page aligned.
+    if (memcmp(header->magic, mesh_cache_magic, 4) != 0 || header->version != mesh_cache_version ||
+        header->layout != layout || header->vertex_size != vertex_size || header->options != options ||
+        (header->index_size != 2 && header->index_size != 4) ||
+        header->source_size != source_size || header->source_hash != source_hash)
+        return nullptr;
+    if (header->lods.num_lods < 1 || header->lods.num_lods > mesh_max_lods)
+        return nullptr;
+    for (uint32_t i = 0; i < header->lods.num_lods; ++i)
+        if ((uint64_t)header->lods.lods[i].first_index + header->lods.lods[i].num_indices > header->num_indices ||
+            (uint64_t)header->lods.lods[i].first_meshlet + header->lods.lods[i].num_meshlets > header->num_meshlets)
+            return nullptr;
+
+    size_t expected_size = sizeof(mesh_cache_header) + (size_t)header->num_vertices*vertex_size + (size_t)header->num_indices*header->index_size +
+                           (size_t)header->num_meshlets*sizeof(mesh_meshlet);
+    if (cache.size() != expected_size)
+        return nullptr;
+
+    //The meshlets are read by the cpu, so their ranges are checked too.
+    for (uint32_t i = 0; i < header->num_meshlets; ++i)
+    {
+        mesh_meshlet meshlet;
+        memcpy(&meshlet, mesh_cache_meshlets(header) + i*sizeof(mesh_meshlet), sizeof(mesh_meshlet));
+        if ((uint64_t)meshlet.first_index + meshlet.num_indices > header->num_indices)
+            return nullptr;
+    }
+
+    return header;
+}
+
+//Write the cache file. It is written to a temporary file first and then renamed, so a crash never leaves a half written cache behind.
+//Failing to write the cache (e.g. read-only directory) is not an error, the mesh is simply parsed again next time.
+inline void mesh_cache_write(const char *obj_path, uint32_t layout, uint32_t options, uint64_t source_size, uint64_t source_hash, const mesh_bounds &bounds,
+                             const mesh_lod_chain &lods, const void *verts, uint32_t vertex_size, size_t num_vertices, const void *inds, uint32_t index_size, size_t num_indices,
+                             const mesh_meshlet *meshlets, size_t num_meshlets)
+{
+    mesh_cache_header header;
+    memset(&header, 0, sizeof(header)); //The padding before source_size is written too, so it must not be garbage.
+    memcpy(header.magic, mesh_cache_magic, 4);
+    header.version = mesh_cache_version;
+    header.layout = layout;
+    header.vertex_size = vertex_size;
+    header.index_size = index_size;
+    header.num_vertices = (uint32_t)num_vertices;
+    header.num_indices = (uint32_t)num_indices;
+    header.num_meshlets = (uint32_t)num_meshlets;
+    header.options = options;
+    header.bounds = bounds;
+    header.lods = lods;
+    header.source_size = source_size;
+    header.source_hash = source_hash;
+
+    std::string path = mesh_cache_path(obj_path, layout, options);
+    std::string temp_path = cache_temp_path(path);
+    FILE *fp = fopen(temp_path.c_str(), "wb");
+    if (fp == NULL)
+        return;
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    if (num_vertices > 0)
+        ok = ok && fwrite(verts, vertex_size, num_vertices, fp) == num_vertices;
+    if (num_indices > 0)
+        ok = ok && fwrite(inds, index_size, num_indices, fp) == num_indices;
+    if (num_meshlets > 0)
+        ok = ok && fwrite(meshlets, sizeof(mesh_meshlet), num_meshlets, fp) == num_meshlets;
+    ok = (fclose(fp) == 0) && ok;
+
+    if (ok)
+    {
+        remove(path.c_str()); //rename() does not overwrite existing files on Windows.
+        ok = rename(temp_path.c_str(), path.c_str()) == 0;
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "Warning : Could not write mesh cache '%s'.\n", path.c_str());
+        remove(temp_path.c_str());
+    }
+}
+
+#endif
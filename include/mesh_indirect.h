@@ -0,0 +1,186 @@
+#ifndef MESH_INDIRECT_H
+#define MESH_INDIRECT_H
+
+#include<GL/glew.h>
+#include<glm/glm.hpp>
+#include<algorithm>
+#include<vector>
+
+#include"mesh_pool.h"
+#include"gl_handle.h"
+
+//Multi-draw indirect submission of the meshes of a mesh_pool. Drawing N meshes the usual way costs N model matrix uniforms and N draw
+//calls per pass, and the driver validates the state for each of them. An indirect draw list records 1 DrawElementsIndirectCommand per
+//object instead, and keeps the per object data (model matrix, color) in a shader storage buffer. The whole pass is then issued with
+//glMultiDrawElementsIndirect, and the *_indirect.vert shaders fetch their object with gl_DrawIDARB (ARB_shader_draw_parameters,
+//core in OpenGL 4.6). The commands are uploaded once per frame and can be drawn by several passes (e.g. shadow map and main pass).
+//A multi-draw has 1 index type for all its draws, so a pool with both 16 and 32-bit index buffers takes 2 multi-draws (1 per type).
+//Textures cannot change between the draws of a multi-draw, so layouts with uvs are not supported.
+//
+//Usage :
+//    indirect_draw_list<meshvfn> draws(pool);
+//    while (...)
+//    {
+//        draws.clear();
+//        draws.add(ryugu, model_ryugu, color_ryugu);
+//        draws.add(bennu, model_bennu, color_bennu);
+//        draws.upload();
+//        shad_indirect.use();
+//        draws.draw();
+//    }
+
+
+
+//Layout of the commands read by glMultiDrawElementsIndirect, fixed by OpenGL.
+struct draw_elements_indirect_command
+{
+    GLuint count; //Number of indices.
+    GLuint instance_count;
+    GLuint first_index; //In indices, not bytes.
+    GLint base_vertex;
+    GLuint base_instance;
+};
+
+//Per object data, as read by the *_indirect.vert shaders (std430 layout).
+struct indirect_object_data
+{
+    glm::mat4 model;
+    glm::vec4 col;
+};
+
+template<typename mesh_type>
+class indirect_draw_list
+{
+private:
+    static_assert(!mesh_type::layout_type::has_uvs, "Indirect draws cannot switch textures between the meshes.");
+
+    //Draws are grouped by index type : 0 for 16-bit indices, 1 for 32-bit.
+    struct draw_group
+    {
+        std::vector<draw_elements_indirect_command> commands;
+        std::vector<indirect_object_data> objects;
+        size_t command_offset, object_offset; //Bytes, in the gpu buffers.
+    };
+
+    mesh_pool<mesh_type> &pool;
+    draw_group groups[2];
+    gl_buffer command_buffer, object_buffer;
+    size_t object_alignment; //GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT. The objects of each group start at such an offset.
+
+public:
+    //The pool must outlive the list.
+    indirect_draw_list(mesh_pool<mesh_type> &draw_pool) : pool(draw_pool)
+    {
+        command_buffer = gl_buffer::create();
+        object_buffer = gl_buffer::create();
+        GLint alignment = 1;
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        object_alignment = (size_t)std::max(alignment, 1);
+        groups[0].command_offset = groups[0].object_offset = 0;
+        groups[1].command_offset = groups[1].object_offset = 0;
+    }
+
+    indirect_draw_list(const indirect_draw_list &) = delete;
+    indirect_draw_list &operator=(const indirect_draw_list &) = delete;
+
+    //Forget the draws of the previous frame.
+    void clear()
+    {
+        for (draw_group &group : groups)
+        {
+            group.commands.clear();
+            group.objects.clear();
+        }
+    }
+
+    //Record the draw of a mesh of the pool, at a level of detail (see mesh::select_lod()).
+    void add(const mesh_type &m, const glm::mat4 &model, const glm::vec4 &col = glm::vec4(1.0f), unsigned int lod = 0)
+    {
+        draw_elements_indirect_command command;
+        GLenum index_type;
+        pool.get_draw_range(m, command.first_index, command.count, command.base_vertex, index_type, lod);
+        command.instance_count = 1;
+        command.base_instance = 0;
+
+        draw_group &group = groups[(index_type == GL_UNSIGNED_SHORT) ? 0 : 1];
+        group.commands.push_back(command);
+        group.objects.push_back({model, col});
+    }
+
+    //Record the visible meshlets of a mesh of the pool (see mesh::cull_meshlets()) : 1 command per run, all with the same object data.
+    void add_meshlets(const mesh_type &m, const meshlet_draw_list &visible, const glm::mat4 &model, const glm::vec4 &col = glm::vec4(1.0f))
+    {
+        unsigned int first_index, num_inds;
+        int base_vertex;
+        GLenum index_type;
+        pool.get_draw_range(m, first_index, num_inds, base_vertex, index_type); //Checks that m lives in the pool.
+        const size_t index_size = (index_type == GL_UNSIGNED_SHORT) ? 2 : 4;
+
+        draw_group &group = groups[(index_type == GL_UNSIGNED_SHORT) ? 0 : 1];
+        for (size_t i = 0; i < visible.counts.size(); ++i)
+        {
+            draw_elements_indirect_command command;
+            command.count = (GLuint)visible.counts[i];
+            command.instance_count = 1;
+            command.first_index = (GLuint)((size_t)visible.offsets[i]/index_size);
+            command.base_vertex = visible.base_vertices[i];
+            command.base_instance = 0;
+            group.commands.push_back(command);
+            group.objects.push_back({model, col});
+        }
+    }
+
+    //Send the recorded draws to the gpu. The buffers are reallocated (orphaned) every time, so the driver never waits for
+    //the previous frame's draws to finish reading them.
+    void upload()
+    {
+        size_t command_bytes = 0, object_bytes = 0;
+        for (draw_group &group : groups)
+        {
+            group.command_offset = command_bytes;
+            group.object_offset = object_bytes;
+            command_bytes += group.commands.size()*sizeof(draw_elements_indirect_command);
+            object_bytes += (group.objects.size()*sizeof(indirect_object_data) + object_alignment - 1)/object_alignment*object_alignment;
+        }
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer.get());
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, command_bytes, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, object_buffer.get());
+        glBufferData(GL_SHADER_STORAGE_BUFFER, object_bytes, nullptr, GL_STREAM_DRAW);
+        for (draw_group &group : groups)
+        {
+            if (group.commands.empty())
+                continue;
+            glBufferSubData(GL_DRAW_INDIRECT_BUFFER, group.command_offset, group.commands.size()*sizeof(draw_elements_indirect_command), group.commands.data());
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, group.object_offset, group.objects.size()*sizeof(indirect_object_data), group.objects.data());
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    //Draw all the uploaded draws with the current shader : 1 multi-draw per index type.
+    void draw()
+    {
+        pool.bind();
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer.get());
+        for (int i = 0; i < 2; i++)
+        {
+            draw_group &group = groups[i];
+            if (group.commands.empty())
+                continue;
+            glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, object_buffer.get(), group.object_offset, group.objects.size()*sizeof(indirect_object_data));
+            glMultiDrawElementsIndirect(GL_TRIANGLES, (i == 0) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, (void*)group.command_offset, (GLsizei)group.commands.size(), 0);
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+        pool.unbind();
+    }
+
+    //Number of recorded draws.
+    unsigned int get_num_draws() const
+    {
+        return (unsigned int)(groups[0].commands.size() + groups[1].commands.size());
+    }
+};
+
+#endif
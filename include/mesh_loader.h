@@ -0,0 +1,209 @@
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
+#include<chrono>
+#include<condition_variable>
+#include<deque>
+#include<functional>
+#include<limits>
+#include<memory>
+#include<mutex>
+#include<string>
+
+#include"mesh.h"
+#include"mesh_pool.h"
+#include"thread_pool.h"
+
+//Background mesh loading. The mesh constructors do everything on the calling thread : map or parse the file, combine the attributes,
+//decode the texture, upload. For big assets that blocks startup for seconds, and it would stall frames if assets were loaded at runtime.
+//The loader splits every load in 2 :
+//1) The cpu side (mesh::prepare(), mesh::prepare_texture()) runs on a thread pool. It touches no OpenGL state.
+//2) The finished meshes wait in an upload queue until the main thread calls upload_pending() (once per frame), which sends them to the gpu
+//   within a time budget, so that a burst of finished loads is spread over several frames instead of causing a hitch.
+//load() returns a handle at once. Until the mesh is uploaded, the demo draws a placeholder instead (see mesh_handle::get_or()).
+//Destroying the loader abandons the loads that are not uploaded yet (their handles never become ready).
+//
+//Usage :
+//    mesh_loader loader;
+//    mesh_handle<meshvfn> ryugu = loader.load<meshvfn>("../obj/vfn/asteroids/ryugu196k.obj");
+//    while (...)
+//    {
+//        loader.upload_pending(2.0f);
+//        ryugu.get_or(sphere).draw_triangles();
+//    }
+
+
+
+//State of 1 background load, shared by its handle, the worker that prepares it and the upload queue.
+template<typename mesh_type>
+struct mesh_load_state
+{
+    std::unique_ptr<mesh_type> m;
+    std::unique_ptr<mesh_staging> staging; //Freed (and the cache file unmapped) right after the upload.
+    std::string obj_path, img_path;
+    unsigned int flags;
+    mesh_pool<mesh_type> *pool; //Where the mesh is uploaded, or null for buffers of its own.
+    bool ready; //Set on the main thread once the mesh is uploaded, and only read there.
+};
+
+//Handle to a mesh that is loading in the background. Cheap to copy, all copies refer to the same mesh.
+template<typename mesh_type>
+class mesh_handle
+{
+private:
+    std::shared_ptr<mesh_load_state<mesh_type>> state;
+
+public:
+    mesh_handle() {}
+    mesh_handle(std::shared_ptr<mesh_load_state<mesh_type>> load_state) : state(std::move(load_state)) {}
+
+    //True once the mesh is on the gpu and can be drawn.
+    bool is_ready() const
+    {
+        return state && state->ready;
+    }
+
+    //The mesh if it is ready, otherwise the placeholder.
+    mesh_type &get_or(mesh_type &placeholder) const
+    {
+        return is_ready() ? *state->m : placeholder;
+    }
+
+    //The mesh itself. It must be ready.
+    mesh_type &get() const
+    {
+        if (!is_ready())
+        {
+            fprintf(stderr, "Error : Mesh '%s' was used before it finished loading. Exiting...\n", state ? state->obj_path.c_str() : "");
+            exit(EXIT_FAILURE);
+        }
+        return *state->m;
+    }
+};
+
+
+
+class mesh_loader
+{
+private:
+    std::mutex uploads_mutex; //Guards uploads.
+    std::condition_variable upload_available;
+    std::deque<std::function<void()>> uploads; //Gpu sides of the loads whose cpu side is done, in the order they finished.
+    unsigned int num_pending; //Loads that are not uploaded yet. Main thread only.
+    thread_pool pool; //Declared last, so that it is destroyed (and its workers joined) first : the jobs push into the upload queue.
+
+    template<typename mesh_type>
+    mesh_handle<mesh_type> start(const char *obj_path, const char *img_path, unsigned int flags, mesh_pool<mesh_type> *destination)
+    {
+        std::shared_ptr<mesh_load_state<mesh_type>> state(new mesh_load_state<mesh_type>());
+        state->m.reset(new mesh_type());
+        state->staging.reset(new mesh_staging());
+        state->obj_path = obj_path;
+        state->img_path = (img_path != nullptr) ? img_path : "";
+        state->flags = flags;
+        state->pool = destination;
+        state->ready = false;
+        ++num_pending;
+
+        pool.submit([this, state]()
+        {
+            state->m->prepare(state->obj_path.c_str(), state->flags, *state->staging);
+            if (!state->img_path.empty())
+                state->m->prepare_texture(state->img_path.c_str(), state->flags, *state->staging);
+
+            {
+                std::lock_guard<std::mutex> lock(uploads_mutex);
+                uploads.push_back([state]()
+                {
+                    if (state->pool != nullptr)
+                        state->m->upload(*state->staging, state->flags, *state->pool);
+                    else
+                        state->m->upload(*state->staging, state->flags);
+                    state->staging.reset();
+                    state->ready = true;
+                });
+            }
+            upload_available.notify_one();
+        });
+        return mesh_handle<mesh_type>(state);
+    }
+
+public:
+    //num_threads is the number of worker threads (0 = one per hardware thread, minus the main thread).
+    mesh_loader(unsigned int num_threads = 0) : num_pending(0), pool(num_threads) {}
+
+    mesh_loader(const mesh_loader &) = delete;
+    mesh_loader &operator=(const mesh_loader &) = delete;
+
+    //Start loading a mesh in the background (layouts without uvs). flags is a combination of mesh_load_flags, like for the mesh constructors.
+    template<typename mesh_type>
+    mesh_handle<mesh_type> load(const char *obj_path, unsigned int flags = 0)
+    {
+        static_assert(!mesh_type::layout_type::has_uvs, "Meshes with uvs need an image path.");
+        return start<mesh_type>(obj_path, nullptr, flags, nullptr);
+    }
+
+    //Start loading a mesh in the background into a pool (layouts without uvs). The pool must outlive the loader and the mesh.
+    template<typename mesh_type>
+    mesh_handle<mesh_type> load(const char *obj_path, mesh_pool<mesh_type> &destination, unsigned int flags = 0)
+    {
+        static_assert(!mesh_type::layout_type::has_uvs, "Meshes with uvs need an image path.");
+        return start<mesh_type>(obj_path, nullptr, flags, &destination);
+    }
+
+    //Start loading a mesh and its image in the background (layouts with uvs).
+    template<typename mesh_type>
+    mesh_handle<mesh_type> load(const char *obj_path, const char *img_path, unsigned int flags = 0)
+    {
+        static_assert(mesh_type::layout_type::has_uvs, "Only meshes with uvs have an image.");
+        return start<mesh_type>(obj_path, img_path, flags, nullptr);
+    }
+
+    //Upload the meshes that finished their cpu side, until budget_ms milliseconds have passed. Call it once per frame on the main thread.
+    //A mesh is never split, so at least 1 mesh is uploaded per call even if it alone takes longer than the budget. Returns the number of uploaded meshes.
+    unsigned int upload_pending(float budget_ms = 2.0f)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        unsigned int num_uploaded = 0;
+        while (true)
+        {
+            std::function<void()> upload;
+            {
+                std::lock_guard<std::mutex> lock(uploads_mutex);
+                if (uploads.empty())
+                    break;
+                upload = std::move(uploads.front());
+                uploads.pop_front();
+            }
+            upload();
+            ++num_uploaded;
+            --num_pending;
+
+            std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            if (elapsed.count() >= budget_ms)
+                break;
+        }
+        return num_uploaded;
+    }
+
+    //Block until every load so far is uploaded, e.g. before the first frame if there is nothing to show without the meshes.
+    void finish()
+    {
+        while (num_pending > 0)
+        {
+            {
+                std::unique_lock<std::mutex> lock(uploads_mutex);
+                upload_available.wait(lock, [this] { return !uploads.empty(); });
+            }
+            upload_pending(std::numeric_limits<float>::infinity());
+        }
+    }
+
+    //Number of loads that are not uploaded yet.
+    unsigned int get_num_pending() const
+    {
+        return num_pending;
+    }
+};
+
+#endif
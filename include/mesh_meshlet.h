@@ -0,0 +1,283 @@
+#ifndef MESH_MESHLET_H
+#define MESH_MESHLET_H
+
+#include<GL/glew.h>
+#include<glm/glm.hpp>
+#include<cstdint>
+#include<cmath>
+#include<vector>
+#include<algorithm>
+
+#include"mesh_cache.h"
+#include"mesh_simplify.h"
+#include"frustum.h"
+
+//Meshlets : small pieces of a mesh (at most 64 vertices and 124 triangles), each with a bounding sphere and a normal cone, culled on the
+//cpu every frame. Culling whole objects does nothing for a high resolution asteroid that fills the screen : it is always visible, yet
+//about half of its triangles face away from the camera and, up close, many of them are off screen. The gpu only rejects those after
+//their vertices have been shaded. A meshlet is skipped before the draw if
+//1) its sphere is outside the view frustum (see frustum.h), or
+//2) the camera is behind all of its triangles : the normals all lie in a cone around an axis, so from far enough behind the cone every
+//   triangle of the meshlet is a back face. Back faces are invisible on closed meshes (or with face culling), so nothing changes on screen.
+//Meshlets grow over neighbouring triangles, and each one is built next to the previous one, so they are contiguous in the index buffer
+//and the visible ones merge into a few long runs. A frame draws the compacted list of runs with 1 glMultiDrawElementsBaseVertex call
+//(or 1 indirect command per run, see indirect_draw_list::add_meshlets()).
+//The limits are the usual ones of mesh shaders. Flat shaded meshes, whose triangles share no vertices, reach the vertex limit with 21 triangles.
+//Culling is done in the mesh's local coordinates, so it costs the same for a rotating mesh. The model matrix may rotate, translate and
+//scale uniformly (a non-uniform scale bends the normal cones).
+//
+//Usage :
+//    meshvfn asteroid("../obj/vfn/asteroids/kleopatra4k.obj", mesh_meshlets);
+//    meshlet_draw_list visible;
+//    while (...)
+//    {
+//        asteroid.cull_meshlets(projection*view, model, cam_pos, visible);
+//        asteroid.draw_triangles(visible);
+//    }
+
+
+
+const unsigned int meshlet_max_vertices = 64;
+const unsigned int meshlet_max_triangles = 124;
+
+//Result of a culling pass.
+struct meshlet_cull_stats
+{
+    unsigned int visible, frustum_culled, cone_culled;
+    unsigned int triangles; //Triangles of the visible meshlets.
+};
+
+//The visible meshlets of a mesh, as runs of its index buffer (see mesh::cull_meshlets()). The arrays are the arguments of
+//glMultiDrawElementsBaseVertex, and keep their memory from frame to frame.
+struct meshlet_draw_list
+{
+    std::vector<GLsizei> counts; //Indices per run.
+    std::vector<const void *> offsets; //Byte offset of every run in the index buffer.
+    std::vector<GLint> base_vertices;
+    GLenum index_type;
+    meshlet_cull_stats stats;
+
+    meshlet_draw_list() : index_type(GL_UNSIGNED_INT), stats() {}
+};
+
+
+
+//Split the triangles of a range of the index buffer into meshlets, appended to meshlets. The triangles are reordered inside the range so
+//that every meshlet is contiguous, each keeping the relative order of its triangles (i.e. their vertex cache order).
+//Vertices are 'stride' floats, position first.
+inline void mesh_build_meshlets(std::vector<unsigned int> &inds, uint32_t first_index, uint32_t num_indices, const float *vertex_data,
+                                size_t num_verts, unsigned int stride, std::vector<mesh_meshlet> &meshlets)
+{
+    const size_t num_tris = num_indices/3;
+    if (num_tris == 0)
+        return;
+    const unsigned int *tri_inds = inds.data() + first_index;
+    auto position = [&](unsigned int v) { const float *p = vertex_data + (size_t)v*stride; return glm::vec3(p[0], p[1], p[2]); };
+
+    //Triangles are neighbours if they share a position (not just a vertex, so that the faces of flat shaded meshes are connected too).
+    std::vector<unsigned int> pos_of, sorted, pos_start;
+    const size_t num_pos = mesh_weld_positions(vertex_data, num_verts, stride, pos_of, sorted, pos_start);
+    std::vector<unsigned int> tri_start(num_pos + 1, 0), tri_list(3*num_tris); //The triangles around every position.
+    for (size_t i = 0; i < 3*num_tris; ++i)
+        tri_start[pos_of[tri_inds[i]] + 1]++;
+    for (size_t p = 0; p < num_pos; ++p)
+        tri_start[p + 1] += tri_start[p];
+    std::vector<unsigned int> fill(tri_start.begin(), tri_start.end() - 1);
+    for (size_t i = 0; i < 3*num_tris; ++i)
+        tri_list[fill[pos_of[tri_inds[i]]]++] = (unsigned int)(i/3);
+
+    std::vector<glm::vec3> centroids(num_tris), normals(num_tris);
+    double total_area = 0.0;
+    for (size_t t = 0; t < num_tris; ++t)
+    {
+        glm::vec3 a = position(tri_inds[3*t]), b = position(tri_inds[3*t + 1]), c = position(tri_inds[3*t + 2]);
+        glm::vec3 n = glm::cross(b - a, c - a);
+        float length = glm::length(n);
+        centroids[t] = (a + b + c)/3.0f;
+        normals[t] = (length > 0.0f) ? n/length : glm::vec3(0.0f); //Degenerate triangles have no say in the cone.
+        total_area += 0.5*length;
+    }
+    const float triangle_size = std::sqrt((float)(total_area/num_tris)); //Typical edge length, so that the scores have no units.
+
+    const unsigned int none = 0xffffffffu;
+    std::vector<char> used(num_tris, 0);
+    std::vector<unsigned int> vertex_mark(num_verts, none), candidate_mark(num_tris, none); //Meshlet that has the vertex / lists the triangle.
+    std::vector<unsigned int> order, members, candidates;
+    order.reserve(num_tris);
+    size_t scan = 0;
+    unsigned int seed = none;
+    for (unsigned int id = 0; order.size() < num_tris; ++id)
+    {
+        //Start next to the previous meshlet if possible, otherwise at the first free triangle.
+        if (seed == none)
+        {
+            while (used[scan])
+                ++scan;
+            seed = (unsigned int)scan;
+        }
+
+        members.clear();
+        candidates.clear();
+        unsigned int num_meshlet_verts = 0;
+        glm::vec3 centroid_sum(0.0f), normal_sum(0.0f);
+        float radius = 0.0f; //Of the members' centroids around their mean.
+        auto add = [&](unsigned int t)
+        {
+            used[t] = 1;
+            members.push_back(t);
+            for (int k = 0; k < 3; ++k)
+            {
+                unsigned int v = tri_inds[3*t + k];
+                if (vertex_mark[v] != id)
+                {
+                    vertex_mark[v] = id;
+                    ++num_meshlet_verts;
+                }
+                unsigned int p = pos_of[v];
+                for (unsigned int i = tri_start[p]; i < tri_start[p + 1]; ++i)
+                    if (!used[tri_list[i]] && candidate_mark[tri_list[i]] != id)
+                    {
+                        candidate_mark[tri_list[i]] = id;
+                        candidates.push_back(tri_list[i]);
+                    }
+            }
+            centroid_sum += centroids[t];
+            normal_sum += normals[t];
+            radius = std::max(radius, glm::distance(centroids[t], centroid_sum/(float)members.size()));
+        };
+        add(seed);
+
+        //Grow by the neighbour that adds few vertices, stays close to the meshlet and above all bends its cone the least (narrow cones cull more).
+        while (members.size() < meshlet_max_triangles)
+        {
+            glm::vec3 center = centroid_sum/(float)members.size();
+            float axis_length = glm::length(normal_sum);
+            glm::vec3 axis = (axis_length > 0.0f) ? normal_sum/axis_length : glm::vec3(0.0f);
+            unsigned int best = none;
+            float best_score = 0.0f;
+            size_t kept = 0;
+            for (unsigned int t : candidates)
+            {
+                if (used[t])
+                    continue;
+                candidates[kept++] = t;
+                unsigned int new_verts = 0;
+                for (int k = 0; k < 3; ++k)
+                    new_verts += (vertex_mark[tri_inds[3*t + k]] != id);
+                if (num_meshlet_verts + new_verts > meshlet_max_vertices)
+                    continue;
+                float score = (float)new_verts + glm::distance(centroids[t], center)/(radius + triangle_size) + 4.0f*(1.0f - glm::dot(normals[t], axis));
+                if (best == none || score < best_score)
+                {
+                    best = t;
+                    best_score = score;
+                }
+            }
+            candidates.resize(kept);
+            if (best == none)
+                break;
+            add(best);
+        }
+
+        seed = none;
+        for (unsigned int t : candidates)
+            if (!used[t])
+            {
+                seed = t;
+                break;
+            }
+
+        //The meshlet's triangles in their previous order, and its bounds.
+        std::sort(members.begin(), members.end());
+        mesh_meshlet meshlet;
+        meshlet.first_index = first_index + (uint32_t)(3*order.size());
+        meshlet.num_indices = (uint32_t)(3*members.size());
+        order.insert(order.end(), members.begin(), members.end());
+
+        glm::vec3 aabb_min = position(tri_inds[3*members[0]]), aabb_max = aabb_min;
+        for (unsigned int t : members)
+            for (int k = 0; k < 3; ++k)
+            {
+                aabb_min = glm::min(aabb_min, position(tri_inds[3*t + k]));
+                aabb_max = glm::max(aabb_max, position(tri_inds[3*t + k]));
+            }
+        glm::vec3 center = 0.5f*(aabb_min + aabb_max);
+        float radius_squared = 0.0f;
+        for (unsigned int t : members)
+            for (int k = 0; k < 3; ++k)
+            {
+                glm::vec3 d = position(tri_inds[3*t + k]) - center;
+                radius_squared = std::max(radius_squared, glm::dot(d, d));
+            }
+
+        //The cone : the mean normal, and the widest angle from it. Past ~85 degrees the meshlet could never be culled.
+        float axis_length = glm::length(normal_sum);
+        glm::vec3 axis = (axis_length > 0.0f) ? normal_sum/axis_length : glm::vec3(0.0f,0.0f,1.0f);
+        float min_dot = 1.0f;
+        for (unsigned int t : members)
+            if (normals[t] != glm::vec3(0.0f))
+                min_dot = std::min(min_dot, glm::dot(normals[t], axis));
+        for (int k = 0; k < 3; ++k)
+        {
+            meshlet.center[k] = center[k];
+            meshlet.cone_axis[k] = axis[k];
+        }
+        meshlet.radius = std::sqrt(radius_squared);
+        meshlet.cone_cutoff = (axis_length > 0.0f && min_dot > 0.1f) ? std::sqrt(1.0f - min_dot*min_dot) : 1.0f;
+        meshlets.push_back(meshlet);
+    }
+
+    std::vector<unsigned int> reordered(3*num_tris);
+    for (size_t i = 0; i < num_tris; ++i)
+        for (int k = 0; k < 3; ++k)
+            reordered[3*i + k] = tri_inds[3*order[i] + k];
+    std::copy(reordered.begin(), reordered.end(), inds.begin() + first_index);
+}
+
+//Whether the camera (local coordinates) is behind every triangle of a meshlet. For a point p of the meshlet and a normal n of the cone,
+//the triangle is a back face if dot(p - camera, n) > 0. That holds for all of them when the direction from the camera to the sphere
+//is within 90 degrees minus the cone's half angle of the axis, with the sphere's radius as margin.
+inline bool mesh_meshlet_back_facing(const mesh_meshlet &meshlet, const glm::vec3 &camera_pos)
+{
+    glm::vec3 d = glm::vec3(meshlet.center[0], meshlet.center[1], meshlet.center[2]) - camera_pos;
+    glm::vec3 axis(meshlet.cone_axis[0], meshlet.cone_axis[1], meshlet.cone_axis[2]);
+    return glm::dot(d, axis) > meshlet.cone_cutoff*glm::length(d) + meshlet.radius*(1.0f + meshlet.cone_cutoff);
+}
+
+//Cull num_meshlets meshlets against a frustum and a camera position, both in the meshlets' coordinates, and append the runs of
+//visible ones to visible (index_size bytes per index, index_offset bytes before the mesh's indices, e.g. in a pool).
+inline void mesh_cull_meshlets(const mesh_meshlet *meshlets, size_t num_meshlets, const frustum &local_frustum, const glm::vec3 &local_camera_pos,
+                               bool cone_culling, size_t index_offset, unsigned int index_size, GLint base_vertex, meshlet_draw_list &visible)
+{
+    bool extend = false; //Whether the previous meshlet was visible, so that this one continues its run.
+    for (size_t i = 0; i < num_meshlets; ++i)
+    {
+        const mesh_meshlet &meshlet = meshlets[i];
+        bool culled = true;
+        if (!local_frustum.sphere_visible(glm::vec3(meshlet.center[0], meshlet.center[1], meshlet.center[2]), meshlet.radius))
+            visible.stats.frustum_culled++;
+        else if (cone_culling && mesh_meshlet_back_facing(meshlet, local_camera_pos))
+            visible.stats.cone_culled++;
+        else
+            culled = false;
+        if (culled)
+        {
+            extend = false;
+            continue;
+        }
+
+        visible.stats.visible++;
+        visible.stats.triangles += meshlet.num_indices/3;
+        if (extend && (size_t)visible.offsets.back() + (size_t)visible.counts.back()*index_size == index_offset + (size_t)meshlet.first_index*index_size)
+            visible.counts.back() += (GLsizei)meshlet.num_indices;
+        else
+        {
+            visible.counts.push_back((GLsizei)meshlet.num_indices);
+            visible.offsets.push_back((const void *)(index_offset + (size_t)meshlet.first_index*index_size));
+            visible.base_vertices.push_back(base_vertex);
+        }
+        extend = true;
+    }
+}
+
+#endif
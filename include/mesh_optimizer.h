@@ -0,0 +1,247 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include<cstdint>
+#include<cstring>
+#include<vector>
+#include<algorithm>
+#include<glm/glm.hpp>
+
+//Load time reordering of indexed triangle meshes, so that the gpu does less work for the same image :
+//1) Triangles are reordered for the post-transform vertex cache (Tipsify, Sander, Nehab & Barczak 2007). Vertices that are still in the
+//   cache are not shaded again, so fewer vertex shader invocations per triangle.
+//2) The clusters that Tipsify produces are sorted so that the triangles facing outwards come first (overdraw, same paper).
+//   Those are the likely occluders, so the depth test rejects more of the fragments that follow.
+//3) Vertices are renumbered in the order the triangles first use them, so that vertex fetching walks the vertex buffer front to back.
+//The quality is measured with a simulated FIFO cache : ACMR (cache misses per triangle, 0.5 is the ideal for large regular meshes)
+//and ATVR (cache misses per vertex, 1.0 is the ideal).
+
+
+
+//Cache size assumed by the reordering. Real gpus behave roughly like a FIFO of 16-32 entries.
+const unsigned int mesh_optimizer_cache_size = 16;
+
+//Number of vertex shader invocations needed to draw the index buffer through a FIFO cache of the given size.
+inline size_t mesh_vertex_cache_misses(const unsigned int *inds, size_t num_inds, size_t num_verts, unsigned int cache_size)
+{
+    std::vector<size_t> timestamp(num_verts, 0); //Time the vertex entered the cache. 0 means never.
+    size_t misses = 0, time = cache_size + 1;
+    for (size_t i = 0; i < num_inds; ++i)
+    {
+        unsigned int v = inds[i];
+        if (time - timestamp[v] > cache_size)
+        {
+            timestamp[v] = time++;
+            ++misses;
+        }
+    }
+    return misses;
+}
+
+//Average cache miss ratio : cache misses per triangle.
+inline float mesh_acmr(const unsigned int *inds, size_t num_inds, size_t num_verts, unsigned int cache_size = mesh_optimizer_cache_size)
+{
+    return (num_inds == 0) ? 0.0f : (float)mesh_vertex_cache_misses(inds, num_inds, num_verts, cache_size)/(float)(num_inds/3);
+}
+
+//Average transform to vertex ratio : cache misses per vertex.
+inline float mesh_atvr(const unsigned int *inds, size_t num_inds, size_t num_verts, unsigned int cache_size = mesh_optimizer_cache_size)
+{
+    return (num_verts == 0) ? 0.0f : (float)mesh_vertex_cache_misses(inds, num_inds, num_verts, cache_size)/(float)num_verts;
+}
+
+
+
+//Tipsify. Returns the triangles in their new order, and the positions in that order where a cluster starts. A cluster ends whenever the
+//algorithm runs into a dead end and has to continue with a vertex that is not in the cache, so reordering whole clusters hardly changes the ACMR.
+inline void mesh_tipsify(const unsigned int *inds, size_t num_inds, size_t num_verts, unsigned int cache_size,
+                         std::vector<unsigned int> &triangle_order, std::vector<size_t> &cluster_starts)
+{
+    const size_t num_tris = num_inds/3;
+
+    //Vertex -> triangles adjacency, as one flat array (offsets + triangle ids).
+    std::vector<unsigned int> live(num_verts, 0); //Number of triangles of every vertex that are not emitted yet.
+    for (size_t i = 0; i < num_inds; ++i)
+        ++live[inds[i]];
+    std::vector<size_t> offsets(num_verts + 1, 0);
+    for (size_t v = 0; v < num_verts; ++v)
+        offsets[v+1] = offsets[v] + live[v];
+    std::vector<unsigned int> adjacency(num_inds);
+    std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < num_inds; ++i)
+        adjacency[fill[inds[i]]++] = (unsigned int)(i/3);
+
+    std::vector<size_t> timestamp(num_verts, 0);
+    std::vector<char> emitted(num_tris, 0);
+    std::vector<unsigned int> dead_end; //Recently used vertices, to continue from when the current fan is exhausted.
+    std::vector<unsigned int> candidates;
+    triangle_order.clear();
+    triangle_order.reserve(num_tris);
+    cluster_starts.clear();
+
+    size_t time = cache_size + 1, cursor = 0;
+    long long fanning = (num_verts > 0) ? 0 : -1;
+    bool new_cluster = true;
+    while (fanning >= 0)
+    {
+        //Emit all remaining triangles of the fanning vertex.
+        candidates.clear();
+        for (size_t k = offsets[fanning]; k < offsets[fanning + 1]; ++k)
+        {
+            unsigned int t = adjacency[k];
+            if (emitted[t])
+                continue;
+            if (new_cluster)
+            {
+                cluster_starts.push_back(triangle_order.size());
+                new_cluster = false;
+            }
+            emitted[t] = 1;
+            triangle_order.push_back(t);
+            for (int c = 0; c < 3; ++c)
+            {
+                unsigned int v = inds[3*t + c];
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (time - timestamp[v] > cache_size)
+                    timestamp[v] = time++;
+            }
+        }
+
+        //Next fanning vertex : the candidate that will still be in the cache after its remaining triangles are emitted, and has been in it the longest.
+        fanning = -1;
+        long long best_priority = -1;
+        for (unsigned int v : candidates)
+        {
+            if (live[v] == 0)
+                continue;
+            long long priority = 0;
+            if (time - timestamp[v] + 2*live[v] <= cache_size)
+                priority = (long long)(time - timestamp[v]);
+            if (priority > best_priority)
+            {
+                best_priority = priority;
+                fanning = v;
+            }
+        }
+        if (fanning >= 0)
+            continue;
+
+        //Dead end. Continue with the most recently used vertex that has triangles left, or else the next one in input order.
+        new_cluster = true;
+        while (!dead_end.empty() && fanning < 0)
+        {
+            unsigned int v = dead_end.back();
+            dead_end.pop_back();
+            if (live[v] > 0)
+                fanning = v;
+        }
+        while (fanning < 0 && cursor < num_verts)
+        {
+            if (live[cursor] > 0)
+                fanning = (long long)cursor;
+            ++cursor;
+        }
+    }
+}
+
+//Sort the clusters so that the ones facing away from the mesh's center (the likely occluders) are drawn first.
+//Positions are the first 3 floats of every 'stride' floats of vertex_data.
+inline void mesh_sort_clusters(const unsigned int *inds, const float *vertex_data, unsigned int stride,
+                               std::vector<unsigned int> &triangle_order, const std::vector<size_t> &cluster_starts)
+{
+    const size_t num_clusters = cluster_starts.size();
+    if (num_clusters < 2)
+        return;
+
+    auto position = [&](unsigned int v) { const float *p = vertex_data + (size_t)v*stride; return glm::vec3(p[0], p[1], p[2]); };
+
+    //Area weighted centroid and normal of every cluster, and the centroid of the whole mesh.
+    std::vector<glm::vec3> centroids(num_clusters, glm::vec3(0.0f)), normals(num_clusters, glm::vec3(0.0f));
+    std::vector<float> areas(num_clusters, 0.0f);
+    glm::vec3 mesh_centroid(0.0f);
+    float mesh_area = 0.0f;
+    for (size_t c = 0; c < num_clusters; ++c)
+    {
+        size_t end = (c + 1 < num_clusters) ? cluster_starts[c+1] : triangle_order.size();
+        for (size_t i = cluster_starts[c]; i < end; ++i)
+        {
+            const unsigned int *tri = inds + 3*(size_t)triangle_order[i];
+            glm::vec3 a = position(tri[0]), b = position(tri[1]), d = position(tri[2]);
+            glm::vec3 n = glm::cross(b - a, d - a); //Length is twice the area.
+            float area = glm::length(n);
+            centroids[c] += (a + b + d)*(area/3.0f);
+            normals[c] += n;
+            areas[c] += area;
+        }
+        mesh_centroid += centroids[c];
+        mesh_area += areas[c];
+    }
+    if (mesh_area > 0.0f)
+        mesh_centroid /= mesh_area;
+
+    std::vector<float> metric(num_clusters, 0.0f);
+    for (size_t c = 0; c < num_clusters; ++c)
+    {
+        if (areas[c] <= 0.0f)
+            continue;
+        float normal_length = glm::length(normals[c]);
+        if (normal_length > 0.0f)
+            metric[c] = glm::dot(centroids[c]/areas[c] - mesh_centroid, normals[c]/normal_length);
+    }
+
+    std::vector<unsigned int> clusters(num_clusters);
+    for (size_t c = 0; c < num_clusters; ++c)
+        clusters[c] = (unsigned int)c;
+    std::stable_sort(clusters.begin(), clusters.end(), [&](unsigned int a, unsigned int b) { return metric[a] > metric[b]; });
+
+    std::vector<unsigned int> sorted;
+    sorted.reserve(triangle_order.size());
+    for (unsigned int c : clusters)
+    {
+        size_t end = (c + 1 < num_clusters) ? cluster_starts[c+1] : triangle_order.size();
+        sorted.insert(sorted.end(), triangle_order.begin() + cluster_starts[c], triangle_order.begin() + end);
+    }
+    triangle_order.swap(sorted);
+}
+
+//Run the whole pipeline on an index buffer and its vertex buffer (num_verts vertices of 'stride' floats, position first).
+//Both buffers are rewritten in place. The mesh stays the same set of triangles with the same winding.
+inline void mesh_optimize_buffers(std::vector<unsigned int> &inds, float *vertex_data, size_t num_verts, unsigned int stride)
+{
+    if (inds.size() < 3 || num_verts == 0)
+        return;
+
+    //1) + 2) Triangle order.
+    std::vector<unsigned int> triangle_order;
+    std::vector<size_t> cluster_starts;
+    mesh_tipsify(inds.data(), inds.size(), num_verts, mesh_optimizer_cache_size, triangle_order, cluster_starts);
+    mesh_sort_clusters(inds.data(), vertex_data, stride, triangle_order, cluster_starts);
+
+    std::vector<unsigned int> reordered(inds.size());
+    for (size_t i = 0; i < triangle_order.size(); ++i)
+        memcpy(&reordered[3*i], &inds[3*(size_t)triangle_order[i]], 3*sizeof(unsigned int));
+
+    //3) Vertex order. Vertices that no triangle uses go to the end, in their old order.
+    const unsigned int unused = 0xFFFFFFFFu;
+    std::vector<unsigned int> remap(num_verts, unused);
+    unsigned int next = 0;
+    for (unsigned int &v : reordered)
+    {
+        if (remap[v] == unused)
+            remap[v] = next++;
+        v = remap[v];
+    }
+    for (size_t v = 0; v < num_verts; ++v)
+        if (remap[v] == unused)
+            remap[v] = next++;
+
+    std::vector<float> old_vertex_data(vertex_data, vertex_data + num_verts*stride);
+    for (size_t v = 0; v < num_verts; ++v)
+        memcpy(vertex_data + (size_t)remap[v]*stride, &old_vertex_data[v*stride], stride*sizeof(float));
+
+    inds.swap(reordered);
+}
+
+#endif
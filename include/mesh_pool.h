@@ -0,0 +1,418 @@
+#ifndef MESH_POOL_H
+#define MESH_POOL_H
+
+#include<algorithm>
+#include<cstdio>
+#include<map>
+#include<memory>
+#include<vector>
+
+#include"mesh.h"
+#include"gl_handle.h"
+
+//Shared vertex and index buffers for many meshes of the same layout. A mesh normally owns its vao, vbo and ebo, so a draw loop over N
+//meshes binds N different vaos (twice per frame in demos with a shadow pass). A pool suballocates the vertex and index ranges of all
+//its meshes out of 1 vbo and 1 ebo, described by 1 vao. Its meshes are drawn with a base vertex (glDrawElementsBaseVertex), so their
+//indices stay relative to their own vertices, and 16-bit index buffers keep working inside a pool of any size.
+//Freed ranges go back to a free list and are merged with their free neighbours. When a new mesh does not fit, the pool first tries to
+//defragment (pack the live ranges to the front of new buffers), and only grows the buffers if the free space is not enough in total.
+//Both happen with gpu side copies (glCopyBufferSubData), so the meshes need no cpu copies of their data.
+//The pool must outlive its meshes, and all its meshes must have the same vertex format (quantized or not).
+//
+//Usage :
+//    mesh_pool<meshvfn> pool;
+//    meshvfn ryugu("../obj/vfn/asteroids/ryugu196k.obj", pool);
+//    meshvfn bennu("../obj/vfn/asteroids/bennu196k.obj", pool);
+//    ryugu.draw_triangles(); //Works like any mesh, or :
+//    pool.bind();
+//    pool.draw_triangles(ryugu); //No vao switch between the meshes of the pool.
+//    pool.draw_triangles(bennu);
+//    pool.unbind();
+
+
+
+//First fit allocator of ranges [offset, offset + size) in some unit (vertices, index words). No gpu state, just the bookkeeping.
+class range_allocator
+{
+private:
+    std::map<size_t, size_t> free_blocks; //Offset -> size of the free blocks, sorted by offset so that neighbours are found at once.
+    size_t capacity, used;
+
+public:
+    static const size_t npos = (size_t)-1;
+
+    range_allocator(size_t initial_capacity = 0) : capacity(0), used(0)
+    {
+        grow(initial_capacity);
+    }
+
+    //Offset of a free range of the given size, or npos if no free block is large enough.
+    size_t allocate(size_t size)
+    {
+        for (auto it = free_blocks.begin(); it != free_blocks.end(); ++it)
+        {
+            if (it->second < size)
+                continue;
+            size_t offset = it->first, remaining = it->second - size;
+            free_blocks.erase(it);
+            if (remaining > 0)
+                free_blocks[offset + size] = remaining;
+            used += size;
+            return offset;
+        }
+        return npos;
+    }
+
+    //Give a range back, merged with the free blocks right before and after it.
+    void free(size_t offset, size_t size)
+    {
+        used -= size;
+        auto next = free_blocks.lower_bound(offset);
+        if (next != free_blocks.end() && offset + size == next->first)
+        {
+            size += next->second;
+            next = free_blocks.erase(next);
+        }
+        if (next != free_blocks.begin())
+        {
+            auto prev = std::prev(next);
+            if (prev->first + prev->second == offset)
+            {
+                prev->second += size;
+                return;
+            }
+        }
+        free_blocks[offset] = size;
+    }
+
+    //Add space at the end.
+    void grow(size_t new_capacity)
+    {
+        if (new_capacity <= capacity)
+            return;
+        size_t old_capacity = capacity;
+        capacity = new_capacity;
+        used += new_capacity - old_capacity; //free() subtracts it again.
+        free(old_capacity, new_capacity - old_capacity);
+    }
+
+    //Forget every range : the first packed_size units are in use, the rest is 1 free block.
+    void reset_packed(size_t packed_size, size_t new_capacity)
+    {
+        free_blocks.clear();
+        capacity = new_capacity;
+        used = packed_size;
+        if (capacity > used)
+            free_blocks[used] = capacity - used;
+    }
+
+    size_t get_capacity() const
+    {
+        return capacity;
+    }
+
+    size_t get_used() const
+    {
+        return used;
+    }
+
+    size_t get_num_free_blocks() const
+    {
+        return free_blocks.size();
+    }
+
+    size_t get_largest_free_block() const
+    {
+        size_t largest = 0;
+        for (const auto &block : free_blocks)
+            largest = std::max(largest, block.second);
+        return largest;
+    }
+};
+
+
+
+//Occupancy of a mesh_pool. Index space is counted in bytes.
+struct mesh_pool_stats
+{
+    size_t vertex_capacity, vertices_used, vertex_free_blocks, largest_free_vertex_block;
+    size_t index_capacity, index_bytes_used, index_free_blocks, largest_free_index_block;
+    unsigned int num_meshes, num_growths, num_defragmentations;
+    size_t gpu_bytes; //Size of the vbo and the ebo.
+    size_t used_bytes; //The part of it that holds meshes.
+};
+
+//Everything of a pool that does not depend on the layout.
+class mesh_pool_base
+{
+protected:
+    static const size_t index_word = 4; //Index ranges are allocated in 4 byte words, so that both 16 and 32-bit indices are aligned.
+
+    gl_vertex_array vao;
+    gl_buffer vbo, ebo;
+    size_t vertex_size;
+    bool quantized;
+    void (*set_vertex_attributes)(bool quantized);
+    range_allocator vertex_space; //In vertices.
+    range_allocator index_space; //In index words.
+    std::vector<mesh_pool_range*> ranges; //Live ranges, to update when the data moves.
+    unsigned int num_growths, num_defragmentations;
+
+    mesh_pool_base(size_t pool_vertex_size, bool pool_quantized, void (*attributes)(bool), size_t vertex_capacity, size_t index_capacity)
+        : vertex_size(pool_vertex_size), quantized(pool_quantized), set_vertex_attributes(attributes), num_growths(0), num_defragmentations(0)
+    {
+        vao = gl_vertex_array::create();
+        relocate(std::max<size_t>(vertex_capacity, 1), std::max<size_t>((index_capacity + index_word - 1)/index_word, 1));
+    }
+
+    //Move all live ranges to the front of new buffers of the given capacities (vertices, index words), in their current order.
+    //This both defragments and grows the pool.
+    void relocate(size_t vertex_capacity, size_t index_words)
+    {
+        gl_buffer new_vbo = gl_buffer::create(), new_ebo = gl_buffer::create();
+        glBindBuffer(GL_COPY_WRITE_BUFFER, new_vbo.get());
+        glBufferData(GL_COPY_WRITE_BUFFER, vertex_capacity*vertex_size, nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, new_ebo.get());
+        glBufferData(GL_COPY_WRITE_BUFFER, index_words*index_word, nullptr, GL_STATIC_DRAW);
+
+        //Vertices.
+        size_t packed_vertices = 0;
+        std::sort(ranges.begin(), ranges.end(), [](const mesh_pool_range *a, const mesh_pool_range *b) { return a->first_vertex < b->first_vertex; });
+        glBindBuffer(GL_COPY_READ_BUFFER, vbo.get());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, new_vbo.get());
+        for (mesh_pool_range *range : ranges)
+        {
+            if (range->num_vertices > 0)
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, range->first_vertex*vertex_size, packed_vertices*vertex_size, range->num_vertices*vertex_size);
+            range->first_vertex = packed_vertices;
+            packed_vertices += vertex_units(*range);
+        }
+
+        //Indices.
+        size_t packed_words = 0;
+        std::sort(ranges.begin(), ranges.end(), [](const mesh_pool_range *a, const mesh_pool_range *b) { return a->index_offset < b->index_offset; });
+        glBindBuffer(GL_COPY_READ_BUFFER, ebo.get());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, new_ebo.get());
+        for (mesh_pool_range *range : ranges)
+        {
+            if (range->index_bytes > 0)
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, range->index_offset, packed_words*index_word, range->index_bytes);
+            range->index_offset = packed_words*index_word;
+            packed_words += index_units(*range);
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        //Point the vao to the new buffers. The old ones are deleted by their handles.
+        vbo = std::move(new_vbo);
+        ebo = std::move(new_ebo);
+        glBindVertexArray(vao.get());
+        glBindBuffer(GL_ARRAY_BUFFER, vbo.get());
+        set_vertex_attributes(quantized);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo.get());
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        vertex_space.reset_packed(packed_vertices, vertex_capacity);
+        index_space.reset_packed(packed_words, index_words);
+    }
+
+    //Units a range takes in the allocators. Empty meshes still take 1, so that every range has an offset of its own.
+    static size_t vertex_units(const mesh_pool_range &range)
+    {
+        return std::max<size_t>(range.num_vertices, 1);
+    }
+
+    static size_t index_units(const mesh_pool_range &range)
+    {
+        return std::max<size_t>((range.index_bytes + index_word - 1)/index_word, 1);
+    }
+
+    //Reserve space for a mesh and upload its data. Defragments or grows the pool if the mesh does not fit.
+    std::shared_ptr<mesh_pool_range> allocate(const void *vertex_data, size_t num_vertices, bool mesh_quantized, const void *index_data, size_t index_bytes)
+    {
+        if (mesh_quantized != quantized)
+        {
+            fprintf(stderr, "Error : A %s mesh cannot be stored in a %s mesh pool. Exiting...\n", mesh_quantized ? "quantized" : "float", quantized ? "quantized" : "float");
+            exit(EXIT_FAILURE);
+        }
+
+        mesh_pool_range *range = new mesh_pool_range();
+        range->pool = this;
+        range->vao = vao.get();
+        range->num_vertices = num_vertices;
+        range->index_bytes = index_bytes;
+        range->vertex_size = vertex_size;
+
+        size_t vertex_need = vertex_units(*range), index_need = index_units(*range);
+        range->first_vertex = vertex_space.allocate(vertex_need);
+        range->index_offset = index_space.allocate(index_need);
+        if (range->first_vertex == range_allocator::npos || range->index_offset == range_allocator::npos)
+        {
+            //Undo the half that fitted, then make room for both.
+            if (range->first_vertex != range_allocator::npos)
+                vertex_space.free(range->first_vertex, vertex_need);
+            if (range->index_offset != range_allocator::npos)
+                index_space.free(range->index_offset, index_need);
+
+            size_t vertex_capacity = vertex_space.get_capacity(), index_words = index_space.get_capacity();
+            if (vertex_space.get_used() + vertex_need > vertex_capacity)
+                vertex_capacity = std::max(2*vertex_capacity, vertex_space.get_used() + vertex_need);
+            if (index_space.get_used() + index_need > index_words)
+                index_words = std::max(2*index_words, index_space.get_used() + index_need);
+            if (vertex_capacity != vertex_space.get_capacity() || index_words != index_space.get_capacity())
+                ++num_growths;
+            else
+                ++num_defragmentations;
+            relocate(vertex_capacity, index_words);
+
+            range->first_vertex = vertex_space.allocate(vertex_need);
+            range->index_offset = index_space.allocate(index_need)*index_word;
+        }
+        else
+            range->index_offset *= index_word;
+        ranges.push_back(range);
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vbo.get());
+        glBufferSubData(GL_COPY_WRITE_BUFFER, range->first_vertex*vertex_size, num_vertices*vertex_size, vertex_data);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ebo.get());
+        glBufferSubData(GL_COPY_WRITE_BUFFER, range->index_offset, index_bytes, index_data);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        //The last mesh that uses the range gives it back (if the pool still exists).
+        return std::shared_ptr<mesh_pool_range>(range, [](mesh_pool_range *r)
+        {
+            if (r->pool != nullptr)
+                r->pool->release(r);
+            delete r;
+        });
+    }
+
+public:
+    //The meshes point to the pool, so it is never copied or moved.
+    mesh_pool_base(const mesh_pool_base &) = delete;
+    mesh_pool_base &operator=(const mesh_pool_base &) = delete;
+
+    //Meshes that outlive the pool are left pointing at nothing, and must not be drawn.
+    ~mesh_pool_base()
+    {
+        for (mesh_pool_range *range : ranges)
+            range->pool = nullptr;
+    }
+
+    //Free the space of a range. Called when the last mesh that uses it is destroyed.
+    void release(mesh_pool_range *range)
+    {
+        vertex_space.free(range->first_vertex, vertex_units(*range));
+        index_space.free(range->index_offset/index_word, index_units(*range));
+        ranges.erase(std::find(ranges.begin(), ranges.end(), range));
+    }
+
+    //Pack the live meshes to the front of the buffers, so that all the free space is 1 block. The capacity stays the same.
+    void defragment()
+    {
+        ++num_defragmentations;
+        relocate(vertex_space.get_capacity(), index_space.get_capacity());
+    }
+
+    //Bind the pool's vao, for draw_triangles() of its meshes.
+    void bind()
+    {
+        glBindVertexArray(vao.get());
+    }
+
+    void unbind()
+    {
+        glBindVertexArray(0);
+    }
+
+    mesh_pool_stats get_stats() const
+    {
+        mesh_pool_stats stats;
+        stats.vertex_capacity = vertex_space.get_capacity();
+        stats.vertices_used = vertex_space.get_used();
+        stats.vertex_free_blocks = vertex_space.get_num_free_blocks();
+        stats.largest_free_vertex_block = vertex_space.get_largest_free_block();
+        stats.index_capacity = index_space.get_capacity()*index_word;
+        stats.index_bytes_used = index_space.get_used()*index_word;
+        stats.index_free_blocks = index_space.get_num_free_blocks();
+        stats.largest_free_index_block = index_space.get_largest_free_block()*index_word;
+        stats.num_meshes = (unsigned int)ranges.size();
+        stats.num_growths = num_growths;
+        stats.num_defragmentations = num_defragmentations;
+        stats.gpu_bytes = stats.vertex_capacity*vertex_size + stats.index_capacity;
+        stats.used_bytes = stats.vertices_used*vertex_size + stats.index_bytes_used;
+        return stats;
+    }
+
+    //Print how full the pool is and how fragmented its free space is (1 - largest free block / all free space).
+    void print_occupancy(const char *label = "Mesh pool")
+    {
+        mesh_pool_stats s = get_stats();
+        size_t free_vertices = s.vertex_capacity - s.vertices_used, free_index_bytes = s.index_capacity - s.index_bytes_used;
+        printf("%s : %u meshes in %.1f MB, %u growths, %u defragmentations.\n", label, s.num_meshes, s.gpu_bytes/(1024.0*1024.0), s.num_growths, s.num_defragmentations);
+        printf("    vertices : %u / %u used (%.1f%%), %u free blocks, fragmentation %.1f%%.\n", (unsigned int)s.vertices_used, (unsigned int)s.vertex_capacity,
+               100.0*s.vertices_used/s.vertex_capacity, (unsigned int)s.vertex_free_blocks, free_vertices ? 100.0*(1.0 - (double)s.largest_free_vertex_block/free_vertices) : 0.0);
+        printf("    indices  : %u / %u bytes used (%.1f%%), %u free blocks, fragmentation %.1f%%.\n", (unsigned int)s.index_bytes_used, (unsigned int)s.index_capacity,
+               100.0*s.index_bytes_used/s.index_capacity, (unsigned int)s.index_free_blocks, free_index_bytes ? 100.0*(1.0 - (double)s.largest_free_index_block/free_index_bytes) : 0.0);
+    }
+};
+
+
+
+template<typename mesh_type>
+class mesh_pool : public mesh_pool_base
+{
+private:
+    typedef typename mesh_type::layout_type layout;
+    friend mesh_type; //Allocates its range.
+
+public:
+    //quantized must match the mesh_quantize flag of the meshes. The capacities (in vertices and index bytes) only set the initial
+    //size of the buffers, the pool grows as needed.
+    mesh_pool(bool quantized = false, size_t vertex_capacity = 1u << 18, size_t index_capacity = 1u << 21)
+        : mesh_pool_base(layout::vertex_size(quantized), quantized, &layout::set_vertex_attributes, vertex_capacity, index_capacity) {}
+
+    //Where a mesh of the pool is, for draws that are not issued by the mesh itself (e.g. indirect draws, see mesh_indirect.h) :
+    //the offset of its first index in indices of its index type, its number of indices and its base vertex. lod picks a level of detail.
+    void get_draw_range(const mesh_type &m, unsigned int &first_index, unsigned int &num_inds, int &base_vertex, GLenum &index_type, unsigned int lod = 0) const
+    {
+        if (!m.pool_range || m.pool_range->pool != this)
+        {
+            fprintf(stderr, "Error : A mesh was drawn with a pool it does not live in. Exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+        index_type = m.index_type;
+        first_index = (unsigned int)(m.get_index_offset(lod)/((index_type == GL_UNSIGNED_SHORT) ? 2 : 4));
+        num_inds = m.get_lod(lod).num_indices;
+        base_vertex = (int)m.pool_range->first_vertex;
+    }
+
+    //Draw a mesh of the pool with the pool's vao already bound (see bind()).
+    void draw_triangles(const mesh_type &m, unsigned int lod = 0)
+    {
+        if (!m.pool_range || m.pool_range->pool != this)
+        {
+            fprintf(stderr, "Error : A mesh was drawn with a pool it does not live in. Exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+        if constexpr (layout::has_uvs)
+            m.bind_texture();
+        m.draw_elements(GL_TRIANGLES, lod);
+    }
+
+    //Same, for the visible meshlets of a mesh of the pool (see mesh::cull_meshlets()).
+    void draw_triangles(const mesh_type &m, const meshlet_draw_list &visible)
+    {
+        if (!m.pool_range || m.pool_range->pool != this)
+        {
+            fprintf(stderr, "Error : A mesh was drawn with a pool it does not live in. Exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+        if constexpr (layout::has_uvs)
+            m.bind_texture();
+        m.draw_meshlet_runs(visible);
+    }
+};
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef MESH_QUANTIZE_H
+#define MESH_QUANTIZE_H
+
+#include<cstdint>
+#include<cstring>
+#include<cmath>
+#include<vector>
+#include<glm/glm.hpp>
+
+#include"mesh_cache.h"
+
+//Compact vertex formats for the gpu (optional, see mesh_quantize in mesh.h). Per attribute :
+//- Position : 3 snorm16 relative to the bounding box (+1 unused short, so that vertices stay 4-byte aligned). 8 bytes instead of 12.
+//  The shader gets values in [-1,1] and maps them back with the mesh's dequantization matrix (bounding box center + half extents).
+//  The error is at most half_extent/32767 per axis, i.e. ~0.0015% of the mesh size.
+//- Normal : octahedral encoding in 2 snorm16 (the unit sphere folded onto a square). 4 bytes instead of 12, error below 0.05 degrees.
+//  The shader has to unfold it (see oct_decode() in the *_quantized.vert shaders).
+//- Uv : 2 half floats. 4 bytes instead of 8. Halfs have 11 significant bits, which is exact enough for uvs in [0,1] up to 2k textures,
+//  but coarse for heavily tiled uvs (e.g. 1/64 of a repeat around uv = 20).
+
+
+
+inline int16_t quantize_snorm16(float x)
+{
+    x = std::fmax(-1.0f, std::fmin(1.0f, x));
+    return (int16_t)std::lround(x*32767.0f);
+}
+
+//Octahedral encoding of a unit vector, in [-1,1]^2.
+inline glm::vec2 octahedral_encode(glm::vec3 n)
+{
+    float sum = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (sum == 0.0f)
+        return glm::vec2(0.0f, 0.0f);
+    n /= sum;
+    if (n.z < 0.0f)
+    {
+        float x = n.x, y = n.y;
+        n.x = (1.0f - std::fabs(y))*((x >= 0.0f) ? 1.0f : -1.0f);
+        n.y = (1.0f - std::fabs(x))*((y >= 0.0f) ? 1.0f : -1.0f);
+    }
+    return glm::vec2(n.x, n.y);
+}
+
+//IEEE 754 single to half precision, rounded to nearest even. Values beyond the half range become infinity.
+inline uint16_t float_to_half(float value)
+{
+    uint32_t f;
+    memcpy(&f, &value, 4);
+    uint32_t sign = (f >> 16) & 0x8000u;
+    uint32_t abs_f = f & 0x7FFFFFFFu;
+
+    if (abs_f >= 0x7F800000u) //Inf or nan.
+        return (uint16_t)(sign | 0x7C00u | ((abs_f > 0x7F800000u) ? 0x200u : 0u));
+    if (abs_f >= 0x47800000u) //Too large.
+        return (uint16_t)(sign | 0x7C00u);
+    if (abs_f < 0x38800000u) //Subnormal half (or zero). Shift the mantissa (with its implicit 1) into place, rounding to nearest even.
+    {
+        if (abs_f < 0x33000000u)
+            return (uint16_t)sign;
+        uint32_t mantissa = (abs_f & 0x7FFFFFu) | 0x800000u;
+        uint32_t shift = 126 - (abs_f >> 23);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1u)))
+            ++half;
+        return (uint16_t)(sign | half);
+    }
+
+    //Normal half. Rebias the exponent and round the 13 dropped mantissa bits to nearest even (a carry correctly bumps the exponent).
+    uint32_t half = ((abs_f - 0x38000000u) >> 13);
+    uint32_t rest = abs_f & 0x1FFFu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+        ++half;
+    return (uint16_t)(sign | half);
+}
+
+//Center and half extents of the bounding box. Flat axes get a half extent of 1, so that nothing is divided by 0.
+inline void mesh_quantization_box(const mesh_bounds &bounds, glm::vec3 &center, glm::vec3 &half_extent)
+{
+    for (int k = 0; k < 3; ++k)
+    {
+        center[k] = 0.5f*(bounds.aabb_min[k] + bounds.aabb_max[k]);
+        half_extent[k] = 0.5f*(bounds.aabb_max[k] - bounds.aabb_min[k]);
+        if (!(half_extent[k] > 0.0f))
+            half_extent[k] = 1.0f;
+    }
+}
+
+//Bytes per quantized vertex, and the offsets of the attributes in it.
+template<bool has_normals, bool has_uvs>
+struct quantized_vertex_format
+{
+    static constexpr unsigned int normal_offset = 8;
+    static constexpr unsigned int uv_offset = has_normals ? 12 : 8;
+    static constexpr unsigned int size = uv_offset + (has_uvs ? 4 : 0);
+};
+
+//Quantize num_vertices interleaved float vertices ({x,y,z, [nx,ny,nz], [u,v]}, 'stride' floats each) into out.
+template<bool has_normals, bool has_uvs>
+void mesh_quantize_vertices(const float *vertex_data, size_t num_vertices, unsigned int stride, const mesh_bounds &bounds, std::vector<unsigned char> &out)
+{
+    typedef quantized_vertex_format<has_normals, has_uvs> format;
+    glm::vec3 center, half_extent;
+    mesh_quantization_box(bounds, center, half_extent);
+
+    out.resize(num_vertices*format::size);
+    for (size_t i = 0; i < num_vertices; ++i)
+    {
+        const float *v = vertex_data + i*stride;
+        unsigned char *q = &out[i*format::size];
+
+        int16_t pos[4] = { quantize_snorm16((v[0] - center.x)/half_extent.x), quantize_snorm16((v[1] - center.y)/half_extent.y),
+                           quantize_snorm16((v[2] - center.z)/half_extent.z), 0 };
+        memcpy(q, pos, sizeof(pos));
+        if constexpr (has_normals)
+        {
+            glm::vec2 e = octahedral_encode(glm::vec3(v[3], v[4], v[5]));
+            int16_t normal[2] = { quantize_snorm16(e.x), quantize_snorm16(e.y) };
+            memcpy(q + format::normal_offset, normal, sizeof(normal));
+        }
+        if constexpr (has_uvs)
+        {
+            const float *uv = v + (has_normals ? 6 : 3);
+            uint16_t half_uv[2] = { float_to_half(uv[0]), float_to_half(uv[1]) };
+            memcpy(q + format::uv_offset, half_uv, sizeof(half_uv));
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,401 @@
+#ifndef MESH_SIMPLIFY_H
+#define MESH_SIMPLIFY_H
+
+#include<cstdint>
+#include<cstring>
+#include<cmath>
+#include<vector>
+#include<queue>
+#include<algorithm>
+#include<glm/glm.hpp>
+
+#include"mesh_cache.h"
+#include"mesh_optimizer.h"
+
+//Load time generation of levels of detail (LODs) : simplified versions of a mesh, for drawing it with fewer triangles when it covers
+//few pixels. A 256k triangle asteroid that is 50 pixels across looks the same with a few thousand.
+//The simplification is the quadric error metric of Garland & Heckbert (1997) : every vertex carries the sum of the (squared distance)
+//quadrics of the planes of the triangles around it, and edges are collapsed cheapest first, the cost being the mean squared distance of
+//the merged vertex from the planes it gathered. A collapse moves 1 vertex onto the other end of the edge, so the simplified meshes only
+//use vertices that already exist : all the levels share the mesh's vertex buffer, and each level only adds indices (a third more in
+//total with 4 times fewer triangles per level). Collapses that would flip a triangle or make the surface non-manifold are skipped, and
+//border vertices (open meshes) and uv seams never move, so the simplified meshes keep their outline and textures.
+//Flat shaded meshes (1 normal per face, like the asteroid shape models) store every position several times with different normals.
+//The simplification works on the positions, and every corner of a simplified triangle then uses the copy of its position whose normal
+//is closest to the new triangle's normal.
+//The error of every level is the largest collapse error on the way to it, in the mesh's local units : a root mean square distance, the
+//largest deviation of the surface is typically about twice that. See mesh::select_lod() for turning it into pixels.
+//
+//Usage :
+//    std::vector<unsigned int> inds = ...; //The full mesh.
+//    mesh_lod_chain chain = mesh_build_lods(inds, vertex_data, num_verts, stride, normal_offset, -1, false);
+//    //inds now holds all the levels one after the other. chain.lods[i] tells where level i is.
+
+
+
+//Number of triangles of the next level, relative to the previous one.
+const float mesh_lod_reduction = 0.25f;
+
+//No level goes below this many triangles.
+const unsigned int mesh_lod_min_triangles = 64;
+
+//Sum of squared distances from planes, as the symmetric 4x4 matrix of the planes (a,b,c,d) (upper triangle only), and the total area
+//of the triangles the planes came from.
+struct mesh_quadric
+{
+    double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+    double weight;
+
+    //Plane through p with unit normal n, weighted by an area.
+    void add_plane(const glm::vec3 &n, const glm::vec3 &p, double area)
+    {
+        double a = n.x, b = n.y, c = n.z, d = -(a*p.x + b*p.y + c*p.z);
+        a2 += area*a*a; ab += area*a*b; ac += area*a*c; ad += area*a*d;
+        b2 += area*b*b; bc += area*b*c; bd += area*b*d;
+        c2 += area*c*c; cd += area*c*d;
+        d2 += area*d*d;
+        weight += area;
+    }
+
+    void add(const mesh_quadric &q)
+    {
+        a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+        b2 += q.b2; bc += q.bc; bd += q.bd;
+        c2 += q.c2; cd += q.cd;
+        d2 += q.d2;
+        weight += q.weight;
+    }
+
+    //Mean squared distance of p from the planes.
+    double error(const glm::vec3 &p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double e = a2*x*x + 2.0*ab*x*y + 2.0*ac*x*z + 2.0*ad*x
+                 + b2*y*y + 2.0*bc*y*z + 2.0*bd*y
+                 + c2*z*z + 2.0*cd*z
+                 + d2;
+        return (weight > 0.0) ? std::max(e, 0.0)/weight : 0.0;
+    }
+};
+
+//Edge collapse candidate : move vertex 'from' onto vertex 'to'. Stale candidates (one of the vertices changed since) are skipped.
+struct mesh_collapse
+{
+    float cost;
+    unsigned int from, to;
+    unsigned int from_version, to_version;
+
+    bool operator>(const mesh_collapse &other) const
+    {
+        return cost > other.cost;
+    }
+};
+
+
+
+//Number the distinct positions of num_verts vertices ('stride' floats, position first) : pos_of[v] is the position of vertex v. The vertices
+//are sorted by position, so that the vertices of position p are sorted[pos_start[p]] ... sorted[pos_start[p + 1] - 1]. Returns the number
+//of positions. The copies of a vertex with different normals or uvs (flat shading, seams) end up with the same position.
+inline size_t mesh_weld_positions(const float *vertex_data, size_t num_verts, unsigned int stride, std::vector<unsigned int> &pos_of,
+                                  std::vector<unsigned int> &sorted, std::vector<unsigned int> &pos_start)
+{
+    sorted.resize(num_verts);
+    for (size_t v = 0; v < num_verts; ++v)
+        sorted[v] = (unsigned int)v;
+    std::sort(sorted.begin(), sorted.end(), [&](unsigned int a, unsigned int b)
+    {
+        return memcmp(vertex_data + (size_t)a*stride, vertex_data + (size_t)b*stride, 3*sizeof(float)) < 0;
+    });
+    pos_of.resize(num_verts);
+    pos_start.clear();
+    for (size_t i = 0; i < num_verts; ++i)
+    {
+        if (i == 0 || memcmp(vertex_data + (size_t)sorted[i]*stride, vertex_data + (size_t)sorted[i - 1]*stride, 3*sizeof(float)) != 0)
+            pos_start.push_back((unsigned int)i);
+        pos_of[sorted[i]] = (unsigned int)pos_start.size() - 1;
+    }
+    const size_t num_pos = pos_start.size();
+    pos_start.push_back((unsigned int)num_verts);
+    return num_pos;
+}
+
+//Build the levels of detail of an indexed triangle mesh and append their indices to inds (which holds the full mesh, level 0).
+//Vertices are 'stride' floats, position first. normal_offset and uv_offset are the offsets (in floats) of the normal and the uv inside a
+//vertex, -1 if the vertices have none. optimize reorders the triangles of every level for the vertex cache (see mesh_optimizer.h).
+inline mesh_lod_chain mesh_build_lods(std::vector<unsigned int> &inds, const float *vertex_data, size_t num_verts, unsigned int stride,
+                                      int normal_offset, int uv_offset, bool optimize)
+{
+    mesh_lod_chain chain = mesh_single_lod((uint32_t)inds.size());
+    const size_t num_tris = inds.size()/3;
+    if (num_tris*mesh_lod_reduction < mesh_lod_min_triangles || num_verts == 0)
+        return chain;
+
+    auto position = [&](size_t v) { const float *p = vertex_data + v*stride; return glm::vec3(p[0], p[1], p[2]); };
+
+    //1) Weld the vertices that share a position (e.g. the copies of a flat shaded mesh).
+    std::vector<unsigned int> pos_of, sorted, pos_start;
+    const size_t num_pos = mesh_weld_positions(vertex_data, num_verts, stride, pos_of, sorted, pos_start);
+    std::vector<glm::vec3> pos(num_pos);
+    for (size_t p = 0; p < num_pos; ++p)
+        pos[p] = position(sorted[pos_start[p]]);
+
+    //Positions whose copies have different uvs are on a seam of the texture, and do not move.
+    std::vector<char> locked(num_pos, 0);
+    if (uv_offset >= 0)
+        for (size_t p = 0; p < num_pos; ++p)
+            for (unsigned int i = pos_start[p] + 1; i < pos_start[p + 1]; ++i)
+                if (memcmp(vertex_data + (size_t)sorted[i]*stride + uv_offset, vertex_data + (size_t)sorted[pos_start[p]]*stride + uv_offset, 2*sizeof(float)) != 0)
+                    locked[p] = 1;
+
+    //2) Triangles over positions, the triangles around every position, and the quadrics.
+    std::vector<unsigned int> tris;
+    tris.reserve(3*num_tris);
+    for (size_t t = 0; t < num_tris; ++t)
+    {
+        unsigned int a = pos_of[inds[3*t]], b = pos_of[inds[3*t + 1]], c = pos_of[inds[3*t + 2]];
+        if (a != b && b != c && c != a) //Degenerate triangles are dropped.
+        {
+            tris.push_back(a);
+            tris.push_back(b);
+            tris.push_back(c);
+        }
+    }
+    const size_t num_live = tris.size()/3;
+    std::vector<std::vector<unsigned int>> pos_tris(num_pos);
+    std::vector<mesh_quadric> quadrics(num_pos, mesh_quadric());
+    for (size_t t = 0; t < num_live; ++t)
+    {
+        const glm::vec3 &p0 = pos[tris[3*t]], &p1 = pos[tris[3*t + 1]], &p2 = pos[tris[3*t + 2]];
+        glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+        float length = glm::length(n);
+        for (int k = 0; k < 3; ++k)
+            pos_tris[tris[3*t + k]].push_back((unsigned int)t);
+        if (length > 0.0f)
+            for (int k = 0; k < 3; ++k)
+                quadrics[tris[3*t + k]].add_plane(n/length, p0, 0.5*length);
+    }
+
+    //Edges used by 1 triangle (borders) or more than 2 (non-manifold) : their vertices do not move.
+    std::vector<uint64_t> edges;
+    edges.reserve(3*num_live);
+    for (size_t t = 0; t < num_live; ++t)
+        for (int k = 0; k < 3; ++k)
+        {
+            uint64_t a = tris[3*t + k], b = tris[3*t + (k + 1)%3];
+            edges.push_back((std::min(a, b) << 32) | std::max(a, b));
+        }
+    std::sort(edges.begin(), edges.end());
+    for (size_t i = 0; i < edges.size(); )
+    {
+        size_t j = i;
+        while (j < edges.size() && edges[j] == edges[i])
+            ++j;
+        if (j - i != 2)
+        {
+            locked[edges[i] >> 32] = 1;
+            locked[edges[i] & 0xFFFFFFFFu] = 1;
+        }
+        i = j;
+    }
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    //3) Collapse edges, cheapest first.
+    std::vector<char> tri_alive(num_live, 1), pos_removed(num_pos, 0);
+    std::vector<unsigned int> version(num_pos, 0);
+    std::priority_queue<mesh_collapse, std::vector<mesh_collapse>, std::greater<mesh_collapse>> queue;
+    auto push_edge = [&](unsigned int a, unsigned int b)
+    {
+        mesh_quadric q = quadrics[a];
+        q.add(quadrics[b]);
+        mesh_collapse c;
+        float cost_ab = locked[a] ? INFINITY : (float)q.error(pos[b]); //a moves onto b.
+        float cost_ba = locked[b] ? INFINITY : (float)q.error(pos[a]);
+        if (cost_ab == INFINITY && cost_ba == INFINITY)
+            return;
+        c.cost = std::min(cost_ab, cost_ba);
+        c.from = (cost_ab <= cost_ba) ? a : b;
+        c.to = (cost_ab <= cost_ba) ? b : a;
+        c.from_version = version[c.from];
+        c.to_version = version[c.to];
+        queue.push(c);
+    };
+    for (uint64_t e : edges)
+        push_edge((unsigned int)(e >> 32), (unsigned int)(e & 0xFFFFFFFFu));
+
+    std::vector<unsigned int> neighbors_from, neighbors_to;
+    auto gather_neighbors = [&](unsigned int p, std::vector<unsigned int> &neighbors)
+    {
+        neighbors.clear();
+        for (unsigned int t : pos_tris[p])
+            if (tri_alive[t])
+                for (int k = 0; k < 3; ++k)
+                    if (tris[3*t + k] != p)
+                        neighbors.push_back(tris[3*t + k]);
+        std::sort(neighbors.begin(), neighbors.end());
+        neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+    };
+
+    //Whether moving 'from' onto 'to' keeps the mesh manifold and no triangle turns over.
+    auto collapse_is_valid = [&](unsigned int from, unsigned int to)
+    {
+        //Link condition : the only common neighbors of the 2 vertices are the opposite corners of the triangles of the edge.
+        unsigned int shared_tris = 0;
+        for (unsigned int t : pos_tris[from])
+            if (tri_alive[t] && (tris[3*t] == to || tris[3*t + 1] == to || tris[3*t + 2] == to))
+                ++shared_tris;
+        gather_neighbors(from, neighbors_from);
+        gather_neighbors(to, neighbors_to);
+        unsigned int common = 0;
+        for (size_t i = 0, j = 0; i < neighbors_from.size() && j < neighbors_to.size(); )
+        {
+            if (neighbors_from[i] < neighbors_to[j])
+                ++i;
+            else if (neighbors_from[i] > neighbors_to[j])
+                ++j;
+            else
+            {
+                ++common;
+                ++i;
+                ++j;
+            }
+        }
+        if (shared_tris != 2 || common != 2)
+            return false;
+
+        //No triangle around 'from' may turn by more than ~45 degrees. More lets thin strips fold over in a few steps.
+        for (unsigned int t : pos_tris[from])
+        {
+            if (!tri_alive[t])
+                continue;
+            unsigned int c[3] = { tris[3*t], tris[3*t + 1], tris[3*t + 2] };
+            if (c[0] == to || c[1] == to || c[2] == to)
+                continue;
+            glm::vec3 n_old = glm::cross(pos[c[1]] - pos[c[0]], pos[c[2]] - pos[c[0]]);
+            for (unsigned int &v : c)
+                if (v == from)
+                    v = to;
+            glm::vec3 n_new = glm::cross(pos[c[1]] - pos[c[0]], pos[c[2]] - pos[c[0]]);
+            if (glm::dot(n_old, n_new) <= 0.7f*glm::length(n_old)*glm::length(n_new))
+                return false;
+            //Nor become a sliver (its normal would be meaningless, and so would be the next flip tests) : area against the longest edge.
+            float longest_squared = std::max({glm::dot(pos[c[1]] - pos[c[0]], pos[c[1]] - pos[c[0]]), glm::dot(pos[c[2]] - pos[c[1]], pos[c[2]] - pos[c[1]]),
+                                      glm::dot(pos[c[0]] - pos[c[2]], pos[c[0]] - pos[c[2]])});
+            if (glm::length(n_new) < 0.05f*longest_squared)
+                return false;
+        }
+        return true;
+    };
+
+    //Write the live triangles as a level. Every corner uses the copy of its position whose normal fits the triangle best.
+    auto emit_level = [&](float error)
+    {
+        mesh_lod_level &lod = chain.lods[chain.num_lods++];
+        std::vector<unsigned int> level;
+        for (size_t t = 0; t < num_live; ++t)
+        {
+            if (!tri_alive[t])
+                continue;
+            const unsigned int *c = &tris[3*t];
+            glm::vec3 n = glm::cross(pos[c[1]] - pos[c[0]], pos[c[2]] - pos[c[0]]);
+            for (int k = 0; k < 3; ++k)
+            {
+                unsigned int best = sorted[pos_start[c[k]]];
+                if (normal_offset >= 0)
+                {
+                    float best_dot = -INFINITY;
+                    for (unsigned int i = pos_start[c[k]]; i < pos_start[c[k] + 1]; ++i)
+                    {
+                        const float *vn = vertex_data + (size_t)sorted[i]*stride + normal_offset;
+                        float d = glm::dot(glm::vec3(vn[0], vn[1], vn[2]), n);
+                        if (d > best_dot)
+                        {
+                            best_dot = d;
+                            best = sorted[i];
+                        }
+                    }
+                }
+                level.push_back(best);
+            }
+        }
+        if (optimize && !level.empty())
+        {
+            std::vector<unsigned int> triangle_order;
+            std::vector<size_t> cluster_starts;
+            mesh_tipsify(level.data(), level.size(), num_verts, mesh_optimizer_cache_size, triangle_order, cluster_starts);
+            mesh_sort_clusters(level.data(), vertex_data, stride, triangle_order, cluster_starts);
+            std::vector<unsigned int> reordered(level.size());
+            for (size_t i = 0; i < triangle_order.size(); ++i)
+                memcpy(&reordered[3*i], &level[3*(size_t)triangle_order[i]], 3*sizeof(unsigned int));
+            level.swap(reordered);
+        }
+        lod.first_index = (uint32_t)inds.size();
+        lod.num_indices = (uint32_t)level.size();
+        lod.error = error;
+        inds.insert(inds.end(), level.begin(), level.end());
+    };
+
+    size_t live = num_live;
+    size_t target = (size_t)(num_tris*mesh_lod_reduction);
+    float max_error = 0.0f;
+    while (chain.num_lods < mesh_max_lods && target >= mesh_lod_min_triangles)
+    {
+        bool stuck = true;
+        while (!queue.empty())
+        {
+            mesh_collapse c = queue.top();
+            queue.pop();
+            if (pos_removed[c.from] || pos_removed[c.to] || version[c.from] != c.from_version || version[c.to] != c.to_version)
+                continue;
+            if (!collapse_is_valid(c.from, c.to))
+                continue;
+
+            //Move 'from' onto 'to' : the triangles of the edge disappear, the other ones of 'from' now use 'to'.
+            for (unsigned int t : pos_tris[c.from])
+            {
+                if (!tri_alive[t])
+                    continue;
+                unsigned int *corners = &tris[3*t];
+                if (corners[0] == c.to || corners[1] == c.to || corners[2] == c.to)
+                {
+                    tri_alive[t] = 0;
+                    --live;
+                    continue;
+                }
+                for (int k = 0; k < 3; ++k)
+                    if (corners[k] == c.from)
+                        corners[k] = c.to;
+                pos_tris[c.to].push_back(t);
+            }
+            std::vector<unsigned int>().swap(pos_tris[c.from]);
+            pos_tris[c.to].erase(std::remove_if(pos_tris[c.to].begin(), pos_tris[c.to].end(), [&](unsigned int t) { return !tri_alive[t]; }), pos_tris[c.to].end());
+            pos_removed[c.from] = 1;
+            quadrics[c.to].add(quadrics[c.from]);
+            ++version[c.to];
+            max_error = std::max(max_error, std::sqrt(c.cost));
+
+            //The edges around 'to' cost something else now.
+            gather_neighbors(c.to, neighbors_to);
+            std::vector<unsigned int> around = neighbors_to;
+            for (unsigned int n : around)
+                push_edge(c.to, n);
+
+            if (live <= target)
+            {
+                stuck = false;
+                break;
+            }
+        }
+        if (stuck)
+        {
+            //Nothing left to collapse. The last level is kept only if it is clearly coarser than the previous one.
+            if (live < 0.8f*chain.lods[chain.num_lods - 1].num_indices/3)
+                emit_level(max_error);
+            break;
+        }
+        emit_level(max_error);
+        target = (size_t)(target*mesh_lod_reduction);
+    }
+    return chain;
+}
+
+#endif
@@ -0,0 +1,568 @@
+#ifndef OBJ_PARSER_H
+#define OBJ_PARSER_H
+
+#include<cstdio>
+#include<cstdlib>
+#include<cmath>
+#include<cstring>
+#include<vector>
+#include<thread>
+#include<algorithm>
+#include<glm/glm.hpp>
+
+#include"mapped_file.h"
+
+//Fast wavefront obj parser, shared by all mesh classes. The file is memory mapped and scanned in place with hand written
+//number tokenizers, so no std::string, no getline() and no sscanf() (i.e. no heap allocation and no format string parsing per line).
+//Large files are split at line boundaries into chunks that are parsed concurrently and then merged in file order.
+//Faces may have any number of corners, any of the v, v/t, v//n, v/t/n forms (mixed freely) and negative (relative) indices.
+
+
+
+//Face corner indices (0-based) as they appear in the obj file. Every triangle contributes 3 of them. Missing attributes are marked with obj_no_index.
+const unsigned int obj_no_index = 0xFFFFFFFFu;
+struct obj_corner
+{
+    unsigned int v, t, n; //Position, uv and normal index.
+};
+
+//A face with more than 3 corners. It is stored in corners[] as a triangle fan (c0,c1,c2, c0,c2,c3, ...), i.e. num_corners - 2 triangles
+//starting at first_corner. Fans are only correct for convex polygons, so the concave ones are re-triangulated once all positions are known.
+struct obj_polygon
+{
+    size_t first_corner;
+    unsigned int num_corners;
+};
+
+//Everything read from the obj file, before vertices and attributes are combined by the mesh classes.
+struct obj_data
+{
+    std::vector<glm::vec3> verts; //{{x1,y1,z1}, {x2,y2,z2}, ...}. One contiguous array, no per vertex allocation.
+    std::vector<glm::vec3> norms; //{{nx1,ny1,nz1}, {nx2,ny2,nz2}, ...}.
+    std::vector<glm::vec2> uvs; //{{u1,v1}, {u2,v2}, ...}.
+    std::vector<obj_corner> corners; //{c1,c2,c3, c4,c5,c6, ...}. 3 corners per triangle.
+    std::vector<obj_polygon> polygons; //Faces that were triangulated (quads, n-gons). Empty for pure triangle meshes.
+};
+static_assert(sizeof(glm::vec3) == 3*sizeof(float) && sizeof(glm::vec2) == 2*sizeof(float), "The vertex arrays are handed to OpenGL as tightly packed floats.");
+
+
+
+inline bool obj_is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline bool obj_is_digit(char c)
+{
+    return (unsigned char)(c - '0') < 10;
+}
+
+inline const char *obj_skip_spaces(const char *p, const char *end)
+{
+    while (p < end && obj_is_space(*p))
+        ++p;
+    return p;
+}
+
+//Return a pointer to the first character of the next line.
+inline const char *obj_next_line(const char *p, const char *end)
+{
+    const char *newline = (const char *)memchr(p, '\n', (size_t)(end - p));
+    return (newline == nullptr) ? end : newline + 1;
+}
+
+//Parse an unsigned integer and advance p past it. Leading spaces/tabs are skipped.
+inline unsigned int obj_parse_uint(const char *&p, const char *end)
+{
+    p = obj_skip_spaces(p, end);
+    unsigned int value = 0;
+    while (p < end && obj_is_digit(*p))
+    {
+        value = 10*value + (unsigned int)(*p - '0');
+        ++p;
+    }
+    return value;
+}
+
+//Slow but exact path for the numbers that the fast path of obj_parse_float() cannot represent exactly (too many digits, huge exponents, nan, inf, ...).
+inline float obj_parse_float_fallback(const char *start, const char *&p, const char *end)
+{
+    p = start;
+    while (p < end && !obj_is_space(*p) && *p != '\n')
+        ++p;
+    char token[64]; //Stack buffer, so even the slow path does not allocate.
+    size_t len = (size_t)(p - start);
+    if (len > sizeof(token) - 1)
+        len = sizeof(token) - 1;
+    memcpy(token, start, len);
+    token[len] = '\0';
+    return strtof(token, nullptr);
+}
+
+//Parse a decimal floating point number (e.g. -1.25, 3, 4.5e-3) and advance p past it. Leading spaces/tabs are skipped.
+//Up to 19 significant digits are accumulated in a 64-bit integer, which is then scaled by an exact power of 10 in double precision.
+//Both operands are exact, so the double is correctly rounded. Rounding it to float again gives what strtof()/sscanf("%f") would give,
+//except when the double lands exactly halfway between 2 floats : the decimal number may be just above or below that midpoint, so such
+//(rare) numbers take the strtof() path too.
+inline float obj_parse_float(const char *&p, const char *end)
+{
+    //Exact powers of 10 in double precision. 10^22 is the largest one that a double holds exactly.
+    static const double pow10[23] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+    p = obj_skip_spaces(p, end);
+    const char *start = p;
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = (*p == '-');
+        ++p;
+    }
+
+    unsigned long long mantissa = 0;
+    int significant_digits = 0, exponent = 0;
+    bool any_digit = false, exact = true;
+
+    //Integer part.
+    while (p < end && obj_is_digit(*p))
+    {
+        any_digit = true;
+        if (significant_digits < 19)
+        {
+            mantissa = 10*mantissa + (unsigned long long)(*p - '0');
+            if (mantissa != 0)
+                ++significant_digits; //Leading zeros are not significant.
+        }
+        else
+        {
+            ++exponent; //Dropped integer digit.
+            exact = exact && (*p == '0');
+        }
+        ++p;
+    }
+
+    //Fractional part.
+    if (p < end && *p == '.')
+    {
+        ++p;
+        while (p < end && obj_is_digit(*p))
+        {
+            any_digit = true;
+            if (significant_digits < 19)
+            {
+                mantissa = 10*mantissa + (unsigned long long)(*p - '0');
+                if (mantissa != 0)
+                    ++significant_digits;
+                --exponent;
+            }
+            else
+                exact = exact && (*p == '0'); //Dropped fractional digit.
+            ++p;
+        }
+    }
+
+    if (!any_digit)
+        return obj_parse_float_fallback(start, p, end);
+
+    //Exponent part.
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        ++p;
+        bool negative_exponent = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative_exponent = (*p == '-');
+            ++p;
+        }
+        int e = 0;
+        while (p < end && obj_is_digit(*p))
+        {
+            if (e < 10000)
+                e = 10*e + (*p - '0');
+            ++p;
+        }
+        exponent += negative_exponent ? -e : e;
+    }
+
+    //The fast path is exact only if both the mantissa and the power of 10 are exactly representable as doubles.
+    if (!exact || mantissa > (1ull << 53) || exponent < -22 || exponent > 22)
+        return obj_parse_float_fallback(start, p, end);
+
+    double value = (double)mantissa;
+    if (exponent < 0)
+        value /= pow10[-exponent];
+    else
+        value *= pow10[exponent];
+
+    //Double rounding check. The sum of 2 neighbouring floats and its half are exact in double precision.
+    float rounded = (float)value;
+    if ((double)rounded != value)
+    {
+        float neighbour = std::nextafter(rounded, ((double)rounded < value) ? INFINITY : -INFINITY);
+        if (value == ((double)rounded + (double)neighbour)/2.0)
+            return obj_parse_float_fallback(start, p, end);
+    }
+
+    return negative ? -rounded : rounded;
+}
+
+//Parse one obj index and convert it to 0-based. Obj indices are either 1-based, or negative, i.e. relative to the end of the
+//elements read so far (-1 is the last one). Relative indices are resolved against 'count', the number of elements parsed so far.
+inline unsigned int obj_parse_index(const char *&p, const char *end, size_t count, bool &relative)
+{
+    p = obj_skip_spaces(p, end);
+    if (p < end && *p == '-')
+    {
+        ++p;
+        relative = true;
+        return (unsigned int)count - obj_parse_uint(p, end);
+    }
+    relative = false;
+    return obj_parse_uint(p, end) - 1;
+}
+
+//Parse one face corner in any of the forms v, v/t, v//n, v/t/n and advance p past it. Indices are converted to 0-based.
+//Bits 0,1,2 of relative_mask are set if the v,t,n index was negative, so that the chunk merge can rebase it later.
+inline obj_corner obj_parse_corner(const char *&p, const char *end, const obj_data &data, unsigned int &relative_mask)
+{
+    obj_corner c = { obj_no_index, obj_no_index, obj_no_index };
+    bool rel;
+    c.v = obj_parse_index(p, end, data.verts.size(), rel);
+    relative_mask = rel ? 1u : 0u;
+    if (p < end && *p == '/')
+    {
+        ++p;
+        if (p < end && *p != '/' && !obj_is_space(*p))
+        {
+            c.t = obj_parse_index(p, end, data.uvs.size(), rel);
+            relative_mask |= rel ? 2u : 0u;
+        }
+        if (p < end && *p == '/')
+        {
+            ++p;
+            c.n = obj_parse_index(p, end, data.norms.size(), rel);
+            relative_mask |= rel ? 4u : 0u;
+        }
+    }
+    return c;
+}
+
+//Append a corner to the triangle list. The slots (3*corner + 0,1,2 for v,t,n) of its negative indices are recorded in 'relative', if given.
+inline void obj_push_corner(obj_data &data, std::vector<size_t> *relative, const obj_corner &c, unsigned int relative_mask)
+{
+    if (relative && relative_mask != 0)
+    {
+        size_t slot = 3*data.corners.size();
+        for (unsigned int k = 0; k < 3; ++k)
+            if (relative_mask & (1u << k))
+                relative->push_back(slot + k);
+    }
+    data.corners.push_back(c);
+}
+
+//Parse the obj records that live in the character range [p, end) and append them to data.
+//Negative face indices are resolved against the elements of data only, so when [p, end) is a chunk in the middle of the file, 'relative'
+//collects them to be rebased on the element counts of the preceding chunks (see obj_parse_chunks()).
+//The attributes a mesh layout does not use are known at compile time. Their lines are skipped without parsing a single number.
+template<bool want_normals = true, bool want_uvs = true>
+void obj_parse_range(const char *p, const char *end, obj_data &data, std::vector<size_t> *relative = nullptr)
+{
+    //Corners of the face being parsed. Reused by every face line, so only the first (and a bigger than ever before) polygon allocates.
+    std::vector<obj_corner> face;
+    std::vector<unsigned int> face_relative;
+
+    while (p < end)
+    {
+        if (p[0] == 'v' && p + 1 < end)
+        {
+            if (obj_is_space(p[1])) //Vertex line.
+            {
+                p += 2;
+                float x = obj_parse_float(p, end);
+                float y = obj_parse_float(p, end);
+                float z = obj_parse_float(p, end);
+                data.verts.push_back(glm::vec3(x,y,z));
+            }
+            else if (p[1] == 'n' && want_normals) //Normal line.
+            {
+                p += 2;
+                float nx = obj_parse_float(p, end);
+                float ny = obj_parse_float(p, end);
+                float nz = obj_parse_float(p, end);
+                data.norms.push_back(glm::vec3(nx,ny,nz));
+            }
+            else if (p[1] == 't' && want_uvs) //Texture coordinates line.
+            {
+                p += 2;
+                float u = obj_parse_float(p, end);
+                float v = obj_parse_float(p, end);
+                data.uvs.push_back(glm::vec2(u,v));
+            }
+        }
+        else if (p[0] == 'f' && p + 1 < end && obj_is_space(p[1])) //Face line.
+        {
+            ++p;
+            face.clear();
+            face_relative.clear();
+            while (true)
+            {
+                p = obj_skip_spaces(p, end);
+                if (p == end || !(obj_is_digit(*p) || *p == '-')) //End of line, comment or garbage.
+                    break;
+                unsigned int relative_mask;
+                face.push_back(obj_parse_corner(p, end, data, relative_mask));
+                face_relative.push_back(relative_mask);
+            }
+
+            //Triangulate as a fan around the first corner. For triangles, this is just the face itself.
+            if (face.size() > 3)
+                data.polygons.push_back({ data.corners.size(), (unsigned int)face.size() });
+            for (size_t i = 1; i + 1 < face.size(); ++i)
+            {
+                obj_push_corner(data, relative, face[0], face_relative[0]);
+                obj_push_corner(data, relative, face[i], face_relative[i]);
+                obj_push_corner(data, relative, face[i+1], face_relative[i+1]);
+            }
+        }
+        p = obj_next_line(p, end); //Anything else (comments, 'o', 'g', 's', 'usemtl', ...) is skipped.
+    }
+}
+
+//Files (or what is left of them per thread) smaller than this are not worth splitting. Spawning a thread costs more than parsing a few hundred kB.
+const size_t obj_min_chunk_size = 256*1024;
+
+//Split [begin, end) at line boundaries into up to num_threads chunks, parse every chunk on its own thread and merge the results in file order.
+//Positive face indices are absolute, so they are valid as they are. Negative ones were resolved per chunk and get the element counts of all preceding chunks added.
+template<bool want_normals = true, bool want_uvs = true>
+void obj_parse_chunks(const char *begin, const char *end, obj_data &data, unsigned int num_threads)
+{
+    size_t size = (size_t)(end - begin);
+    size_t num_chunks = std::min((size_t)num_threads, size/obj_min_chunk_size);
+    if (num_chunks <= 1)
+    {
+        obj_parse_range<want_normals, want_uvs>(begin, end, data);
+        return;
+    }
+
+    //Chunk i is [bounds[i], bounds[i+1]). Every bound (except the last one) is the first character of a line.
+    std::vector<const char *> bounds(num_chunks + 1);
+    bounds[0] = begin;
+    bounds[num_chunks] = end;
+    for (size_t i = 1; i < num_chunks; ++i)
+        bounds[i] = obj_next_line(std::max(begin + i*size/num_chunks, bounds[i-1]), end);
+
+    std::vector<obj_data> chunks(num_chunks);
+    std::vector<std::vector<size_t>> relative(num_chunks);
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < num_chunks; ++i)
+        workers.emplace_back(obj_parse_range<want_normals, want_uvs>, bounds[i], bounds[i+1], std::ref(chunks[i]), &relative[i]);
+    obj_parse_range<want_normals, want_uvs>(bounds[0], bounds[1], chunks[0], &relative[0]); //The calling thread takes the first chunk.
+    for (std::thread &worker : workers)
+        worker.join();
+
+    //Merge. Every output vector is allocated exactly once.
+    size_t num_verts = 0, num_norms = 0, num_uvs = 0, num_corners = 0, num_polygons = 0;
+    for (const obj_data &chunk : chunks)
+    {
+        num_verts += chunk.verts.size();
+        num_norms += chunk.norms.size();
+        num_uvs += chunk.uvs.size();
+        num_corners += chunk.corners.size();
+        num_polygons += chunk.polygons.size();
+    }
+    data.verts.reserve(data.verts.size() + num_verts);
+    data.norms.reserve(data.norms.size() + num_norms);
+    data.uvs.reserve(data.uvs.size() + num_uvs);
+    data.corners.reserve(data.corners.size() + num_corners);
+    data.polygons.reserve(data.polygons.size() + num_polygons);
+
+    for (size_t i = 0; i < num_chunks; ++i)
+    {
+        //Element counts of all preceding chunks, i.e. the offsets of this chunk's elements in the merged vectors.
+        const unsigned int base[3] = { (unsigned int)data.verts.size(), (unsigned int)data.uvs.size(), (unsigned int)data.norms.size() };
+        size_t corner_base = data.corners.size();
+
+        data.verts.insert(data.verts.end(), chunks[i].verts.begin(), chunks[i].verts.end());
+        data.norms.insert(data.norms.end(), chunks[i].norms.begin(), chunks[i].norms.end());
+        data.uvs.insert(data.uvs.end(), chunks[i].uvs.begin(), chunks[i].uvs.end());
+        data.corners.insert(data.corners.end(), chunks[i].corners.begin(), chunks[i].corners.end());
+
+        for (size_t slot : relative[i])
+        {
+            obj_corner &c = data.corners[corner_base + slot/3];
+            unsigned int &index = (slot%3 == 0) ? c.v : ((slot%3 == 1) ? c.t : c.n);
+            index += base[slot%3];
+        }
+
+        //Polygons refer to corners, so they are rebased too.
+        for (const obj_polygon &polygon : chunks[i].polygons)
+            data.polygons.push_back({ corner_base + polygon.first_corner, polygon.num_corners });
+
+        chunks[i] = obj_data(); //Release the chunk's memory as soon as it is merged.
+    }
+}
+
+//Twice the signed area of the 2D triangle abc. Positive if abc is counter clockwise.
+inline float obj_area2(const glm::vec2 &a, const glm::vec2 &b, const glm::vec2 &c)
+{
+    return (b.x - a.x)*(c.y - a.y) - (b.y - a.y)*(c.x - a.x);
+}
+
+inline bool obj_point_in_triangle(const glm::vec2 &p, const glm::vec2 &a, const glm::vec2 &b, const glm::vec2 &c)
+{
+    return obj_area2(a, b, p) >= 0.0f && obj_area2(b, c, p) >= 0.0f && obj_area2(c, a, p) >= 0.0f;
+}
+
+//The parser fans every polygon, which is only right for convex ones. Now that all positions are known, the concave polygons are
+//re-triangulated by ear clipping. A polygon always has num_corners - 2 triangles, so its fan is overwritten in place and nothing else moves.
+inline void obj_triangulate_polygons(obj_data &data)
+{
+    std::vector<obj_corner> ring; //Scratch buffers, shared by all polygons.
+    std::vector<glm::vec2> projected;
+    std::vector<unsigned int> remaining;
+
+    for (const obj_polygon &polygon : data.polygons)
+    {
+        obj_corner *tris = &data.corners[polygon.first_corner];
+        const unsigned int n = polygon.num_corners;
+
+        //Recover the polygon's corners from its fan (c0,c1,c2, c0,c2,c3, ...).
+        ring.assign(tris, tris + 2);
+        for (unsigned int i = 0; i < n - 2; ++i)
+            ring.push_back(tris[3*i + 2]);
+        bool valid = true;
+        for (const obj_corner &c : ring)
+            valid = valid && c.v < data.verts.size();
+        if (!valid)
+            continue; //Reported by obj_check_indices().
+
+        //Newell's normal of the polygon, which is robust for non planar and concave polygons.
+        glm::vec3 normal(0.0f);
+        for (unsigned int i = 0; i < n; ++i)
+        {
+            const glm::vec3 &a = data.verts[ring[i].v], &b = data.verts[ring[(i + 1)%n].v];
+            normal += glm::vec3((a.y - b.y)*(a.z + b.z), (a.z - b.z)*(a.x + b.x), (a.x - b.x)*(a.y + b.y));
+        }
+
+        //Project the polygon on the coordinate plane it is most parallel to, mirrored if needed, so that it is counter clockwise in 2D.
+        glm::vec3 abs_normal = glm::abs(normal);
+        int axis = (abs_normal.x > abs_normal.y && abs_normal.x > abs_normal.z) ? 0 : ((abs_normal.y > abs_normal.z) ? 1 : 2);
+        float mirror = (normal[axis] < 0.0f) ? -1.0f : 1.0f;
+        projected.clear();
+        for (const obj_corner &c : ring)
+        {
+            const glm::vec3 &v = data.verts[c.v];
+            projected.push_back(glm::vec2(mirror*v[(axis + 1)%3], v[(axis + 2)%3]));
+        }
+
+        //Convex polygons keep their fan.
+        bool convex = true;
+        for (unsigned int i = 0; i < n && convex; ++i)
+            convex = obj_area2(projected[(i + n - 1)%n], projected[i], projected[(i + 1)%n]) >= 0.0f;
+        if (convex)
+            continue;
+
+        //Ear clipping : repeatedly cut off a convex corner whose triangle contains no other corner.
+        remaining.clear();
+        for (unsigned int i = 0; i < n; ++i)
+            remaining.push_back(i);
+        obj_corner *out = tris;
+        while (remaining.size() > 3)
+        {
+            size_t m = remaining.size(), ear = m;
+            for (size_t i = 0; i < m && ear == m; ++i)
+            {
+                unsigned int a = remaining[(i + m - 1)%m], b = remaining[i], c = remaining[(i + 1)%m];
+                if (obj_area2(projected[a], projected[b], projected[c]) <= 0.0f)
+                    continue; //Reflex (or degenerate) corner.
+                bool empty = true;
+                for (unsigned int k : remaining)
+                    if (k != a && k != b && k != c && obj_point_in_triangle(projected[k], projected[a], projected[b], projected[c]))
+                    {
+                        empty = false;
+                        break;
+                    }
+                if (empty)
+                    ear = i;
+            }
+            if (ear == m)
+                ear = 0; //Self intersecting polygon, there are no proper ears. Cut anyway, so that the face count stays right.
+
+            *out++ = ring[remaining[(ear + m - 1)%m]];
+            *out++ = ring[remaining[ear]];
+            *out++ = ring[remaining[(ear + 1)%m]];
+            remaining.erase(remaining.begin() + ear);
+        }
+        *out++ = ring[remaining[0]];
+        *out++ = ring[remaining[1]];
+        *out++ = ring[remaining[2]];
+    }
+}
+
+//Make sure that every corner references existing elements. Positions cannot be made up, so false is returned if a position index is invalid.
+//Missing or invalid normal/uv indices (e.g. 'f 1 2 3' lines in a file that is loaded with normals) are pointed at an extra, default element
+//(zero normal, zero uv) that is appended for them. num_defaulted is the number of corners that needed it.
+template<bool want_normals, bool want_uvs>
+bool obj_check_indices(obj_data &data, size_t &num_defaulted)
+{
+    const size_t num_verts = data.verts.size(), num_norms = data.norms.size(), num_uvs = data.uvs.size();
+    bool missing_norms = false, missing_uvs = false;
+    num_defaulted = 0;
+    for (obj_corner &c : data.corners)
+    {
+        if (c.v >= num_verts)
+            return false;
+
+        bool defaulted = false;
+        if constexpr (want_normals)
+        {
+            if (c.n >= num_norms)
+            {
+                c.n = (unsigned int)num_norms;
+                missing_norms = defaulted = true;
+            }
+        }
+        if constexpr (want_uvs)
+        {
+            if (c.t >= num_uvs)
+            {
+                c.t = (unsigned int)num_uvs;
+                missing_uvs = defaulted = true;
+            }
+        }
+        num_defaulted += defaulted ? 1 : 0;
+    }
+    if (missing_norms)
+        data.norms.push_back(glm::vec3(0.0f));
+    if (missing_uvs)
+        data.uvs.push_back(glm::vec2(0.0f));
+    return true;
+}
+
+//Parse an already mapped obj file. num_threads = 0 means one thread per hardware thread.
+//Large files are split among the threads, small files are parsed on the calling thread.
+//want_normals/want_uvs = false leaves data.norms/data.uvs empty (the face indices that reference them are still read).
+template<bool want_normals = true, bool want_uvs = true>
+void obj_parse(const mapped_file &file, obj_data &data, unsigned int num_threads = 0)
+{
+    if (num_threads == 0)
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    if (file.size() > 0)
+        obj_parse_chunks<want_normals, want_uvs>(file.data(), file.end(), data, num_threads);
+    obj_triangulate_polygons(data);
+}
+
+//Map the obj file into memory and parse it. Returns false if the file could not be opened.
+template<bool want_normals = true, bool want_uvs = true>
+bool obj_load(const char *obj_path, obj_data &data, unsigned int num_threads = 0)
+{
+    mapped_file file(obj_path);
+    if (!file.is_open())
+        return false;
+
+    obj_parse<want_normals, want_uvs>(file, data, num_threads);
+    return true;
+}
+
+#endif
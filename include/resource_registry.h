@@ -0,0 +1,295 @@
+#ifndef RESOURCE_REGISTRY_H
+#define RESOURCE_REGISTRY_H
+
+#include<cstdio>
+#include<cstdint>
+#include<filesystem>
+#include<initializer_list>
+#include<memory>
+#include<string>
+#include<system_error>
+#include<unordered_map>
+
+#include"mesh.h"
+
+//Deduplication of mesh and texture loads. Demos that construct their meshes one by one load the same obj or image file as many times as
+//they ask for it (e.g. 1 cube geometry with 2 different textures is parsed and uploaded twice). The registry hands out shared, reference
+//counted meshes instead, and remembers what it loaded at 3 levels :
+//- Whole meshes (same obj, same image, same flags) : the very same mesh object is returned.
+//- Geometry (same obj, same buffer flags) : a new mesh that shares the vao/vbo/ebo of the one already loaded.
+//- Textures (same image) : a new mesh that shares the texture object.
+//Resources are identified by their canonical path (so "../obj/a.obj" and "../obj/./a.obj" are the same file) plus a hash of their
+//content (so a file edited on disk is loaded again), which is only computed again when the file's size or modification time changes. The registry only keeps weak references : the gpu objects are freed when the last
+//mesh that uses them is destroyed, not when the registry is. Like every OpenGL call, it must be used on the main thread.
+//prefetch_images() decodes the images of a whole scene concurrently (see image_batch.h), so that the get() calls only upload them.
+//
+//Usage :
+//    resource_registry registry;
+//    std::shared_ptr<meshvft> brick_cube = registry.get<meshvft>("../obj/vft/cube1x1x1_correct_uv.obj", "../images/texture/red_brick_diff_2k.jpg");
+//    brick_cube->draw_triangles();
+
+
+
+//Hit/miss counters of a resource_registry.
+struct resource_registry_stats
+{
+    unsigned int mesh_hits, mesh_misses; //Requests answered with an existing mesh / that created a new mesh.
+    unsigned int geometry_hits, geometry_loads; //New meshes that shared existing buffers / loaded the obj file (or its cache file).
+    unsigned int texture_hits, texture_loads; //New meshes that shared an existing texture / decoded the image file.
+    size_t bytes_saved; //Gpu memory that the hits did not allocate again.
+};
+
+class resource_registry
+{
+private:
+    //What a new mesh needs to share the gpu buffers of a mesh that is already loaded.
+    struct geometry_entry
+    {
+        std::weak_ptr<mesh_buffers> buffers;
+        unsigned int num_inds;
+        mesh_lod_chain lods;
+        std::vector<mesh_meshlet> meshlets;
+        GLenum index_type;
+        bool quantized;
+        mesh_bounds bounds;
+    };
+
+    std::unordered_map<std::string, std::weak_ptr<void>> meshes; //The mesh type is part of the key, so the stored pointer is always of that type.
+    std::unordered_map<std::string, geometry_entry> geometries;
+    std::unordered_map<std::string, std::weak_ptr<mesh_texture>> textures;
+    image_batch prefetch_batch; //Images decoded ahead of the get() calls that use them (see prefetch_images()).
+    std::unordered_map<std::string, size_t> prefetched; //Texture key -> index in prefetch_batch, until a get() takes the image.
+    resource_registry_stats stats;
+
+    //Canonical path + content hash of a file, i.e. its part of the registry keys.
+    struct file_key_entry
+    {
+        std::string key;
+        uint64_t hash; //mesh_cache_hash() of the content.
+        uintmax_t size;
+        std::filesystem::file_time_type mtime;
+    };
+    std::unordered_map<std::string, file_key_entry> file_keys; //Canonical path -> key, so that the files are only hashed again when they change.
+
+    //The key of a file. The content is hashed the first time only, and again when the file's size or modification time changes, so that
+    //hits (e.g. the same mesh asked for in a loop) do not map and read whole obj and image files. Exits if the file does not exist, like the
+    //mesh constructors.
+    const file_key_entry &file_key(const char *path)
+    {
+        std::error_code error;
+        uintmax_t size = std::filesystem::file_size(path, error);
+        std::filesystem::file_time_type mtime;
+        if (!error)
+            mtime = std::filesystem::last_write_time(path, error);
+        if (error)
+        {
+            fprintf(stderr, "Error : File '%s' was not found. Exiting...\n", path);
+            exit(EXIT_FAILURE);
+        }
+
+        std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+        std::string name = error ? std::string(path) : canonical.generic_string();
+        file_key_entry &entry = file_keys[name];
+        if (!entry.key.empty() && entry.size == size && entry.mtime == mtime)
+            return entry;
+
+        mapped_file file(path);
+        if (!file.is_open())
+        {
+            fprintf(stderr, "Error : File '%s' was not found. Exiting...\n", path);
+            exit(EXIT_FAILURE);
+        }
+        char hash[32];
+        entry.hash = mesh_cache_hash(file.data(), file.size());
+        snprintf(hash, sizeof(hash), "|%016llx", (unsigned long long)entry.hash);
+        entry.key = name + hash;
+        entry.size = size;
+        entry.mtime = mtime;
+        return entry;
+    }
+
+    //A compressed and an uncompressed texture of the same image are different textures.
+    std::string texture_file_key(const char *img_path, unsigned int flags)
+    {
+        return file_key(img_path).key + ((flags & mesh_compress_texture) ? "|compressed" : "");
+    }
+
+    //Drop the entries whose resources are gone.
+    void prune()
+    {
+        for (auto it = meshes.begin(); it != meshes.end(); )
+            it = it->second.expired() ? meshes.erase(it) : std::next(it);
+        for (auto it = geometries.begin(); it != geometries.end(); )
+            it = it->second.buffers.expired() ? geometries.erase(it) : std::next(it);
+        for (auto it = textures.begin(); it != textures.end(); )
+            it = it->second.expired() ? textures.erase(it) : std::next(it);
+    }
+
+    template<typename mesh_type>
+    std::shared_ptr<mesh_type> acquire(const char *obj_path, const char *img_path, unsigned int flags, std::shared_ptr<mesh_texture> given_texture = nullptr)
+    {
+        typedef typename mesh_type::layout_type layout;
+        const file_key_entry &obj_key = file_key(obj_path);
+        uint64_t obj_hash = obj_key.hash;
+        std::string geometry_key = std::to_string(layout::cache_layout) + "|" + std::to_string(flags & mesh_buffer_flags) + "|" + obj_key.key;
+        std::string texture_key = (img_path != nullptr) ? texture_file_key(img_path, flags) : std::string();
+        if (given_texture)
+        {
+            char address[32];
+            snprintf(address, sizeof(address), "given|%p", (void*)given_texture.get()); //The texture object itself is the key.
+            texture_key = address;
+        }
+        std::string mesh_key = geometry_key + "|" + std::to_string(flags) + "|" + texture_key;
+
+        std::weak_ptr<void> &mesh_entry = meshes[mesh_key];
+        if (std::shared_ptr<void> existing = mesh_entry.lock())
+        {
+            std::shared_ptr<mesh_type> m = std::static_pointer_cast<mesh_type>(existing);
+            ++stats.mesh_hits;
+            stats.bytes_saved += m->get_gpu_memory_bytes();
+            return m;
+        }
+        ++stats.mesh_misses;
+
+        std::shared_ptr<mesh_type> m(new mesh_type());
+        mesh_staging staging;
+
+        //Geometry. A shared geometry comes without cpu copies of the mesh data (they stay with the mesh that loaded it).
+        geometry_entry &geometry = geometries[geometry_key];
+        if (std::shared_ptr<mesh_buffers> buffers = geometry.buffers.lock())
+        {
+            m->buffers = buffers;
+            m->num_inds = geometry.num_inds;
+            m->lods = geometry.lods;
+            m->meshlets = geometry.meshlets;
+            m->index_type = geometry.index_type;
+            m->quantized = geometry.quantized;
+            m->bounds = geometry.bounds;
+            ++stats.geometry_hits;
+            stats.bytes_saved += buffers->bytes;
+        }
+        else
+        {
+            m->prepare(obj_path, flags, staging, &obj_hash); //The obj file was hashed for its key already.
+            ++stats.geometry_loads;
+        }
+
+        //Texture.
+        std::shared_ptr<mesh_texture> texture = given_texture;
+        if (img_path != nullptr)
+        {
+            texture = textures[texture_key].lock();
+            if (texture)
+            {
+                ++stats.texture_hits;
+                stats.bytes_saved += texture->bytes;
+            }
+            else
+            {
+                std::unordered_map<std::string, size_t>::iterator image = prefetched.find(texture_key);
+                if (image != prefetched.end())
+                {
+                    m->take_texture(prefetch_batch[image->second], staging);
+                    prefetched.erase(image);
+                }
+                else
+                    m->prepare_texture(img_path, flags, staging);
+                ++stats.texture_loads;
+            }
+        }
+
+        //Upload whatever was not shared.
+        if (!m->buffers)
+            m->upload(staging, flags);
+        else if (staging.has_image())
+            m->upload_texture(staging);
+        if (texture)
+            m->texture = texture;
+
+        geometry.buffers = m->buffers;
+        geometry.num_inds = m->num_inds;
+        geometry.lods = m->lods;
+        geometry.meshlets = m->meshlets;
+        geometry.index_type = m->index_type;
+        geometry.quantized = m->quantized;
+        geometry.bounds = m->bounds;
+        if (img_path != nullptr)
+            textures[texture_key] = m->texture;
+        mesh_entry = m;
+        return m;
+    }
+
+public:
+    resource_registry()
+    {
+        stats = resource_registry_stats();
+    }
+
+    resource_registry(const resource_registry &) = delete;
+    resource_registry &operator=(const resource_registry &) = delete;
+
+    //Shared mesh of a layout without uvs. flags is a combination of mesh_load_flags, like for the mesh constructors.
+    template<typename mesh_type>
+    std::shared_ptr<mesh_type> get(const char *obj_path, unsigned int flags = 0)
+    {
+        static_assert(!mesh_type::layout_type::has_uvs, "Meshes with uvs need an image path.");
+        return acquire<mesh_type>(obj_path, nullptr, flags);
+    }
+
+    //Shared mesh of a layout with uvs, with its image.
+    template<typename mesh_type>
+    std::shared_ptr<mesh_type> get(const char *obj_path, const char *img_path, unsigned int flags = 0)
+    {
+        static_assert(mesh_type::layout_type::has_uvs, "Only meshes with uvs have an image.");
+        return acquire<mesh_type>(obj_path, img_path, flags);
+    }
+
+    //Shared mesh of a layout with uvs, with a texture that is loaded elsewhere, e.g. streamed in by a texture_streamer (see texture_streamer.h).
+    //Only the geometry is shared through the registry, the texture is the caller's.
+    template<typename mesh_type>
+    std::shared_ptr<mesh_type> get(const char *obj_path, std::shared_ptr<mesh_texture> texture, unsigned int flags = 0)
+    {
+        static_assert(mesh_type::layout_type::has_uvs, "Only meshes with uvs have a texture.");
+        return acquire<mesh_type>(obj_path, nullptr, flags, std::move(texture));
+    }
+
+    //Decode the images of a scene all at once on worker threads, before the get() calls that use them. Each get() then only uploads
+    //its texture, instead of decoding it first. Images that are already loaded, or already prefetched, are skipped.
+    //flags must match the get() calls (only mesh_compress_texture matters), otherwise they decode their images again.
+    void prefetch_images(std::initializer_list<const char*> img_paths, unsigned int flags = 0, unsigned int num_threads = 0)
+    {
+        for (const char *img_path : img_paths)
+        {
+            std::string texture_key = texture_file_key(img_path, flags);
+            std::unordered_map<std::string, std::weak_ptr<mesh_texture>>::iterator texture = textures.find(texture_key);
+            if ((texture != textures.end() && !texture->second.expired()) || prefetched.count(texture_key) != 0)
+                continue;
+            prefetched[texture_key] = prefetch_batch.add(img_path, true, (flags & mesh_compress_texture) != 0); //Flipped, like mesh::prepare_texture().
+        }
+        prefetch_batch.decode(num_threads);
+    }
+
+    //Decode timings of the prefetched images.
+    const image_batch &get_prefetch_batch() const
+    {
+        return prefetch_batch;
+    }
+
+    const resource_registry_stats &get_stats() const
+    {
+        return stats;
+    }
+
+    //Print the counters and what is still alive.
+    void print_stats()
+    {
+        prune();
+        printf("Resource registry : meshes %u hits / %u misses, geometry %u shared / %u loaded, textures %u shared / %u loaded, %.1f MB of gpu memory saved.\n",
+               stats.mesh_hits, stats.mesh_misses, stats.geometry_hits, stats.geometry_loads, stats.texture_hits, stats.texture_loads, stats.bytes_saved/(1024.0*1024.0));
+        printf("                    %u meshes, %u geometries and %u textures alive.\n", (unsigned int)meshes.size(), (unsigned int)geometries.size(), (unsigned int)textures.size());
+        if (prefetch_batch.size() > 0)
+            prefetch_batch.print_timings("Resource registry (prefetched images)");
+    }
+};
+
+#endif
@@ -8,10 +8,12 @@
 #include<fstream>
 #include<string>
 
+#include"gl_handle.h"
+
 class shader
 {
 private:
-    unsigned int ID; //Shader program ID. With this, we recognize which shader to use.
+    gl_program ID; //Shader program ID. With this, we recognize which shader to use.
 
 public:
     //Parse and read the vertex and fragment shader source files. Then compile both. Then link.
@@ -30,15 +32,15 @@ public:
         const char *vsource = vtemp.c_str();
         
         //Compile the vertex shader and check for errors.
-        unsigned vshader = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vshader, 1, &vsource, NULL);
-        glCompileShader(vshader);
+        gl_shader vshader(glCreateShader(GL_VERTEX_SHADER));
+        glShaderSource(vshader.get(), 1, &vsource, NULL);
+        glCompileShader(vshader.get());
         int success;
         char infolog[1024];
-        glGetShaderiv(vshader, GL_COMPILE_STATUS, &success);
+        glGetShaderiv(vshader.get(), GL_COMPILE_STATUS, &success);
         if (!success)
         {
-            glGetShaderInfoLog(vshader, 1024, NULL, infolog);
+            glGetShaderInfoLog(vshader.get(), 1024, NULL, infolog);
             fprintf(stderr, "Error while compiling '%s'.\n", vpath);
             fprintf(stderr, "%s\n", infolog);
         }
@@ -56,46 +58,84 @@ public:
         const char *fsource = ftemp.c_str();
         
         //Compile the fragment shader and check for errors.
-        unsigned fshader = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fshader, 1, &fsource, NULL);
-        glCompileShader(fshader);
-        glGetShaderiv(fshader, GL_COMPILE_STATUS, &success);
+        gl_shader fshader(glCreateShader(GL_FRAGMENT_SHADER));
+        glShaderSource(fshader.get(), 1, &fsource, NULL);
+        glCompileShader(fshader.get());
+        glGetShaderiv(fshader.get(), GL_COMPILE_STATUS, &success);
         if (!success)
         {
-            glGetShaderInfoLog(fshader, 1024, NULL, infolog);
+            glGetShaderInfoLog(fshader.get(), 1024, NULL, infolog);
             fprintf(stderr, "Error while compiling '%s'.\n", fpath);
             fprintf(stderr, "%s\n", infolog);
         }
         
         //Handle linking.
-        ID = glCreateProgram();
-        glAttachShader(ID, vshader);
-        glAttachShader(ID, fshader);
-        glLinkProgram(ID);
-        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        ID = gl_program::create();
+        glAttachShader(ID.get(), vshader.get());
+        glAttachShader(ID.get(), fshader.get());
+        glLinkProgram(ID.get());
+        glGetProgramiv(ID.get(), GL_LINK_STATUS, &success);
         if (!success)
         {
-            glGetProgramInfoLog(ID, 1024, NULL, infolog);
+            glGetProgramInfoLog(ID.get(), 1024, NULL, infolog);
             fprintf(stderr, "Error while linking shader program ('%s' || '%s').\n", vpath, fpath);
             fprintf(stderr, "%s\n", infolog);
         }
         
-        //We no longer need the vshader and fshader, so let's delete them from now.
-        //We DO need however the ID, which will be kept for deletion in the destructor.
-        glDeleteShader(vshader);
-        glDeleteShader(fshader);
+        //We no longer need the vshader and fshader, so their handles delete them when the constructor returns.
+        //We DO need however the ID, whose handle deletes the program when the shader is destroyed.
     }
 
-    //Delete the shader.
-    ~shader()
+    //Parse and read a compute shader source file. Then compile it. Then link. Run it with use() and glDispatchCompute(...).
+    explicit shader(const char *cpath)
     {
-        glDeleteProgram(ID);
+        //Read the compute shader source code from its file.
+        std::ifstream fpcompute(cpath);
+        if (!fpcompute.is_open())
+        {
+            fprintf(stderr, "Error : '%s' not found. Exiting...\n", cpath);
+            exit(EXIT_FAILURE);
+        }
+
+        std::string ctemp;
+        ctemp.assign( (std::istreambuf_iterator<char>(fpcompute)), (std::istreambuf_iterator<char>()) );
+        const char *csource = ctemp.c_str();
+
+        //Compile the compute shader and check for errors.
+        gl_shader cshader(glCreateShader(GL_COMPUTE_SHADER));
+        glShaderSource(cshader.get(), 1, &csource, NULL);
+        glCompileShader(cshader.get());
+        int success;
+        char infolog[1024];
+        glGetShaderiv(cshader.get(), GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            glGetShaderInfoLog(cshader.get(), 1024, NULL, infolog);
+            fprintf(stderr, "Error while compiling '%s'.\n", cpath);
+            fprintf(stderr, "%s\n", infolog);
+        }
+
+        //Handle linking.
+        ID = gl_program::create();
+        glAttachShader(ID.get(), cshader.get());
+        glLinkProgram(ID.get());
+        glGetProgramiv(ID.get(), GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            glGetProgramInfoLog(ID.get(), 1024, NULL, infolog);
+            fprintf(stderr, "Error while linking shader program ('%s').\n", cpath);
+            fprintf(stderr, "%s\n", infolog);
+        }
     }
+
+    //Shaders can be moved (e.g. stored by value in a std::vector) but not copied : only 1 shader owns a program.
+    shader(shader &&) noexcept = default;
+    shader &operator=(shader &&) noexcept = default;
     
     //Activate the current shader.
     void use()
     {
-        glUseProgram(ID);
+        glUseProgram(ID.get());
     }
 
     //The following member functions are used to pass uniform variables to the shaders from the main code.
@@ -103,77 +143,77 @@ public:
     //Pass to the currently active shader 1 int (uniform).
     void set_int_uniform(const std::string &name, int value)
     {
-        unsigned location = glGetUniformLocation(ID, name.c_str());
+        unsigned location = glGetUniformLocation(ID.get(), name.c_str());
         glUniform1i(location, value);
     }
     
     //Pass to the currently active shader 1 float (uniform).
     void set_float_uniform(const std::string &name, float value)
     {
-        unsigned location = glGetUniformLocation(ID, name.c_str());
+        unsigned location = glGetUniformLocation(ID.get(), name.c_str());
         glUniform1f(location, value);
     }
     
     //Pass to the currently active shader 2 floats (uniform).
     void set_vec2_uniform(const std::string &name, float x, float y)
     {
-        unsigned location = glGetUniformLocation(ID, name.c_str());
+        unsigned location = glGetUniformLocation(ID.get(), name.c_str());
         glUniform2f(location, x,y);
     }
     
     //Pass to the currently active shader 1 vector of 2 floats (uniform).
     void set_vec2_uniform(const std::string &name, glm::vec2 &v)
     {
-        unsigned location = glGetUniformLocation(ID, name.c_str());
+        unsigned location = glGetUniformLocation(ID.get(), name.c_str());
         glUniform2fv(location, 1, &v[0]);
     }
     
     //Pass to the currently active shader 3 floats (uniform).
     void set_vec3_uniform(const std::string &name, float x, float y, float z)
     {
-        unsigned location = glGetUniformLocation(ID, name.c_str());
+        unsigned location = glGetUniformLocation(ID.get(), name.c_str());
         glUniform3f(location, x,y,z);
     }
     
     //Pass to the currently active shader 1 vector of 3 floats (uniform).
     void set_vec3_uniform(const std::string &name, glm::vec3 &v)
     {
-        unsigned location = glGetUniformLocation(ID, name.c_str());
+        unsigned location = glGetUniformLocation(ID.get(), name.c_str());
         glUniform3fv(location, 1, &v[0]);
     }
     
     //Pass to the currently active shader 4 floats (uniform).
     void set_vec4_uniform(const std::string &name, float x, float y, float z, float w)
     {
-        unsigned location = glGetUniformLocation(ID, name.c_str());
+        unsigned location = glGetUniformLocation(ID.get(), name.c_str());
         glUniform4f(location, x,y,z,w);
     }
     
     //Pass to the currently active shader 1 vector of 4 floats (uniform).
     void set_vec4_uniform(const std::string &name, glm::vec4 &v)
     {
-        unsigned location = glGetUniformLocation(ID, name.c_str());
+        unsigned location = glGetUniformLocation(ID.get(), name.c_str());
         glUniform4fv(location, 1, &v[0]);
     }
     
     //Pass to the currently active shader 1 2x2 float matrix (uniform).
     void set_mat2_uniform(const std::string &name, glm::mat2 &m)
     {
-        unsigned location = glGetUniformLocation(ID, name.c_str());
+        unsigned location = glGetUniformLocation(ID.get(), name.c_str());
         glUniformMatrix2fv(location, 1, GL_FALSE, &m[0][0]);
     }
     
     //Pass to the currently active shader 1 3x3 float matrix (uniform).
     void set_mat3_uniform(const std::string &name, glm::mat3 &m)
     {
-        unsigned location = glGetUniformLocation(ID, name.c_str());
+        unsigned location = glGetUniformLocation(ID.get(), name.c_str());
         glUniformMatrix3fv(location, 1, GL_FALSE, &m[0][0]);
     }
     
     //Pass to the currently active shader 1 4x4 float matrix (uniform).
     void set_mat4_uniform(const std::string &name, glm::mat4 &m)
     {
-        unsigned location = glGetUniformLocation(ID, name.c_str());
+        unsigned location = glGetUniformLocation(ID.get(), name.c_str());
         glUniformMatrix4fv(location, 1, GL_FALSE, &m[0][0]);
     }
 };
@@ -0,0 +1,351 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include<GL/glew.h>
+#include<algorithm>
+#include<chrono>
+#include<cstdio>
+#include<cstdlib>
+#include<memory>
+#include<string>
+#include<vector>
+
+#include"mesh.h"
+#include"image_batch.h"
+#include"texture_compress.h"
+#include"texture_streamer.h"
+
+//The textures of a scene packed in 1 GL_TEXTURE_2D_ARRAY. Meshes with their own textures bind a texture per draw call (and unbind it
+//after), so a textured scene cannot be drawn without texture switches in between. The layers of an array all have the same size : the
+//size of the smallest image (or of its largest mip level that fits the size asked for), so a 4096x4096 and a 512x512 image make 512x512
+//layers. The images are never upscaled (that costs memory, adds no detail, and could not use the compressed caches), only box filtered
+//down by halves like their mipmaps, or resampled down if the layer size is not 1 of their mip levels (e.g. 718x718 into 512x512 layers).
+//Each layer keeps its own mipmaps and wraps on its own, so tiling uvs and mipmapping work like with separate textures (which an atlas of
+//rectangles would not allow).
+//add() returns the layer as a mesh_texture (see mesh.h) for the mesh constructors and resource_registry::get(). Such meshes do not bind
+//anything when they draw : bind() the array once, and set the layer uniform of texture_array.frag per draw (get_texture_layer()).
+//build() uploads the layers, either :
+//- uncompressed (rgba), decoded concurrently (see image_batch.h),
+//- block compressed with mesh_compress_texture (see texture_cache.h). A cached image is uploaded from the level of its mip chain that
+//  has the layer size on, as it is. Images without such a level are resized and compressed again on every build (not cached). If
+//  any image needs alpha (BC3), the BC1 images are converted to BC3 too, losslessly, because an array has 1 format.
+//- or streamed in over several frames by a texture_streamer (uncompressed).
+//
+//Usage :
+//    texture_array textures(2048, 2048);
+//    resource_registry registry;
+//    std::shared_ptr<meshvft> brick_cube = registry.get<meshvft>("../obj/vft/cube1x1x1_correct_uv.obj", textures.add("../images/texture/red_brick_diff_2k.jpg"));
+//    textures.build(mesh_compress_texture);
+//    shader texshad("../shaders/vertex/trans_mvp_texture.vert", "../shaders/fragment/texture_array.frag");
+//    while (...)
+//    {
+//        textures.bind();
+//        texshad.set_int_uniform("layer", (int)brick_cube->get_texture_layer());
+//        brick_cube->draw_triangles();
+//    }
+
+
+
+class texture_array
+{
+private:
+    std::shared_ptr<mesh_texture> array;
+    std::vector<std::shared_ptr<mesh_texture>> layers; //The layers handed out by add(), in layer order.
+    std::vector<std::string> paths; //The image of each layer.
+    int max_width, max_height; //Largest layer size asked for.
+    int layer_width, layer_height; //Chosen when the array is built.
+    bool flip;
+    bool built;
+    uint32_t block_format; //texture_block_format of compressed arrays.
+    bool compressed;
+    unsigned int num_resized; //Images that had to be resampled, because they have no mip level of the layer size.
+    float build_ms;
+
+    //Allocate the storage of all the layers and their mipmaps.
+    void allocate(GLenum internal_format)
+    {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array->tex.get());
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, (GLsizei)texture_num_levels(layer_width, layer_height), internal_format, layer_width, layer_height, (GLsizei)layers.size());
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    //Bytes of 1 rgba layer and its mipmaps.
+    size_t rgba_chain_bytes() const
+    {
+        size_t bytes = 0;
+        for (uint32_t level = 0; level < texture_num_levels(layer_width, layer_height); ++level)
+            bytes += (size_t)texture_level_dim(layer_width, level)*texture_level_dim(layer_height, level)*4;
+        return bytes;
+    }
+
+    //Whether the mip chain of a width x height image has a level of level_width x level_height.
+    static bool has_level(uint32_t width, uint32_t height, uint32_t level_width, uint32_t level_height)
+    {
+        for (uint32_t level = 0; level < texture_num_levels(width, height); ++level)
+        {
+            if (texture_level_dim(width, level) == level_width && texture_level_dim(height, level) == level_height)
+                return true;
+        }
+        return false;
+    }
+
+    void start_build()
+    {
+        if (built)
+        {
+            fprintf(stderr, "Error : A texture array was built twice. Exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+        if (layers.empty())
+        {
+            fprintf(stderr, "Error : A texture array was built without images. Exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+        built = true;
+        choose_layer_size();
+    }
+
+    //Every image counts with the largest level of its mip chain that fits the size asked for, and the layers get the smallest of those.
+    //Only the image headers are read.
+    void choose_layer_size()
+    {
+        layer_width = max_width;
+        layer_height = max_height;
+        for (const std::string &path : paths)
+        {
+            int width, height, channels;
+            if (!stbi_info(path.c_str(), &width, &height, &channels))
+            {
+                fprintf(stderr, "Error : File '%s' was not found. Exiting...\n", path.c_str());
+                exit(EXIT_FAILURE);
+            }
+            uint32_t level = 0;
+            while (level + 1 < texture_num_levels((uint32_t)width, (uint32_t)height) &&
+                   (texture_level_dim((uint32_t)width, level) > (uint32_t)max_width || texture_level_dim((uint32_t)height, level) > (uint32_t)max_height))
+                ++level;
+            layer_width = std::min(layer_width, (int)texture_level_dim((uint32_t)width, level));
+            layer_height = std::min(layer_height, (int)texture_level_dim((uint32_t)height, level));
+        }
+    }
+
+    static void check_loaded(const decoded_image &image)
+    {
+        if (!image.loaded())
+        {
+            fprintf(stderr, "Error : File '%s' was not found. Exiting...\n", image.path.c_str());
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    void build_uncompressed(unsigned int num_threads)
+    {
+        image_batch batch;
+        for (const std::string &path : paths)
+            batch.add(path.c_str(), flip);
+        batch.decode(num_threads);
+
+        allocate(GL_RGBA8);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        std::vector<unsigned char> rgba, resized;
+        for (size_t layer = 0; layer < batch.size(); ++layer)
+        {
+            decoded_image &image = batch[layer];
+            check_loaded(image);
+            texture_expand_rgba(image.data, (uint32_t)image.width, (uint32_t)image.height, image.channels, rgba);
+            stbi_image_free(image.release());
+            if (image.width != layer_width || image.height != layer_height)
+            {
+                texture_resample(rgba.data(), (uint32_t)image.width, (uint32_t)image.height, (uint32_t)layer_width, (uint32_t)layer_height, resized);
+                rgba.swap(resized);
+                if (!has_level((uint32_t)image.width, (uint32_t)image.height, (uint32_t)layer_width, (uint32_t)layer_height))
+                    ++num_resized;
+            }
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, (GLint)layer, layer_width, layer_height, 1, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+        }
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        array->bytes = rgba_chain_bytes()*layers.size();
+    }
+
+    void build_compressed(unsigned int num_threads)
+    {
+        if (!GLEW_EXT_texture_compression_s3tc)
+        {
+            fprintf(stderr, "Error : The gpu does not support S3TC (BC1/BC3) compressed textures. Load without mesh_compress_texture. Exiting...\n");
+            exit(EXIT_FAILURE);
+        }
+
+        image_batch batch;
+        for (const std::string &path : paths)
+            batch.add(path.c_str(), flip, true);
+        batch.decode(num_threads);
+
+        block_format = texture_bc1;
+        for (size_t layer = 0; layer < batch.size(); ++layer)
+        {
+            check_loaded(batch[layer]);
+            if (batch[layer].compressed.format == texture_bc3)
+                block_format = texture_bc3;
+        }
+        GLenum internal_format = (block_format == texture_bc3) ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        allocate(internal_format);
+
+        uint32_t num_levels = texture_num_levels(layer_width, layer_height);
+        for (size_t layer = 0; layer < batch.size(); ++layer)
+        {
+            const compressed_texture &texture = batch[layer].compressed;
+
+            //The level of the cached mip chain that has the layer size, if there is one.
+            uint32_t first_level = 0;
+            while (first_level < texture.num_levels && (texture_level_dim(texture.width, first_level) != (uint32_t)layer_width ||
+                                                         texture_level_dim(texture.height, first_level) != (uint32_t)layer_height))
+                ++first_level;
+
+            std::vector<unsigned char> recompressed;
+            uint32_t format = texture.format;
+            const unsigned char *blocks = nullptr;
+            if (first_level < texture.num_levels)
+                blocks = texture.data + texture.level_offset(first_level);
+            else
+            {
+                //Decode the image again, resize it and compress the result. The cache only has the image's own size.
+                int width, height, channels;
+                stbi_set_flip_vertically_on_load_thread(flip);
+                unsigned char *pixels = stbi_load(batch[layer].path.c_str(), &width, &height, &channels, 4);
+                if (!pixels)
+                {
+                    fprintf(stderr, "Error : File '%s' was not found. Exiting...\n", batch[layer].path.c_str());
+                    exit(EXIT_FAILURE);
+                }
+                std::vector<unsigned char> resized;
+                texture_resample(pixels, (uint32_t)width, (uint32_t)height, (uint32_t)layer_width, (uint32_t)layer_height, resized);
+                stbi_image_free(pixels);
+                format = block_format;
+                recompressed = texture_compress_rgba(std::move(resized), layer_width, layer_height, format);
+                blocks = recompressed.data();
+                ++num_resized;
+                fprintf(stderr, "Warning : Image '%s' is %ux%u, so its cached blocks do not fit a %dx%d layer. It is compressed again.\n",
+                        batch[layer].path.c_str(), texture.width, texture.height, layer_width, layer_height);
+            }
+
+            for (uint32_t level = 0; level < num_levels; ++level)
+            {
+                uint32_t w = texture_level_dim(layer_width, level), h = texture_level_dim(layer_height, level);
+                size_t level_bytes = texture_level_bytes(format, w, h);
+                std::vector<unsigned char> converted;
+                const unsigned char *level_blocks = blocks;
+                if (format != block_format)
+                {
+                    converted = texture_bc1_to_bc3(blocks, level_bytes/texture_block_bytes(texture_bc1));
+                    level_blocks = converted.data();
+                }
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level, 0, 0, (GLint)layer, w, h, 1, internal_format,
+                                          (GLsizei)texture_level_bytes(block_format, w, h), level_blocks);
+                blocks += level_bytes;
+            }
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        array->bytes = texture_chain_bytes(block_format, layer_width, layer_height)*layers.size();
+        compressed = true;
+    }
+
+public:
+    //An array of layers of at most max_width x max_height texels (see above for the size they get). flip : flip the images vertically
+    //on load, like the meshes' textures.
+    texture_array(int max_width, int max_height, bool flip = true)
+        : max_width(max_width), max_height(max_height), layer_width(0), layer_height(0), flip(flip), built(false), block_format(texture_bc1), compressed(false),
+          num_resized(0), build_ms(0.0f)
+    {
+        array = std::make_shared<mesh_texture>();
+        array->tex = gl_texture::create();
+    }
+
+    texture_array(const texture_array &) = delete;
+    texture_array &operator=(const texture_array &) = delete;
+
+    //Add an image (before build()) and return its layer, for the meshes to use as their texture. Adding the same image again returns
+    //the same layer.
+    std::shared_ptr<mesh_texture> add(const char *img_path)
+    {
+        if (built)
+        {
+            fprintf(stderr, "Error : Image '%s' was added to a texture array that is already built. Exiting...\n", img_path);
+            exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+            if (paths[i] == img_path)
+                return layers[i];
+        }
+
+        std::shared_ptr<mesh_texture> layer = std::make_shared<mesh_texture>();
+        layer->array = array;
+        layer->layer = (unsigned int)layers.size();
+        layers.push_back(layer);
+        paths.push_back(img_path);
+        return layer;
+    }
+
+    //Decode and upload all the layers. flags : only mesh_compress_texture matters. num_threads is for the concurrent decode (see image_batch::decode()).
+    void build(unsigned int flags = 0, unsigned int num_threads = 0)
+    {
+        start_build();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (flags & mesh_compress_texture)
+            build_compressed(num_threads);
+        else
+            build_uncompressed(num_threads);
+        std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        build_ms = elapsed.count();
+    }
+
+    //Allocate the layers and let a texture streamer fill them over the next frames (see texture_streamer::load_layers()). The layers
+    //are black until they arrive.
+    void build(texture_streamer &streamer)
+    {
+        start_build();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        allocate(GL_RGBA8);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        array->bytes = rgba_chain_bytes()*layers.size();
+        streamer.load_layers(array, paths, flip);
+        std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        build_ms = elapsed.count();
+    }
+
+    //Bind the array to a texture unit, once for all the meshes that use its layers.
+    void bind(GLenum unit = GL_TEXTURE0) const
+    {
+        glActiveTexture(unit);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array->tex.get());
+    }
+
+    void unbind() const
+    {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    size_t size() const
+    {
+        return layers.size();
+    }
+
+    //Size of all the layers and their mipmaps.
+    size_t get_gpu_memory_bytes() const
+    {
+        return array->bytes;
+    }
+
+    void print_stats(const char *title = "Texture array") const
+    {
+        printf("%s : %u layers of %dx%d (%s), %.1f MB, %u images resampled, built in %.1f ms.\n", title, (unsigned int)layers.size(), layer_width, layer_height,
+               compressed ? ((block_format == texture_bc3) ? "BC3" : "BC1") : "rgba", array->bytes/(1024.0f*1024.0f), num_resized, build_ms);
+        for (size_t i = 0; i < paths.size(); ++i)
+            printf("    layer %u  %s\n", (unsigned int)i, paths[i].c_str());
+    }
+};
+
+#endif
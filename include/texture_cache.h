@@ -0,0 +1,185 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include<cstdio>
+#include<cstdint>
+#include<cstring>
+#include<memory>
+#include<string>
+#include<vector>
+
+#include"mapped_file.h"
+#include"mesh_cache.h"
+#include"texture_compress.h"
+#include"stb_image.h"
+
+//Compressed texture cache, the texture counterpart of mesh_cache.h. The first time an image is loaded compressed, it is decoded, block
+//compressed with its whole mip chain (see texture_compress.h) and written next to it as '<img_path>.texcache', or as
+//'<img_path>.flipped.texcache' if it was flipped vertically on load (so an image used both ways keeps 2 caches instead of thrashing 1).
+//Later loads map the cache file and hand its blocks straight to glCompressedTexImage2D(), so there is no image decoding, no compression
+//and no glGenerateMipmap(). The cache stores a hash of the image file it was built from, so editing the image invalidates it.
+//
+//File layout : texture_cache_header | the blocks of level 0 | of level 1 | ... | of the 1x1 level.
+
+
+
+const char texture_cache_magic[4] = { 'T', 'E', 'X', 'C' };
+const uint32_t texture_cache_version = 1; //Bump this whenever the file layout or the encoder's output changes.
+
+struct texture_cache_header
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t format; //texture_block_format.
+    uint32_t width, height; //Of level 0, in texels.
+    uint32_t num_levels;
+    uint32_t channels; //Of the source image.
+    uint32_t flipped; //1 if the image was flipped vertically on load (the meshes' textures are, the skybox faces are not).
+    uint64_t source_size; //Size and hash of the image file this cache was built from.
+    uint64_t source_hash;
+};
+
+//A block compressed texture and its mip chain, mapped from its cache file or (if the cache could not be written) in memory.
+struct compressed_texture
+{
+    std::unique_ptr<mapped_file> cache_file;
+    std::vector<unsigned char> blocks;
+    const unsigned char *data; //The levels, largest first. Null if there is no texture.
+    uint32_t format, width, height, num_levels, channels;
+    bool from_cache; //False if it was compressed by this load.
+
+    compressed_texture() : data(nullptr), format(texture_bc1), width(0), height(0), num_levels(0), channels(0), from_cache(false) {}
+
+    compressed_texture(compressed_texture &&) noexcept = default;
+    compressed_texture &operator=(compressed_texture &&) noexcept = default;
+
+    //Byte offset of a level from data.
+    size_t level_offset(uint32_t level) const
+    {
+        size_t offset = 0;
+        for (uint32_t i = 0; i < level; ++i)
+            offset += texture_level_bytes(format, texture_level_dim(width, i), texture_level_dim(height, i));
+        return offset;
+    }
+};
+
+
+
+inline std::string texture_cache_path(const char *img_path, bool flipped)
+{
+    return std::string(img_path) + (flipped ? ".flipped.texcache" : ".texcache");
+}
+
+//Return the header of a mapped cache file if it is valid for the given image file, otherwise nullptr (missing, stale, corrupt or truncated cache).
+inline const texture_cache_header *texture_cache_validate(const mapped_file &cache, bool flipped, uint64_t source_size, uint64_t source_hash)
+{
+    if (!cache.is_open() || cache.size() < sizeof(texture_cache_header))
+        return nullptr;
+
+    const texture_cache_header *header = (const texture_cache_header *)cache.data(); //Mapped memory is page aligned.
+    if (memcmp(header->magic, texture_cache_magic, 4) != 0 || header->version != texture_cache_version ||
+        (header->format != texture_bc1 && header->format != texture_bc3) || header->flipped != (flipped ? 1u : 0u) ||
+        header->source_size != source_size || header->source_hash != source_hash)
+        return nullptr;
+    if (header->width == 0 || header->height == 0 || header->num_levels != texture_num_levels(header->width, header->height))
+        return nullptr;
+    if (cache.size() != sizeof(texture_cache_header) + texture_chain_bytes(header->format, header->width, header->height))
+        return nullptr;
+    return header;
+}
+
+//Write the cache file, through a temporary file like mesh_cache_write(). Failing to write it is not an error, the image is simply
+//compressed again next time.
+inline bool texture_cache_write(const char *img_path, const texture_cache_header &header, const unsigned char *blocks, size_t num_bytes)
+{
+    std::string path = texture_cache_path(img_path, header.flipped != 0);
+    std::string temp_path = cache_temp_path(path);
+    FILE *fp = fopen(temp_path.c_str(), "wb");
+    if (fp == NULL)
+        return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    ok = ok && fwrite(blocks, 1, num_bytes, fp) == num_bytes;
+    ok = (fclose(fp) == 0) && ok;
+
+    if (ok)
+    {
+        remove(path.c_str()); //rename() does not overwrite existing files on Windows.
+        ok = rename(temp_path.c_str(), path.c_str()) == 0;
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "Warning : Could not write texture cache '%s'.\n", path.c_str());
+        remove(temp_path.c_str());
+    }
+    return ok;
+}
+
+//Get the compressed texture of an image : map its cache file, or decode, compress and cache it if there is no up-to-date cache.
+//Returns false if the image cannot be read or decoded. No OpenGL calls, so this can run on a worker thread.
+inline bool texture_cache_load(const char *img_path, bool flip, compressed_texture &texture)
+{
+    mapped_file img_file(img_path);
+    if (!img_file.is_open() || img_file.size() == 0)
+        return false;
+    uint64_t img_hash = mesh_cache_hash(img_file.data(), img_file.size());
+
+    std::unique_ptr<mapped_file> cache_file(new mapped_file(texture_cache_path(img_path, flip).c_str()));
+    const texture_cache_header *header = texture_cache_validate(*cache_file, flip, img_file.size(), img_hash);
+    if (header == nullptr)
+    {
+        //Decode straight from the mapped bytes, the file is already in memory for the hash.
+        int width, height, channels;
+        stbi_set_flip_vertically_on_load_thread(flip);
+        unsigned char *pixels = stbi_load_from_memory((const stbi_uc *)img_file.data(), (int)img_file.size(), &width, &height, &channels, 0);
+        if (!pixels)
+            return false;
+
+        texture_cache_header new_header;
+        memcpy(new_header.magic, texture_cache_magic, 4);
+        new_header.version = texture_cache_version;
+        new_header.format = texture_choose_format(channels);
+        new_header.width = (uint32_t)width;
+        new_header.height = (uint32_t)height;
+        new_header.num_levels = texture_num_levels(new_header.width, new_header.height);
+        new_header.channels = (uint32_t)channels;
+        new_header.flipped = flip ? 1u : 0u;
+        new_header.source_size = img_file.size();
+        new_header.source_hash = img_hash;
+        std::vector<unsigned char> blocks = texture_compress(pixels, new_header.width, new_header.height, channels, new_header.format);
+        stbi_image_free(pixels);
+
+        //Use the cache just written, so that the blocks live in the page cache instead of the heap. Keep them in memory if it failed.
+        if (texture_cache_write(img_path, new_header, blocks.data(), blocks.size()))
+        {
+            cache_file.reset(new mapped_file(texture_cache_path(img_path, flip).c_str()));
+            header = texture_cache_validate(*cache_file, flip, img_file.size(), img_hash);
+        }
+        if (header == nullptr)
+        {
+            texture.blocks = std::move(blocks);
+            texture.data = texture.blocks.data();
+            texture.format = new_header.format;
+            texture.width = new_header.width;
+            texture.height = new_header.height;
+            texture.num_levels = new_header.num_levels;
+            texture.channels = new_header.channels;
+            texture.from_cache = false;
+            return true;
+        }
+        texture.from_cache = false;
+    }
+    else
+        texture.from_cache = true;
+
+    texture.data = (const unsigned char *)(header + 1);
+    texture.format = header->format;
+    texture.width = header->width;
+    texture.height = header->height;
+    texture.num_levels = header->num_levels;
+    texture.channels = header->channels;
+    texture.cache_file = std::move(cache_file);
+    return true;
+}
+
+#endif
@@ -0,0 +1,411 @@
+#ifndef TEXTURE_COMPRESS_H
+#define TEXTURE_COMPRESS_H
+
+#include<cstdint>
+#include<cstring>
+#include<cmath>
+#include<vector>
+#include<algorithm>
+
+//Block compression of textures for the gpu (optional, see mesh_compress_texture in mesh.h). An uncompressed rgb texture costs 3-4 bytes
+//per texel, plus a third more for its mipmaps. The S3TC formats cut each 4x4 block of texels down to a fixed size, which the gpu
+//decodes on the fly when it samples :
+//- BC1 (DXT1) : 2 rgb565 end colors + a 2-bit index per texel into the 4 colors on the line between them. 8 bytes per block, 0.5 byte per texel.
+//- BC3 (DXT5) : a BC1 color block + 2 alpha end values and a 3-bit index per texel into 8 alphas between them. 16 bytes per block, 1 byte per texel.
+//The colors of a block are fitted along their principal axis (range fit, then 1 least squares step), the classic quality/speed tradeoff
+//of real time encoders. The mipmaps are box filtered here, like glGenerateMipmap() would, and compressed too.
+
+
+
+enum texture_block_format : uint32_t
+{
+    texture_bc1 = 0, //Opaque textures (1, 2 or 3 channels).
+    texture_bc3 = 1 //Textures with alpha (4 channels).
+};
+
+inline texture_block_format texture_choose_format(int channels)
+{
+    return (channels == 4) ? texture_bc3 : texture_bc1;
+}
+
+inline size_t texture_block_bytes(uint32_t format)
+{
+    return (format == texture_bc3) ? 16 : 8;
+}
+
+//Bytes of 1 mip level. Partial blocks at the right and bottom edges take a whole block.
+inline size_t texture_level_bytes(uint32_t format, uint32_t width, uint32_t height)
+{
+    return (size_t)((width + 3)/4)*((height + 3)/4)*texture_block_bytes(format);
+}
+
+//Number of mip levels down to 1x1.
+inline uint32_t texture_num_levels(uint32_t width, uint32_t height)
+{
+    uint32_t num_levels = 1;
+    for (uint32_t size = std::max(width, height); size > 1; size /= 2)
+        ++num_levels;
+    return num_levels;
+}
+
+inline uint32_t texture_level_dim(uint32_t dim, uint32_t level)
+{
+    return std::max(dim >> level, 1u);
+}
+
+//Bytes of the whole mip chain.
+inline size_t texture_chain_bytes(uint32_t format, uint32_t width, uint32_t height)
+{
+    size_t bytes = 0;
+    for (uint32_t level = 0; level < texture_num_levels(width, height); ++level)
+        bytes += texture_level_bytes(format, texture_level_dim(width, level), texture_level_dim(height, level));
+    return bytes;
+}
+
+
+
+inline uint16_t texture_pack_565(const float rgb[3])
+{
+    int r = (int)std::lround(std::min(std::max(rgb[0], 0.0f), 255.0f)*31.0f/255.0f);
+    int g = (int)std::lround(std::min(std::max(rgb[1], 0.0f), 255.0f)*63.0f/255.0f);
+    int b = (int)std::lround(std::min(std::max(rgb[2], 0.0f), 255.0f)*31.0f/255.0f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+//The 8-bit color the gpu expands a 565 color to.
+inline void texture_unpack_565(uint16_t c, float rgb[3])
+{
+    int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    rgb[0] = (float)((r << 3) | (r >> 2));
+    rgb[1] = (float)((g << 2) | (g >> 4));
+    rgb[2] = (float)((b << 3) | (b >> 2));
+}
+
+//The 4 colors of a block in 4-color mode, in index order : c0, c1, 2/3 c0 + 1/3 c1, 1/3 c0 + 2/3 c1.
+inline void texture_bc1_palette(uint16_t c0, uint16_t c1, float palette[4][3])
+{
+    texture_unpack_565(c0, palette[0]);
+    texture_unpack_565(c1, palette[1]);
+    for (int k = 0; k < 3; ++k)
+    {
+        palette[2][k] = (2.0f*palette[0][k] + palette[1][k])/3.0f;
+        palette[3][k] = (palette[0][k] + 2.0f*palette[1][k])/3.0f;
+    }
+}
+
+//Pick the nearest palette color of every texel. Returns the squared error of the block.
+inline float texture_bc1_indices(const float texels[16][3], const float palette[4][3], unsigned int indices[16])
+{
+    float error = 0.0f;
+    for (int i = 0; i < 16; ++i)
+    {
+        float best = 1e30f;
+        for (unsigned int p = 0; p < 4; ++p)
+        {
+            float dr = texels[i][0] - palette[p][0], dg = texels[i][1] - palette[p][1], db = texels[i][2] - palette[p][2];
+            float d = dr*dr + dg*dg + db*db;
+            if (d < best)
+            {
+                best = d;
+                indices[i] = p;
+            }
+        }
+        error += best;
+    }
+    return error;
+}
+
+//Encode 16 rgba texels (row major, 4 bytes each) into an 8-byte BC1 color block.
+inline void texture_encode_bc1_block(const unsigned char rgba[64], unsigned char block[8])
+{
+    float texels[16][3], mean[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; ++i)
+        for (int k = 0; k < 3; ++k)
+        {
+            texels[i][k] = (float)rgba[4*i + k];
+            mean[k] += texels[i][k]/16.0f;
+        }
+
+    //Principal axis of the colors (power iteration on their covariance matrix).
+    float cov[3][3] = {};
+    for (int i = 0; i < 16; ++i)
+        for (int a = 0; a < 3; ++a)
+            for (int b = 0; b < 3; ++b)
+                cov[a][b] += (texels[i][a] - mean[a])*(texels[i][b] - mean[b]);
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; ++iteration)
+    {
+        float next[3];
+        for (int a = 0; a < 3; ++a)
+            next[a] = cov[a][0]*axis[0] + cov[a][1]*axis[1] + cov[a][2]*axis[2];
+        float len = std::max(std::fabs(next[0]), std::max(std::fabs(next[1]), std::fabs(next[2])));
+        if (len < 1e-6f)
+            break; //Flat block : any axis does.
+        for (int a = 0; a < 3; ++a)
+            axis[a] = next[a]/len;
+    }
+
+    //Range fit : the extreme projections on the axis, pulled in by 1/16 of the range (the end colors are rarely hit exactly).
+    float t_min = 1e30f, t_max = -1e30f;
+    for (int i = 0; i < 16; ++i)
+    {
+        float t = (texels[i][0] - mean[0])*axis[0] + (texels[i][1] - mean[1])*axis[1] + (texels[i][2] - mean[2])*axis[2];
+        t_min = std::min(t_min, t);
+        t_max = std::max(t_max, t);
+    }
+    float inset = (t_max - t_min)/16.0f;
+    float end0[3], end1[3];
+    for (int k = 0; k < 3; ++k)
+    {
+        end0[k] = mean[k] + axis[k]*(t_max - inset);
+        end1[k] = mean[k] + axis[k]*(t_min + inset);
+    }
+
+    uint16_t c0 = texture_pack_565(end0), c1 = texture_pack_565(end1);
+    float palette[4][3];
+    unsigned int indices[16];
+    texture_bc1_palette(c0, c1, palette);
+    float error = texture_bc1_indices(texels, palette, indices);
+
+    //1 least squares step : the end colors that minimize the error for the indices just chosen.
+    const float weights[4] = { 1.0f, 0.0f, 2.0f/3.0f, 1.0f/3.0f }; //Weight of c0 per index.
+    float aa = 0.0f, bb = 0.0f, ab = 0.0f, ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; ++i)
+    {
+        float a = weights[indices[i]], b = 1.0f - a;
+        aa += a*a;
+        bb += b*b;
+        ab += a*b;
+        for (int k = 0; k < 3; ++k)
+        {
+            ax[k] += a*texels[i][k];
+            bx[k] += b*texels[i][k];
+        }
+    }
+    float det = aa*bb - ab*ab;
+    if (std::fabs(det) > 1e-6f)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            end0[k] = (ax[k]*bb - bx[k]*ab)/det;
+            end1[k] = (bx[k]*aa - ax[k]*ab)/det;
+        }
+        uint16_t refined_c0 = texture_pack_565(end0), refined_c1 = texture_pack_565(end1);
+        float refined_palette[4][3];
+        unsigned int refined_indices[16];
+        texture_bc1_palette(refined_c0, refined_c1, refined_palette);
+        float refined_error = texture_bc1_indices(texels, refined_palette, refined_indices);
+        if (refined_error < error)
+        {
+            c0 = refined_c0;
+            c1 = refined_c1;
+            memcpy(indices, refined_indices, sizeof(indices));
+        }
+    }
+
+    //c0 > c1 selects the 4-color mode. Swapping the end colors swaps indices 0 <-> 1 and 2 <-> 3.
+    if (c0 < c1)
+    {
+        std::swap(c0, c1);
+        for (int i = 0; i < 16; ++i)
+            indices[i] ^= 1u;
+    }
+    else if (c0 == c1)
+    {
+        for (int i = 0; i < 16; ++i)
+            indices[i] = 0; //3-color mode, but index 0 is c0 in both modes.
+    }
+
+    uint32_t bits = 0;
+    for (int i = 0; i < 16; ++i)
+        bits |= indices[i] << (2*i);
+    block[0] = (unsigned char)(c0 & 0xFF);
+    block[1] = (unsigned char)(c0 >> 8);
+    block[2] = (unsigned char)(c1 & 0xFF);
+    block[3] = (unsigned char)(c1 >> 8);
+    memcpy(block + 4, &bits, 4); //Little endian, like every platform the demos run on.
+}
+
+//Encode the alpha of 16 rgba texels into an 8-byte BC3 alpha block (8-value mode : a0 > a1, 6 alphas interpolated between them).
+inline void texture_encode_bc3_alpha_block(const unsigned char rgba[64], unsigned char block[8])
+{
+    unsigned char a0 = 0, a1 = 255;
+    for (int i = 0; i < 16; ++i)
+    {
+        a0 = std::max(a0, rgba[4*i + 3]);
+        a1 = std::min(a1, rgba[4*i + 3]);
+    }
+
+    uint64_t bits = 0;
+    if (a0 != a1)
+    {
+        float alphas[8] = { (float)a0, (float)a1 };
+        for (int p = 1; p < 7; ++p)
+            alphas[p + 1] = ((7 - p)*(float)a0 + p*(float)a1)/7.0f;
+        for (int i = 0; i < 16; ++i)
+        {
+            uint64_t best_index = 0;
+            float best = 1e30f;
+            for (uint64_t p = 0; p < 8; ++p)
+            {
+                float d = std::fabs((float)rgba[4*i + 3] - alphas[p]);
+                if (d < best)
+                {
+                    best = d;
+                    best_index = p;
+                }
+            }
+            bits |= best_index << (3*i);
+        }
+    }
+
+    block[0] = a0;
+    block[1] = a1;
+    for (int k = 0; k < 6; ++k)
+        block[2 + k] = (unsigned char)(bits >> (8*k));
+}
+
+//Encode a whole image (rgba, 4 bytes per texel) as a sequence of blocks, row of blocks by row of blocks.
+inline void texture_encode_level(const unsigned char *rgba, uint32_t width, uint32_t height, uint32_t format, unsigned char *out)
+{
+    unsigned char texels[64];
+    for (uint32_t by = 0; by < height; by += 4)
+        for (uint32_t bx = 0; bx < width; bx += 4)
+        {
+            //Texels past the edges repeat the last row/column, so they do not pull the end colors away.
+            for (uint32_t y = 0; y < 4; ++y)
+                for (uint32_t x = 0; x < 4; ++x)
+                {
+                    uint32_t sx = std::min(bx + x, width - 1), sy = std::min(by + y, height - 1);
+                    memcpy(texels + 4*(4*y + x), rgba + 4*((size_t)sy*width + sx), 4);
+                }
+            if (format == texture_bc3)
+            {
+                texture_encode_bc3_alpha_block(texels, out);
+                out += 8;
+            }
+            texture_encode_bc1_block(texels, out);
+            out += 8;
+        }
+}
+
+//Half size rgba image, each texel the average of (up to) 4 texels.
+inline void texture_downsample(const unsigned char *rgba, uint32_t width, uint32_t height, std::vector<unsigned char> &half)
+{
+    uint32_t half_width = std::max(width/2, 1u), half_height = std::max(height/2, 1u);
+    half.resize((size_t)half_width*half_height*4);
+    for (uint32_t y = 0; y < half_height; ++y)
+        for (uint32_t x = 0; x < half_width; ++x)
+        {
+            uint32_t x0 = std::min(2*x, width - 1), x1 = std::min(2*x + 1, width - 1);
+            uint32_t y0 = std::min(2*y, height - 1), y1 = std::min(2*y + 1, height - 1);
+            for (int k = 0; k < 4; ++k)
+            {
+                unsigned int sum = rgba[4*((size_t)y0*width + x0) + k] + rgba[4*((size_t)y0*width + x1) + k] +
+                                   rgba[4*((size_t)y1*width + x0) + k] + rgba[4*((size_t)y1*width + x1) + k];
+                half[4*((size_t)y*half_width + x) + k] = (unsigned char)((sum + 2)/4);
+            }
+        }
+}
+
+//Expand an image (1-4 channels, as stbi_load() returns it) to rgba. 1 and 2 channel images keep their meaning (red, red + green) : the
+//missing channels are 0, like the gpu fills them for GL_RED and GL_RG.
+inline void texture_expand_rgba(const unsigned char *pixels, uint32_t width, uint32_t height, int channels, std::vector<unsigned char> &rgba)
+{
+    rgba.resize((size_t)width*height*4);
+    for (size_t i = 0; i < (size_t)width*height; ++i)
+    {
+        const unsigned char *p = pixels + i*channels;
+        unsigned char *q = rgba.data() + 4*i;
+        q[0] = p[0];
+        q[1] = (channels >= 2) ? p[1] : 0;
+        q[2] = (channels >= 3) ? p[2] : 0;
+        q[3] = (channels == 4) ? p[3] : 255;
+    }
+}
+
+//Resize an rgba image. It is box filtered by halves while it is at least twice as large as asked (like its mipmaps would be), and
+//the rest of the way (or up) is bilinear.
+inline void texture_resample(const unsigned char *rgba, uint32_t width, uint32_t height, uint32_t new_width, uint32_t new_height,
+                             std::vector<unsigned char> &resized)
+{
+    std::vector<unsigned char> current(rgba, rgba + (size_t)width*height*4), half;
+    while (width >= 2*new_width && height >= 2*new_height)
+    {
+        texture_downsample(current.data(), width, height, half);
+        current.swap(half);
+        width /= 2;
+        height /= 2;
+    }
+    if (width == new_width && height == new_height)
+    {
+        resized.swap(current);
+        return;
+    }
+
+    resized.resize((size_t)new_width*new_height*4);
+    for (uint32_t y = 0; y < new_height; ++y)
+    {
+        float v = std::min(std::max(((float)y + 0.5f)*height/new_height - 0.5f, 0.0f), (float)(height - 1)); //Texel centers.
+        uint32_t y0 = (uint32_t)v, y1 = std::min(y0 + 1, height - 1);
+        float fy = v - (float)y0;
+        for (uint32_t x = 0; x < new_width; ++x)
+        {
+            float u = std::min(std::max(((float)x + 0.5f)*width/new_width - 0.5f, 0.0f), (float)(width - 1));
+            uint32_t x0 = (uint32_t)u, x1 = std::min(x0 + 1, width - 1);
+            float fx = u - (float)x0;
+            for (int k = 0; k < 4; ++k)
+            {
+                float top = (1.0f - fx)*current[4*((size_t)y0*width + x0) + k] + fx*current[4*((size_t)y0*width + x1) + k];
+                float bottom = (1.0f - fx)*current[4*((size_t)y1*width + x0) + k] + fx*current[4*((size_t)y1*width + x1) + k];
+                resized[4*((size_t)y*new_width + x) + k] = (unsigned char)((1.0f - fy)*top + fy*bottom + 0.5f);
+            }
+        }
+    }
+}
+
+//Compress an rgba image and its whole mip chain. The levels follow each other, largest first.
+inline std::vector<unsigned char> texture_compress_rgba(std::vector<unsigned char> rgba, uint32_t width, uint32_t height, uint32_t format)
+{
+    std::vector<unsigned char> half;
+    std::vector<unsigned char> blocks(texture_chain_bytes(format, width, height));
+    unsigned char *out = blocks.data();
+    while (true)
+    {
+        texture_encode_level(rgba.data(), width, height, format, out);
+        out += texture_level_bytes(format, width, height);
+        if (width == 1 && height == 1)
+            break;
+        texture_downsample(rgba.data(), width, height, half);
+        rgba.swap(half);
+        width = std::max(width/2, 1u);
+        height = std::max(height/2, 1u);
+    }
+    return blocks;
+}
+
+//Compress an image (1-4 channels, as stbi_load() returns it) and its whole mip chain (see texture_expand_rgba()).
+inline std::vector<unsigned char> texture_compress(const unsigned char *pixels, uint32_t width, uint32_t height, int channels, uint32_t format)
+{
+    std::vector<unsigned char> rgba;
+    texture_expand_rgba(pixels, width, height, channels, rgba);
+    return texture_compress_rgba(std::move(rgba), width, height, format);
+}
+
+//BC1 blocks as BC3 blocks (opaque alpha), so that images of both formats fit in 1 texture array. Lossless : the BC1 blocks of
+//texture_encode_bc1_block() are always in 4-color mode, which is the only mode of BC3's color blocks.
+inline std::vector<unsigned char> texture_bc1_to_bc3(const unsigned char *bc1, size_t num_blocks)
+{
+    std::vector<unsigned char> bc3(num_blocks*16);
+    for (size_t i = 0; i < num_blocks; ++i)
+    {
+        unsigned char *block = bc3.data() + 16*i;
+        block[0] = 255; //a0 = a1 = 255 and every index 0 : all texels opaque.
+        block[1] = 255;
+        memset(block + 2, 0, 6);
+        memcpy(block + 8, bc1 + 8*i, 8);
+    }
+    return bc3;
+}
+
+#endif
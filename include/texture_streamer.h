@@ -0,0 +1,467 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include<GL/glew.h>
+#include<algorithm>
+#include<chrono>
+#include<condition_variable>
+#include<cstdio>
+#include<cstdlib>
+#include<cstring>
+#include<deque>
+#include<limits>
+#include<memory>
+#include<mutex>
+#include<string>
+#include<thread>
+#include<vector>
+
+#include"mesh.h"
+#include"gl_handle.h"
+#include"thread_pool.h"
+
+//Texture uploads that never stall the main thread. glTexImage2D() from a client pointer copies the whole image before it returns, so a 2k
+//texture blocks the frame for as long as the copy takes, and a burst of them causes a visible hitch. The streamer uploads through a ring
+//of pixel buffer slots instead (1 buffer, mapped once with glBufferStorage, persistent and coherent, like instance_buffer.h) :
+//1) A worker thread decodes the image and copies its rows straight into a free slot of the mapped buffer, as many rows as fit. Images
+//   larger than a slot are split into strips of rows, each in a slot of its own.
+//2) The main thread calls update() once per frame. It issues glTexSubImage2D() for the filled slots, sourced from the buffer (so the call
+//   only queues a gpu copy), until a time budget is used up, and puts a fence behind each. A slot is handed to the workers again once its
+//   fence has signaled, i.e. once the gpu has read it.
+//load() returns the texture at once. Until its last strip is uploaded it has only level 0 enabled, so the rows appear as they arrive
+//(the rest is black). Then its mipmaps are generated (get_num_pending() counts the textures that are not there yet).
+//The layers of a texture array can be streamed too (see texture_array.h) : each image is resized to the layer size on its worker.
+//Only uncompressed images are streamed (for compressed ones, see texture_cache.h). Like every OpenGL object, the streamer must be used
+//on the main thread, and it must outlive the loads that are not ready yet (destroying it abandons them).
+//
+//Usage :
+//    texture_streamer streamer;
+//    std::shared_ptr<mesh_texture> grass = streamer.load("../images/texture/aerial_grass_rock_diff_2k.jpg");
+//    meshvft ground("../obj/vft/plane10x10.obj", grass);
+//    while (...)
+//    {
+//        streamer.update(2.0f);
+//        ground.draw_triangles();
+//    }
+
+
+
+class texture_streamer
+{
+private:
+    //1 texture being streamed : a 2d texture (1 image), a cube map (6 faces) or a texture array (1 image per layer).
+    struct stream
+    {
+        std::shared_ptr<mesh_texture> texture;
+        GLenum target; //GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP or GL_TEXTURE_2D_ARRAY.
+        bool allocated; //Storage is allocated with the size of the first strip that arrives (texture arrays come allocated).
+        GLsizei num_levels;
+        unsigned int images_left; //Images not fully uploaded yet.
+        int width, height, channels;
+    };
+
+    //Rows [first_row, first_row + num_rows) of 1 image, waiting in a slot to be uploaded.
+    struct strip
+    {
+        std::shared_ptr<stream> owner;
+        GLenum image_target; //GL_TEXTURE_2D, a face of the cube map or GL_TEXTURE_2D_ARRAY.
+        int layer; //Of the texture array.
+        std::string path;
+        int width, height, channels;
+        int first_row, num_rows; //num_rows = 0 : the image could not be streamed, see too_wide.
+        bool too_wide; //Its rows do not fit in a slot. Otherwise num_rows = 0 means that it could not be decoded.
+        unsigned int slot;
+    };
+
+    gl_buffer pbo;
+    unsigned char *mapped;
+    size_t slot_bytes;
+    unsigned int num_slots;
+
+    std::mutex mutex; //Guards free_slots, strips and stopping.
+    std::condition_variable slot_available;
+    std::deque<unsigned int> free_slots; //Slots the workers may fill.
+    std::deque<strip> strips; //Filled slots, in the order they were filled.
+    bool stopping;
+
+    std::deque<std::pair<unsigned int, GLsync>> in_flight; //Uploaded slots whose fence has not signaled yet, oldest first. Main thread only.
+    unsigned int num_pending; //Textures not fully uploaded yet. Main thread only.
+    size_t bytes_streamed; //Main thread only.
+    thread_pool pool; //Declared last, so that it is destroyed (and its workers joined) first : the jobs use the slots.
+
+    //Worker side : wait for a free slot. Returns false if the streamer is being destroyed.
+    bool acquire_slot(unsigned int &slot)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        slot_available.wait(lock, [this] { return stopping || !free_slots.empty(); });
+        if (stopping)
+            return false;
+        slot = free_slots.front();
+        free_slots.pop_front();
+        return true;
+    }
+
+    void push_strip(strip &&filled)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        strips.push_back(std::move(filled));
+    }
+
+    //Worker side : decode an image and copy it, strip by strip, into the ring.
+    //The layers of a texture array are loaded as rgba and resized to the array's size.
+    void stream_image(std::shared_ptr<stream> owner, GLenum image_target, int layer, std::string path, bool flip)
+    {
+        int width, height, channels;
+        stbi_set_flip_vertically_on_load_thread(flip); //Per thread, like mesh::prepare_texture().
+        bool is_layer = (image_target == GL_TEXTURE_2D_ARRAY);
+        unsigned char *pixels = stbi_load(path.c_str(), &width, &height, &channels, is_layer ? 4 : 0);
+        std::vector<unsigned char> resized;
+        if (pixels && is_layer)
+        {
+            channels = 4;
+            if (width != owner->width || height != owner->height)
+            {
+                texture_resample(pixels, (uint32_t)width, (uint32_t)height, (uint32_t)owner->width, (uint32_t)owner->height, resized);
+                width = owner->width;
+                height = owner->height;
+            }
+        }
+        const unsigned char *rows = resized.empty() ? pixels : resized.data();
+
+        strip filled;
+        filled.owner = owner;
+        filled.image_target = image_target;
+        filled.layer = layer;
+        filled.path = path;
+        filled.width = pixels ? width : 0;
+        filled.height = pixels ? height : 0;
+        filled.channels = pixels ? channels : 0;
+        filled.first_row = 0;
+        filled.num_rows = 0;
+        size_t row_bytes = pixels ? (size_t)width*channels : 0;
+        filled.too_wide = (row_bytes > slot_bytes);
+        if (filled.too_wide)
+        {
+            stbi_image_free(pixels);
+            pixels = nullptr; //Reported by upload_strip(), on the main thread.
+        }
+        if (!pixels)
+        {
+            if (acquire_slot(filled.slot))
+                push_strip(std::move(filled));
+            return;
+        }
+
+        int rows_per_slot = (int)(slot_bytes/row_bytes);
+        for (int row = 0; row < height; row += rows_per_slot)
+        {
+            if (!acquire_slot(filled.slot))
+                break;
+            filled.first_row = row;
+            filled.num_rows = std::min(rows_per_slot, height - row);
+            memcpy(mapped + filled.slot*slot_bytes, rows + row*row_bytes, filled.num_rows*row_bytes);
+            push_strip(strip(filled));
+        }
+        stbi_image_free(pixels);
+    }
+
+    //Main thread side : hand the slots whose upload the gpu has finished back to the workers. With wait, block until at least 1 is back.
+    void reclaim_slots(bool wait)
+    {
+        unsigned int num_reclaimed = 0;
+        while (!in_flight.empty())
+        {
+            bool block = wait && num_reclaimed == 0;
+            GLenum status = glClientWaitSync(in_flight.front().second, GL_SYNC_FLUSH_COMMANDS_BIT, block ? 1000000 : 0);
+            while (status == GL_TIMEOUT_EXPIRED && block)
+                status = glClientWaitSync(in_flight.front().second, 0, 1000000);
+            if (status == GL_TIMEOUT_EXPIRED)
+                break; //The later slots were uploaded later, so they are not done either.
+            glDeleteSync(in_flight.front().second);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                free_slots.push_back(in_flight.front().first);
+            }
+            in_flight.pop_front();
+            ++num_reclaimed;
+        }
+        if (num_reclaimed > 0)
+            slot_available.notify_all();
+    }
+
+    //Main thread side : upload 1 strip from its slot.
+    void upload_strip(strip &filled)
+    {
+        stream &owner = *filled.owner;
+        if (filled.too_wide)
+        {
+            fprintf(stderr, "Error : Image '%s' has rows of %u bytes, more than a slot of the texture streamer (%u bytes). Exiting...\n",
+                    filled.path.c_str(), (unsigned int)((size_t)filled.width*filled.channels), (unsigned int)slot_bytes);
+            exit(EXIT_FAILURE);
+        }
+        if (filled.num_rows == 0)
+        {
+            fprintf(stderr, "Error : File '%s' was not found. Exiting...\n", filled.path.c_str());
+            exit(EXIT_FAILURE);
+        }
+
+        GLenum internal_format = GL_RGB8, format = GL_RGB;
+        if (filled.channels == 1)
+        {
+            internal_format = GL_R8;
+            format = GL_RED;
+        }
+        else if (filled.channels == 2)
+        {
+            internal_format = GL_RG8;
+            format = GL_RG;
+        }
+        else if (filled.channels == 4)
+        {
+            internal_format = GL_RGBA8;
+            format = GL_RGBA;
+        }
+
+        glBindTexture(owner.target, owner.texture->tex.get());
+        if (!owner.allocated)
+        {
+            owner.width = filled.width;
+            owner.height = filled.height;
+            owner.channels = filled.channels;
+            owner.num_levels = (owner.target == GL_TEXTURE_2D) ? (GLsizei)texture_num_levels(filled.width, filled.height) : 1;
+            glTexStorage2D(owner.target, owner.num_levels, internal_format, filled.width, filled.height);
+            glTexParameteri(owner.target, GL_TEXTURE_MAX_LEVEL, 0); //Until the mipmaps exist, so that the rows show as they arrive.
+            owner.allocated = true;
+
+            for (int w = owner.width, h = owner.height, level = 0; level < owner.num_levels; w = std::max(w/2, 1), h = std::max(h/2, 1), ++level)
+                owner.texture->bytes += (size_t)w*h*owner.channels*((owner.target == GL_TEXTURE_2D) ? 1 : 6);
+        }
+        if (filled.width != owner.width || filled.height != owner.height || filled.channels != owner.channels)
+        {
+            if (owner.target == GL_TEXTURE_CUBE_MAP)
+                fprintf(stderr, "Error : All 6 images of a cube map must have the same width, height, and channels ('%s' does not). Exiting...\n", filled.path.c_str());
+            else
+                fprintf(stderr, "Error : Image '%s' is %dx%d with %d channels, but its texture is %dx%d with %d channels. Exiting...\n",
+                        filled.path.c_str(), filled.width, filled.height, filled.channels, owner.width, owner.height, owner.channels);
+            exit(EXIT_FAILURE);
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo.get());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        if (owner.target == GL_TEXTURE_2D_ARRAY)
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, filled.first_row, filled.layer, filled.width, filled.num_rows, 1, format, GL_UNSIGNED_BYTE,
+                            (void*)(filled.slot*slot_bytes));
+        else
+            glTexSubImage2D(filled.image_target, 0, 0, filled.first_row, filled.width, filled.num_rows, format, GL_UNSIGNED_BYTE,
+                            (void*)(filled.slot*slot_bytes)); //An offset into the bound pixel buffer, not a client pointer.
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        in_flight.emplace_back(filled.slot, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+        bytes_streamed += (size_t)filled.num_rows*filled.width*filled.channels;
+
+        if (filled.first_row + filled.num_rows == filled.height && --owner.images_left == 0)
+        {
+            if (owner.num_levels > 1)
+            {
+                glTexParameteri(owner.target, GL_TEXTURE_MAX_LEVEL, owner.num_levels - 1);
+                glGenerateMipmap(owner.target);
+            }
+            --num_pending;
+        }
+        glBindTexture(owner.target, 0);
+    }
+
+    std::shared_ptr<stream> start(GLenum target, unsigned int num_images)
+    {
+        std::shared_ptr<stream> owner(new stream());
+        owner->texture = std::make_shared<mesh_texture>();
+        owner->texture->tex = gl_texture::create();
+        owner->target = target;
+        owner->allocated = false;
+        owner->num_levels = 1;
+        owner->images_left = num_images;
+        owner->width = owner->height = owner->channels = 0;
+        ++num_pending;
+        return owner;
+    }
+
+public:
+    //A ring of num_slots slots of slot_mb megabytes each. A slot must hold at least 1 row of every image. num_threads is the number of
+    //decoding threads (0 = one per hardware thread, minus the main thread).
+    texture_streamer(unsigned int num_slots = 4, float slot_mb = 4.0f, unsigned int num_threads = 0)
+        : mapped(nullptr), slot_bytes((size_t)(slot_mb*1024.0f*1024.0f)), num_slots(std::max(num_slots, 1u)), stopping(false),
+          num_pending(0), bytes_streamed(0), pool(num_threads)
+    {
+        pbo = gl_buffer::create();
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo.get());
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, this->num_slots*slot_bytes, nullptr, flags);
+        mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, this->num_slots*slot_bytes, flags);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (mapped == nullptr)
+        {
+            fprintf(stderr, "Error : Failed to map the %u slots of the texture streamer. Exiting...\n", this->num_slots);
+            exit(EXIT_FAILURE);
+        }
+        for (unsigned int slot = 0; slot < this->num_slots; ++slot)
+            free_slots.push_back(slot);
+    }
+
+    //Workers waiting for a slot give up, the running decodes are waited for (by the pool, which is destroyed first), the decodes that did
+    //not start are dropped. The buffer is unmapped when it is deleted.
+    ~texture_streamer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        slot_available.notify_all();
+        for (std::pair<unsigned int, GLsync> &slot : in_flight)
+            glDeleteSync(slot.second);
+    }
+
+    texture_streamer(const texture_streamer &) = delete;
+    texture_streamer &operator=(const texture_streamer &) = delete;
+
+    //Start streaming an image into a new 2d texture (wrapped and filtered like the meshes' textures). flip : flip vertically on load,
+    //like mesh::prepare_texture() does.
+    std::shared_ptr<mesh_texture> load(const char *img_path, bool flip = true)
+    {
+        std::shared_ptr<stream> owner = start(GL_TEXTURE_2D, 1);
+        glBindTexture(GL_TEXTURE_2D, owner->texture->tex.get());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        std::string path = img_path;
+        pool.submit([this, owner, path, flip]() { stream_image(owner, GL_TEXTURE_2D, 0, path, flip); });
+        return owner->texture;
+    }
+
+    //Start streaming 6 images into a new cube map (wrapped and filtered like the skybox's), in the skybox's order : right, left, top,
+    //bottom, front, back. The faces decode concurrently.
+    std::shared_ptr<mesh_texture> load_cube_map(const char *right_img_path, const char *left_img_path, const char *top_img_path, const char *bottom_img_path,
+                                                const char *front_img_path, const char *back_img_path)
+    {
+        std::shared_ptr<stream> owner = start(GL_TEXTURE_CUBE_MAP, 6);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, owner->texture->tex.get());
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+        const char *paths[6] = { right_img_path, left_img_path, top_img_path, bottom_img_path, front_img_path, back_img_path };
+        for (int i = 0; i < 6; i++)
+        {
+            std::string path = paths[i];
+            GLenum face = GL_TEXTURE_CUBE_MAP_POSITIVE_X + i;
+            pool.submit([this, owner, face, path]() { stream_image(owner, face, 0, path, false); });
+        }
+        return owner->texture;
+    }
+
+    //Start streaming images into the layers of a texture array (see texture_array.h), image i into layer i. The array must have its
+    //storage allocated (glTexStorage3D) as GL_RGBA8, with at least as many layers as images. Its mipmaps are generated once all the
+    //layers are uploaded.
+    void load_layers(std::shared_ptr<mesh_texture> array, const std::vector<std::string> &img_paths, bool flip = true)
+    {
+        GLint width = 0, height = 0, num_layers = 0, num_levels = 0, internal_format = 0;
+        glBindTexture(GL_TEXTURE_2D_ARRAY, array->tex.get());
+        glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, 0, GL_TEXTURE_HEIGHT, &height);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, 0, GL_TEXTURE_DEPTH, &num_layers);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D_ARRAY, 0, GL_TEXTURE_INTERNAL_FORMAT, &internal_format);
+        glGetTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_IMMUTABLE_LEVELS, &num_levels);
+        if (num_levels == 0 || internal_format != GL_RGBA8 || (size_t)num_layers < img_paths.size())
+        {
+            fprintf(stderr, "Error : The texture array to stream %u images into is not allocated as GL_RGBA8 with enough layers. Exiting...\n",
+                    (unsigned int)img_paths.size());
+            exit(EXIT_FAILURE);
+        }
+        if (img_paths.empty())
+        {
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+            return;
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0); //Until the mipmaps exist, like load().
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        std::shared_ptr<stream> owner(new stream());
+        owner->texture = std::move(array);
+        owner->target = GL_TEXTURE_2D_ARRAY;
+        owner->allocated = true;
+        owner->num_levels = num_levels;
+        owner->images_left = (unsigned int)img_paths.size();
+        owner->width = width;
+        owner->height = height;
+        owner->channels = 4;
+        ++num_pending;
+        for (size_t i = 0; i < img_paths.size(); ++i)
+        {
+            std::string path = img_paths[i];
+            int layer = (int)i;
+            pool.submit([this, owner, layer, path, flip]() { stream_image(owner, GL_TEXTURE_2D_ARRAY, layer, path, flip); });
+        }
+    }
+
+    //Upload the strips that the workers filled, until budget_ms milliseconds have passed. Call it once per frame on the main thread.
+    //A strip is never split, so at least 1 strip is uploaded per call. Returns the number of uploaded strips.
+    unsigned int update(float budget_ms = 2.0f)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        reclaim_slots(false);
+
+        unsigned int num_uploaded = 0;
+        while (true)
+        {
+            strip filled;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (strips.empty())
+                    break;
+                filled = std::move(strips.front());
+                strips.pop_front();
+            }
+            upload_strip(filled);
+            ++num_uploaded;
+
+            std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            if (elapsed.count() >= budget_ms)
+                break;
+        }
+        return num_uploaded;
+    }
+
+    //Block until every texture so far is ready, e.g. before the first frame if there is nothing to show without them.
+    void finish()
+    {
+        while (num_pending > 0)
+        {
+            if (update(std::numeric_limits<float>::infinity()) == 0)
+            {
+                //Nothing filled : the workers are decoding, or waiting for slots that the gpu still reads.
+                if (!in_flight.empty())
+                    reclaim_slots(true);
+                else
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+    //Textures that are not fully uploaded yet.
+    unsigned int get_num_pending() const
+    {
+        return num_pending;
+    }
+
+    //Bytes of pixels uploaded so far, over all textures.
+    size_t get_bytes_streamed() const
+    {
+        return bytes_streamed;
+    }
+};
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include<algorithm>
+#include<condition_variable>
+#include<deque>
+#include<functional>
+#include<mutex>
+#include<thread>
+#include<vector>
+
+//Fixed set of worker threads that run submitted jobs in submission order. The threads are created once and sleep while there is no work,
+//so handing a job to the pool costs a lock and a wake up instead of a thread creation.
+//Jobs must not touch OpenGL : the context belongs to the main thread.
+
+
+
+class thread_pool
+{
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs; //Submitted jobs that no worker has picked up yet.
+    std::mutex mutex; //Guards jobs, num_busy and stopping.
+    std::condition_variable job_available, all_idle;
+    unsigned int num_busy; //Workers that are running a job right now.
+    bool stopping;
+
+    void work()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            job_available.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping)
+                return;
+
+            std::function<void()> job = std::move(jobs.front());
+            jobs.pop_front();
+            ++num_busy;
+            lock.unlock();
+            job();
+            job = nullptr; //Release whatever the job captured before reporting it done.
+            lock.lock();
+            --num_busy;
+            if (num_busy == 0 && jobs.empty())
+                all_idle.notify_all();
+        }
+    }
+
+public:
+    //num_threads = 0 means one thread per hardware thread, minus the main thread (which keeps rendering), and at least 1.
+    thread_pool(unsigned int num_threads = 0) : num_busy(0), stopping(false)
+    {
+        if (num_threads == 0)
+            num_threads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+        for (unsigned int i = 0; i < num_threads; ++i)
+            workers.emplace_back(&thread_pool::work, this);
+    }
+
+    //Jobs that have not started yet are dropped, running jobs are waited for.
+    ~thread_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            jobs.clear();
+        }
+        job_available.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+
+    //The workers refer to the pool, so it must never be copied or moved.
+    thread_pool(const thread_pool &) = delete;
+    thread_pool &operator=(const thread_pool &) = delete;
+
+    //Queue a job. It runs on one of the workers as soon as one is free.
+    void submit(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        job_available.notify_one();
+    }
+
+    //Block until every submitted job has finished.
+    void wait_idle()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        all_idle.wait(lock, [this] { return num_busy == 0 && jobs.empty(); });
+    }
+
+    unsigned int get_num_threads() const
+    {
+        return (unsigned int)workers.size();
+    }
+};
+
+#endif
@@ -0,0 +1,15 @@
+#version 450 core
+
+in vec2 uv;
+out vec4 frag_col;
+
+//1) This refers to the texture array bound to texture unit 0 (see texture_array.h), which holds the textures of the whole scene.
+//2) The layer of the mesh being drawn is set per draw call, so the array stays bound from one mesh to the next.
+uniform sampler2DArray sample_tex;
+uniform int layer;
+
+void main()
+{
+	//Sample the mesh's layer at the specified u,v coordinates.
+	frag_col = texture(sample_tex, vec3(uv, layer));
+}
@@ -0,0 +1,23 @@
+#version 450 core
+#extension GL_ARB_shader_draw_parameters : require
+
+layout(location = 0) in vec3 pos;
+
+//Per object data of a multi-draw indirect pass (see mesh_indirect.h). Draw i of the multi-draw uses objects[i].
+struct object_data
+{
+    mat4 model;
+    vec4 col;
+};
+layout(std430, binding = 0) readonly buffer object_buffer
+{
+    object_data objects[];
+};
+
+uniform mat4 dir_light_pv; //Precomputed projection*view matrix.
+
+void main()
+{
+    //The following operation, transforms all the scene's vertices (pos) to the directional light's (orthographic) view.
+    gl_Position = dir_light_pv*objects[gl_DrawIDARB].model*vec4(pos, 1.0f);
+}
@@ -0,0 +1,13 @@
+#version 450 core
+
+layout(location = 0) in vec3 pos; //snorm16, in [-1,1] (see mesh_quantize.h).
+
+uniform mat4 dir_light_pv; //Precomputed projection*view matrix.
+uniform mat4 model;
+uniform mat4 dequantization; //mesh::get_dequantization_matrix().
+
+void main()
+{
+    //The following operation, transforms all the scene's vertices (pos) to the directional light's (orthographic) view.
+    gl_Position = dir_light_pv*model*dequantization*vec4(pos, 1.0f);
+}
@@ -0,0 +1,17 @@
+#version 450 core
+
+layout(location = 0) in vec3 pos; //snorm16, in [-1,1] (see mesh_quantize.h).
+layout(location = 1) in vec2 tex; //Half floats.
+
+out vec2 uv;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+uniform mat4 dequantization; //mesh::get_dequantization_matrix().
+
+void main()
+{
+    gl_Position = projection*view*model*dequantization*vec4(pos,1.0f);
+    uv = tex;
+}
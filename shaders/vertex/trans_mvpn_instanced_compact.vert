@@ -0,0 +1,26 @@
+#version 450 core
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 norm;
+layout(location = 3) in vec4 pos_scale; //Per instance : position (xyz) and uniform scale (w). See instance_buffer.h.
+layout(location = 4) in vec4 rot; //Per instance : unit quaternion (x,y,z,w).
+
+out vec3 frag_pos;
+out vec3 normal;
+
+uniform mat4 projection;
+uniform mat4 view;
+
+//Rotate a vector by a unit quaternion.
+vec3 quat_rotate(vec4 q, vec3 v)
+{
+    return v + 2.0f*cross(q.xyz, cross(q.xyz, v) + q.w*v);
+}
+
+void main()
+{
+    frag_pos = quat_rotate(rot, pos_scale.w*pos) + pos_scale.xyz; //Fragment's position in world coordinates.
+    normal = quat_rotate(rot, norm); //The scale is uniform, so the normals only rotate (no inverse matrix needed).
+
+    gl_Position = projection*view*vec4(frag_pos, 1.0f); //Final vertex position.
+}
\ No newline at end of file
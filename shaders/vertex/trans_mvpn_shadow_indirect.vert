@@ -0,0 +1,35 @@
+#version 450 core
+#extension GL_ARB_shader_draw_parameters : require
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 norm;
+
+out vec3 frag_pos_world;
+out vec4 frag_pos_light;
+out vec3 normal;
+flat out vec3 object_col; //Replaces the mesh_col uniform (see dir_light_ad_shadow_indirect.frag).
+
+//Per object data of a multi-draw indirect pass (see mesh_indirect.h). Draw i of the multi-draw uses objects[i].
+struct object_data
+{
+    mat4 model;
+    vec4 col;
+};
+layout(std430, binding = 0) readonly buffer object_buffer
+{
+    object_data objects[];
+};
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform mat4 dir_light_pv; //Light's projection*view matrix.
+
+void main()
+{
+    mat4 model = objects[gl_DrawIDARB].model;
+    object_col = objects[gl_DrawIDARB].col.rgb;
+    frag_pos_world = vec3(model*vec4(pos,1.0f)); //Fragment's position in world coordinates.
+    frag_pos_light = dir_light_pv*model*vec4(pos, 1.0f);
+    normal = mat3(transpose(inverse(model)))*norm; //Avoiding non uniform scaling issues.
+    gl_Position = projection*view*model*vec4(pos, 1.0f); //Final vertex position.
+}
@@ -0,0 +1,32 @@
+#version 450 core
+
+layout(location = 0) in vec3 pos; //snorm16, in [-1,1] (see mesh_quantize.h).
+layout(location = 1) in vec2 norm; //Octahedral encoded normal.
+
+out vec3 frag_pos_world;
+out vec4 frag_pos_light;
+out vec3 normal;
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform mat4 model;
+uniform mat4 dir_light_pv; //Light's projection*view matrix.
+uniform mat4 dequantization; //mesh::get_dequantization_matrix().
+
+vec3 oct_decode(vec2 e)
+{
+    vec3 n = vec3(e.xy, 1.0f - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0f);
+    n.x += (n.x >= 0.0f) ? -t : t;
+    n.y += (n.y >= 0.0f) ? -t : t;
+    return normalize(n);
+}
+
+void main()
+{
+    vec4 local_pos = dequantization*vec4(pos, 1.0f); //Back to the mesh's local coordinates.
+    frag_pos_world = vec3(model*local_pos); //Fragment's position in world coordinates.
+    frag_pos_light = dir_light_pv*model*local_pos;
+    normal = mat3(transpose(inverse(model)))*oct_decode(norm); //Avoiding non uniform scaling issues.
+    gl_Position = projection*view*model*local_pos; //Final vertex position.
+}